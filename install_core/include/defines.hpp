@@ -676,6 +676,30 @@ enum class SphairaResult : Result {
     YatiNcmDbCorruptHeader,
     // unable to total infos from ncm database.
     YatiNcmDbCorruptInfos,
+    // buffer pool failed to allocate a buffer.
+    YatiBufferPoolOutOfMemory,
+    // timed out waiting for a buffer to be returned to the pool.
+    YatiBufferPoolTimeout,
+    // no journal entry found for the nca.
+    YatiJournalNotFound,
+    // journal entry is corrupt or from a different version.
+    YatiJournalInvalid,
+    // no tuning profile saved for the source type.
+    YatiTuningNotFound,
+    // tuning profile is corrupt or from a different version.
+    YatiTuningInvalid,
+    // a block of an nca section failed its hash tree verification.
+    YatiInvalidNcaSectionHash,
+    // no data was pushed to a stream before the idle timeout.
+    StreamIdleTimeout,
+    // nca is smaller than its header, or the source returned less than the nca size.
+    YatiInvalidNcaSize,
+    // an nca in the stream is an ncz, which has to go through the pipeline.
+    YatiNczInNcaStream,
+    // the mtp session closed before the file was fully sent, it may be sent again to resume.
+    StreamSessionClosed,
+    // too many files are still installing, the file can be sent again once one finishes.
+    StreamQueueBusy,
 };
 
 #define MAKE_SPHAIRA_RESULT_ENUM(x) Result_##x =  MAKERESULT(Module_Sphaira, (Result)SphairaResult::x)
@@ -793,6 +817,18 @@ enum : Result {
     MAKE_SPHAIRA_RESULT_ENUM(YatiCertNotFound),
     MAKE_SPHAIRA_RESULT_ENUM(YatiNcmDbCorruptHeader),
     MAKE_SPHAIRA_RESULT_ENUM(YatiNcmDbCorruptInfos),
+    MAKE_SPHAIRA_RESULT_ENUM(YatiBufferPoolOutOfMemory),
+    MAKE_SPHAIRA_RESULT_ENUM(YatiBufferPoolTimeout),
+    MAKE_SPHAIRA_RESULT_ENUM(YatiJournalNotFound),
+    MAKE_SPHAIRA_RESULT_ENUM(YatiJournalInvalid),
+    MAKE_SPHAIRA_RESULT_ENUM(YatiTuningNotFound),
+    MAKE_SPHAIRA_RESULT_ENUM(YatiTuningInvalid),
+    MAKE_SPHAIRA_RESULT_ENUM(YatiInvalidNcaSectionHash),
+    MAKE_SPHAIRA_RESULT_ENUM(StreamIdleTimeout),
+    MAKE_SPHAIRA_RESULT_ENUM(YatiInvalidNcaSize),
+    MAKE_SPHAIRA_RESULT_ENUM(YatiNczInNcaStream),
+    MAKE_SPHAIRA_RESULT_ENUM(StreamSessionClosed),
+    MAKE_SPHAIRA_RESULT_ENUM(StreamQueueBusy),
 };
 
 #undef MAKE_SPHAIRA_RESULT_ENUM
@@ -6,6 +6,16 @@ extern "C" {
 
 #define sphaira_USE_LOG 1
 
+// log levels, lines below LOG_MIN_LEVEL are compiled out entirely.
+#define LOG_LEVEL_DEBUG 0
+#define LOG_LEVEL_INFO 1
+#define LOG_LEVEL_WARN 2
+#define LOG_LEVEL_ERROR 3
+
+#ifndef LOG_MIN_LEVEL
+#define LOG_MIN_LEVEL LOG_LEVEL_INFO
+#endif
+
 #include <stdarg.h>
 
 #if sphaira_USE_LOG
@@ -15,6 +25,10 @@ void log_file_exit();
 bool log_is_init();
 
 void log_nxlink_exit();
+// lines are queued and written by a background thread, this blocks until
+// everything queued so far has been written.
+void log_flush();
+void log_write_level(int level, const char* s, ...) __attribute__ ((format (printf, 2, 3)));
 void log_write(const char* s, ...) __attribute__ ((format (printf, 1, 2)));
 void log_write_arg(const char* s, va_list* v);
 #else
@@ -26,10 +40,36 @@ inline bool log_nxlink_init() {
 }
 #define log_file_exit()
 #define log_nxlink_exit()
+#define log_flush()
+#define log_write_level(...)
 #define log_write(...)
 #define log_write_arg(...)
 #endif
 
+#if sphaira_USE_LOG && LOG_MIN_LEVEL <= LOG_LEVEL_DEBUG
+#define log_debug(...) log_write_level(LOG_LEVEL_DEBUG, __VA_ARGS__)
+#else
+#define log_debug(...) do {} while (0)
+#endif
+
+#if sphaira_USE_LOG && LOG_MIN_LEVEL <= LOG_LEVEL_INFO
+#define log_info(...) log_write_level(LOG_LEVEL_INFO, __VA_ARGS__)
+#else
+#define log_info(...) do {} while (0)
+#endif
+
+#if sphaira_USE_LOG && LOG_MIN_LEVEL <= LOG_LEVEL_WARN
+#define log_warn(...) log_write_level(LOG_LEVEL_WARN, __VA_ARGS__)
+#else
+#define log_warn(...) do {} while (0)
+#endif
+
+#if sphaira_USE_LOG && LOG_MIN_LEVEL <= LOG_LEVEL_ERROR
+#define log_error(...) log_write_level(LOG_LEVEL_ERROR, __VA_ARGS__)
+#else
+#define log_error(...) do {} while (0)
+#endif
+
 #ifdef __cplusplus
 }
 #endif
@@ -1,6 +1,8 @@
 #pragma once
 
+#include "defines.hpp"
 #include <switch.h>
+#include <atomic>
 #include <string>
 #include <vector>
 #include <span>
@@ -9,20 +11,24 @@ namespace sphaira::ui {
 
 struct ProgressBox {
     ProgressBox() {
-        ueventCreate(&m_uevent, true);
+        // not autoclear, as every nca being installed waits on it.
+        ueventCreate(&m_uevent, false);
     }
 
     ProgressBox& SetActionName(const std::string& action) {
+        SCOPED_MUTEX(&m_mutex);
         m_action = action;
         return *this;
     }
 
     ProgressBox& SetTitle(const std::string& title) {
+        SCOPED_MUTEX(&m_mutex);
         m_title = title;
         return *this;
     }
 
     ProgressBox& NewTransfer(const std::string& transfer) {
+        SCOPED_MUTEX(&m_mutex);
         m_transfer = transfer;
         m_offset = 0;
         m_size = 0;
@@ -30,6 +36,7 @@ struct ProgressBox {
     }
 
     ProgressBox& UpdateTransfer(s64 offset, s64 size) {
+        SCOPED_MUTEX(&m_mutex);
         m_offset = offset;
         m_size = size;
         return *this;
@@ -40,16 +47,20 @@ struct ProgressBox {
     }
 
     ProgressBox& SetImageData(std::vector<u8>& data) {
+        SCOPED_MUTEX(&m_mutex);
         m_image_data = data;
         return *this;
     }
 
     ProgressBox& SetImageDataConst(std::span<const u8> data) {
+        SCOPED_MUTEX(&m_mutex);
         m_image_data.assign(data.begin(), data.end());
         return *this;
     }
 
-    void RequestExit() {
+    // reason is returned by ShouldExitResult(), Result_TransferCancelled if the user cancelled.
+    void RequestExit(Result reason = Result_TransferCancelled) {
+        m_exit_result = reason;
         m_exit = true;
         ueventSignal(&m_uevent);
     }
@@ -59,7 +70,8 @@ struct ProgressBox {
     }
 
     Result ShouldExitResult() {
-        return 0;
+        R_UNLESS(!m_exit, m_exit_result.load());
+        R_SUCCEED();
     }
 
     UEvent* GetCancelEvent() {
@@ -71,8 +83,11 @@ struct ProgressBox {
     }
 
 private:
+    // the setters may be called from multiple install threads at once.
+    Mutex m_mutex{};
     UEvent m_uevent{};
-    bool m_exit{};
+    std::atomic_bool m_exit{};
+    std::atomic<Result> m_exit_result{};
     std::string m_action{};
     std::string m_title{};
     std::string m_transfer{};
@@ -0,0 +1,142 @@
+/*
+* Notes:
+* - process-wide pool of fixed size, page aligned buffers used by the install pipeline.
+* - buffers are handed out as move-only handles, which return the buffer
+*   to the pool once released / destroyed.
+* - freed buffers are cached and re-used, so an install does not hit the
+*   allocator (or memset) after the first few buffers.
+*/
+
+#pragma once
+
+#include <switch.h>
+#include <algorithm>
+#include <utility>
+
+namespace sphaira::yati {
+
+struct PooledBuffer;
+
+namespace pool {
+
+// size of every buffer in the pool.
+// 4MiB of data plus headroom for a single zstd output chunk.
+constexpr u64 BUFFER_SIZE = 1024 * 1024 * 4 + 1024 * 256;
+// alignment of every buffer, page aligned so that it can be used for dma / ipc.
+constexpr u64 BUFFER_ALIGN = 0x1000;
+// limit of memory the pool can allocate until an install sets it, see GetMemoryCapFor().
+constexpr u64 DEFAULT_MEMORY_CAP = BUFFER_SIZE * 24;
+// heap that GetMemoryCapFor() leaves free for the rest of the application.
+constexpr u64 HEAP_HEADROOM = 1024 * 1024 * 48;
+
+struct Stats {
+    u64 buffer_size{};
+    u64 memory_cap{};
+    // bytes currently allocated from the heap (cached + in use).
+    u64 allocated{};
+    // bytes currently borrowed.
+    u64 in_use{};
+    // bytes promised to users via Reserve().
+    u64 reserved{};
+    // the most bytes ever borrowed at once.
+    u64 high_water{};
+    u64 acquire_count{};
+    u64 alloc_count{};
+    // number of times an acquire had to wait for a buffer to be returned.
+    u64 wait_count{};
+};
+
+// sets the max amount of memory the pool will allocate, rounded down to the buffer size.
+// this does not free any buffers that are already allocated.
+void SetMemoryCap(u64 size);
+
+// returns the memory needed for count buffers, limited to what the heap can
+// still provide (less HEAP_HEADROOM), buffers the pool already holds count as free.
+auto GetMemoryCapFor(u64 count) -> u64;
+
+// fetches a buffer, blocking until one is returned if the cap has been reached.
+// if out already holds a buffer, it is released first.
+Result Acquire(PooledBuffer& out, u64 timeout = UINT64_MAX);
+
+// reserves count buffers from the memory cap, blocking until they are free.
+// as long as every user stays within its reservation, an acquire
+// will never wait forever, this is how concurrent pipelines avoid deadlocking.
+void Reserve(u64 count);
+// same as above, but returns false rather than blocking.
+bool TryReserve(u64 count);
+void Unreserve(u64 count);
+
+// frees every cached buffer that is not currently borrowed.
+void Trim();
+
+auto GetStats() -> Stats;
+void ResetStats();
+void LogStats();
+
+} // namespace pool
+
+// unique handle to a buffer borrowed from the pool.
+struct PooledBuffer {
+    PooledBuffer() = default;
+    ~PooledBuffer() { Release(); }
+
+    PooledBuffer(const PooledBuffer&) = delete;
+    PooledBuffer& operator=(const PooledBuffer&) = delete;
+
+    PooledBuffer(PooledBuffer&& other) noexcept {
+        *this = std::move(other);
+    }
+
+    PooledBuffer& operator=(PooledBuffer&& other) noexcept {
+        if (this != std::addressof(other)) {
+            Release();
+            std::swap(m_data, other.m_data);
+            std::swap(m_size, other.m_size);
+        }
+        return *this;
+    }
+
+    // returns the buffer to the pool, the handle is empty afterwards.
+    void Release();
+
+    auto IsValid() const -> bool {
+        return m_data;
+    }
+
+    auto data() -> u8* {
+        return m_data;
+    }
+
+    auto data() const -> const u8* {
+        return m_data;
+    }
+
+    auto size() const -> u64 {
+        return m_size;
+    }
+
+    auto capacity() const -> u64 {
+        return m_data ? pool::BUFFER_SIZE : 0;
+    }
+
+    auto empty() const -> bool {
+        return !m_size;
+    }
+
+    // sets the size of the valid data, contents are left untouched (no zero fill).
+    void resize(u64 size) {
+        m_size = std::min(size, capacity());
+    }
+
+    void clear() {
+        m_size = 0;
+    }
+
+private:
+    friend Result pool::Acquire(PooledBuffer& out, u64 timeout);
+
+    u8* m_data{};
+    u64 m_size{};
+};
+
+} // namespace sphaira::yati
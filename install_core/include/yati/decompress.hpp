@@ -0,0 +1,54 @@
+/*
+* Notes:
+* - the decompress stage of the install pipeline, for the data after the nca header.
+* - the loop is a template over the type of nca / config, so that the per
+*   buffer loop doesn't have to check them, the variant is picked once per nca.
+* - the caller handles the nca header, and sets up the parts of the state
+*   that the picked variant needs (see DecompressState).
+*/
+
+#pragma once
+
+#include "yati/pipeline.hpp"
+#include "yati/ncz_blocks.hpp"
+#include "yati/ncz_crypt.hpp"
+#include <switch.h>
+#include <memory>
+
+namespace sphaira::yati {
+
+// how the data after the nca header is handled, picked once per nca.
+enum class NcaMode {
+    // plain nca, passed through as is.
+    Plain,
+    // solid ncz, a single zstd stream.
+    NczSolid,
+    // block ncz, decompressed serially.
+    NczBlock,
+    // block ncz, decompressed in parallel by NczBlockDecompressor.
+    NczBlockParallel,
+};
+
+// state of the decompress thread, shared by every variant of the decompress loop.
+struct DecompressState {
+    // the buffer popped from the read thread.
+    ThreadBuffer tbuf{};
+    // ncz output that is yet to be flushed.
+    ThreadBuffer inflate_tbuf{};
+    s64 inflate_offset{};
+    // nca offset of the next byte passed to the write thread.
+    s64 written{};
+
+    // only used for block ncz, when more than one thread is enabled.
+    std::unique_ptr<NczBlockDecompressor> block_decompressor{};
+    // only used for ncz that needs re-encrypting, when not using the above.
+    std::unique_ptr<NczCtrCrypter> ctr_crypter{};
+};
+
+// runs the decompress loop until every byte up to the write size has been
+// passed on, or the read ring is closed.
+// crypt is false if every ncz section is plaintext, fused crypts and hashes
+// ncz output on this thread rather than leaving the hash to the hash thread.
+Result DecompressNca(PipelineData* t, DecompressState& s, NcaMode mode, bool crypt, bool fused);
+
+} // namespace sphaira::yati
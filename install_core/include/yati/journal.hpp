@@ -0,0 +1,92 @@
+/*
+* Notes:
+* - small on-sd journal used to resume an nca install that was interrupted,
+*   such as an mtp transfer dropping part way through.
+* - one file per nca, keyed by the content id.
+* - an entry is only ever written at an offset the install can restart from,
+*   so the hash state always matches the written offset.
+* - entries of installs that are never sent again are pruned at the start of
+*   an install session, by age and by the total size of their placeholders.
+* - the unit makes no libnx calls, file access is stdio / dirent only and
+*   placeholders are left for the caller to check / delete, so it is built and
+*   tested on the host against tests/host (see tests/test_journal.cpp).
+*/
+
+#pragma once
+
+#include <switch.h>
+#include <vector>
+
+namespace sphaira::yati::journal {
+
+constexpr u32 MAGIC = 0x4C4E4A42; // BJNL
+constexpr u32 VERSION = 2;
+
+// folder that journal entries are stored in.
+constexpr const char* JOURNAL_PATH = "/config/BBI/journal";
+
+// entries not saved for this long are pruned.
+constexpr u64 MAX_AGE_SECONDS = 60 * 60 * 24 * 7; // 7 days
+// total size of the placeholders kept for resuming, the oldest entries are pruned first.
+constexpr s64 MAX_TOTAL_SIZE = 1024LL * 1024LL * 1024LL * 32LL; // 32GiB
+
+// config options that change the data written to the placeholder.
+enum Flag : u32 {
+    Flag_IgnoreDistributionBit = 1 << 0,
+    Flag_ConvertToStandardCrypto = 1 << 1,
+    Flag_LowerMasterKey = 1 << 2,
+    Flag_HasHash = 1 << 3,
+};
+
+struct Entry {
+    u32 magic{MAGIC};
+    u32 version{VERSION};
+    NcmContentId content_id{};
+    NcmPlaceHolderId placeholder_id{};
+    // NcmStorageId the placeholder was created in.
+    u8 storage_id{};
+    u8 _0x29[0x3]{};
+    // Flag
+    u32 flags{};
+    // size of the nca in the source, used to detect a different file with the same id.
+    s64 source_size{};
+    // size of the nca once installed, taken from the nca header.
+    s64 write_size{};
+    // offset the placeholder has been written up to.
+    s64 written{};
+    // index of the first ncz block that has not been written, 0 if not a block ncz.
+    u64 block_index{};
+    // unix time the entry was last saved, set by Save().
+    u64 saved_at{};
+    // hash state of the data up to written, only valid if Flag_HasHash is set.
+    Sha256Context sha256{};
+};
+
+// what the current install would write.
+struct Target {
+    // size of the nca in the source.
+    s64 source_size{};
+    // NcmStorageId the nca is installed to.
+    u8 storage_id{};
+    // Flag
+    u32 flags{};
+};
+
+// loads the entry for the content id, fails if not found or invalid.
+Result Load(const NcmContentId& content_id, Entry& out, const char* dir = JOURNAL_PATH);
+// writes (or replaces) the entry.
+Result Save(const Entry& entry, const char* dir = JOURNAL_PATH);
+// deletes the entry, if any.
+void Remove(const NcmContentId& content_id, const char* dir = JOURNAL_PATH);
+
+// deletes entries saved more than max_age seconds before now, then the oldest
+// entries until the write size of the rest fits in max_size, the newest entry
+// is always kept. entries that fail to load are deleted too.
+// returns the deleted entries that name a placeholder, for the caller to delete.
+auto Prune(u64 now, u64 max_age = MAX_AGE_SECONDS, s64 max_size = MAX_TOTAL_SIZE, const char* dir = JOURNAL_PATH) -> std::vector<Entry>;
+
+// true if the install of target can continue from the entry, which needs the
+// output to be exactly the same as last time and the placeholder to still exist.
+auto CanResume(const Entry& entry, const Target& target, bool has_placeholder) -> bool;
+
+} // namespace sphaira::yati::journal
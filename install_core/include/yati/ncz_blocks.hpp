@@ -0,0 +1,189 @@
+/*
+* Notes:
+* - block ncz stores every block as an independent zstd frame, so blocks can be
+*   decompressed (and re-encrypted) in any order.
+* - compressed data is gathered into jobs of whole blocks, which are submitted
+*   to the thread pool, each worker using its own ZSTD_DCtx.
+* - jobs are collected in the order they were submitted, so the output is always in order.
+*/
+
+#pragma once
+
+#include "yati/pipeline.hpp"
+#include "yati/thread_pool.hpp"
+#include "yati/buffer_pool.hpp"
+#include "defines.hpp"
+#include <switch.h>
+#include <cstring>
+#include <deque>
+#include <memory>
+#include <span>
+
+namespace sphaira::yati {
+
+// a run of whole ncz blocks, decompressed by a single worker.
+struct NczBlockJob {
+    // compressed data of every block in the job.
+    PooledBuffer in{};
+    // decompressed data of every block in the job.
+    PooledBuffer out{};
+    u64 first_block{};
+    u64 block_count{};
+    u64 out_size{};
+    // nca offset of the decompressed data.
+    u64 nca_offset{};
+    Result rc{};
+};
+
+struct NczBlockDecompressor {
+    static constexpr u32 MAX_WORKERS = 4;
+    // max number of jobs in flight per worker.
+    static constexpr u32 JOBS_PER_WORKER = 2;
+
+    struct InFlight {
+        std::unique_ptr<NczBlockJob> job{};
+        ThreadPool::Future future{};
+    };
+
+    // returns true if every block fits in a single job.
+    static auto CanDecompress(const PipelineData* t) -> bool;
+
+    NczBlockDecompressor(ThreadPool* pool, const Placement& placement, PipelineData* _t, u32 worker_count);
+    ~NczBlockDecompressor();
+
+    // copies the compressed data into the current job, submitting the job
+    // once no more blocks fit.
+    // output is passed to on_output in order.
+    template<typename F>
+    Result Feed(std::span<const u8> data, F&& on_output) {
+        while (!data.empty()) {
+            R_UNLESS(m_next_block < t->ncz_blocks.size(), Result_YatiNczBlockNotFound);
+
+            // blocks before the resume point have already been written, so skip them.
+            if (m_next_block < t->resume_block) {
+                const auto size = std::min<u64>(data.size(), t->ncz_blocks[m_next_block].size - m_block_offset);
+                data = data.subspan(size);
+                m_block_offset += size;
+
+                if (m_block_offset == t->ncz_blocks[m_next_block].size) {
+                    const auto decompressed_size = t->GetNczBlockDecompressedSize(m_next_block);
+                    m_block_offset = 0;
+                    m_next_block++;
+                    m_nca_offset += decompressed_size;
+                    t->decompress_offset += decompressed_size;
+                    t->SkipOutput(decompressed_size);
+                }
+                continue;
+            }
+
+            if (!m_job.in.IsValid()) {
+                R_TRY(pool::Acquire(m_job.in));
+                m_job.first_block = m_next_block;
+                m_job.block_count = 0;
+                m_job.out_size = 0;
+                m_job.nca_offset = m_nca_offset;
+            }
+
+            const auto& block = t->ncz_blocks[m_next_block];
+            const auto size = std::min<u64>(data.size(), block.size - m_block_offset);
+            std::memcpy(m_job.in.data() + m_job.in.size(), data.data(), size);
+            m_job.in.resize(m_job.in.size() + size);
+            t->copied_size += size;
+            data = data.subspan(size);
+            m_block_offset += size;
+
+            if (m_block_offset == block.size) {
+                m_block_offset = 0;
+                m_job.block_count++;
+                m_job.out_size += t->GetNczBlockDecompressedSize(m_next_block);
+                m_next_block++;
+
+                if (m_next_block == t->ncz_blocks.size() || !JobHasSpace(m_next_block)) {
+                    R_TRY(Dispatch(on_output));
+                }
+            }
+        }
+
+        R_SUCCEED();
+    }
+
+    // submits the partial job and waits for every job to finish.
+    template<typename F>
+    Result Finish(F&& on_output) {
+        if (m_job.block_count) {
+            R_TRY(Dispatch(on_output));
+        }
+
+        while (!m_in_flight.empty()) {
+            R_TRY(RetireOne(on_output));
+        }
+
+        R_SUCCEED();
+    }
+
+private:
+    auto JobHasSpace(u64 index) const -> bool {
+        return m_job.in.size() + t->ncz_blocks[index].size <= m_job.in.capacity() &&
+            m_job.out_size + t->GetNczBlockDecompressedSize(index) <= INFLATE_BUFFER_MAX;
+    }
+
+    template<typename F>
+    Result Dispatch(F&& on_output) {
+        // the first job is covered by the pipeline's reservation, every other
+        // job has to reserve its input and output buffer from the pool.
+        // if it can't, wait for the oldest job instead.
+        while (!m_in_flight.empty()) {
+            if (m_in_flight.size() < m_max_jobs && pool::TryReserve(2)) {
+                m_reserved_jobs++;
+                break;
+            }
+            R_TRY(RetireOne(on_output));
+        }
+
+        auto job = std::make_unique<NczBlockJob>(std::move(m_job));
+        m_job.block_count = 0;
+        m_nca_offset += job->out_size;
+
+        const auto job_ptr = job.get();
+        auto future = m_pool->Submit([this, job_ptr](ThreadPool::Context& ctx) {
+            return Decompress(ctx.dctx, *job_ptr);
+        }, m_placement);
+
+        m_in_flight.emplace_back(std::move(job), std::move(future));
+        R_SUCCEED();
+    }
+
+    template<typename F>
+    Result RetireOne(F&& on_output) {
+        auto e = std::move(m_in_flight.front());
+        m_in_flight.pop_front();
+        const auto rc = e.future.Wait();
+
+        // the first job never holds a reservation.
+        if (m_reserved_jobs && m_reserved_jobs >= m_in_flight.size()) {
+            pool::Unreserve(2);
+            m_reserved_jobs--;
+        }
+
+        R_TRY(rc);
+        return on_output(e.job->out);
+    }
+
+    Result Decompress(ZSTD_DCtx* dctx, NczBlockJob& job) const;
+
+private:
+    ThreadPool* const m_pool;
+    const Placement m_placement;
+    PipelineData* t{};
+    u32 m_max_jobs{};
+    u32 m_reserved_jobs{};
+
+    NczBlockJob m_job{};
+    std::deque<InFlight> m_in_flight{};
+    u64 m_next_block{};
+    u64 m_block_offset{};
+    // compressed data starts after the (uncompressed) nca header.
+    u64 m_nca_offset{0x4000};
+};
+
+} // namespace sphaira::yati
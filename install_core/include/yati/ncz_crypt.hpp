@@ -0,0 +1,41 @@
+/*
+* Notes:
+* - re-encrypts the decompressed data of ncz sections with the section's aes-ctr key.
+* - the counter is computed from the nca offset, so any range can be crypted
+*   on its own, which is what allows a buffer to be split into shards.
+*/
+
+#pragma once
+
+#include "yati/nx/ncz.hpp"
+#include "yati/thread_pool.hpp"
+#include <switch.h>
+#include <span>
+
+namespace sphaira::yati {
+
+// re-encrypts decompressed ncz data, offset being the nca offset of the data.
+Result CryptNczSections(std::span<const ncz::Section> sections, u8* data, u64 size, u64 offset);
+
+// same as above, also hashing the crypted output in the same sweep.
+Result CryptHashNczSections(std::span<const ncz::Section> sections, u8* data, u64 size, u64 offset, Sha256Context* sha256);
+
+// re-encrypts solid ncz output, splitting large buffers into shards that
+// are crypted in parallel on the thread pool. the calling thread crypts the first shard.
+struct NczCtrCrypter {
+    // buffers smaller than this are not worth splitting.
+    static constexpr u64 MIN_SHARD_SIZE = 1024 * 256;
+
+    NczCtrCrypter(ThreadPool* pool, const Placement& placement, std::span<const ncz::Section> sections, u32 thread_count)
+    : m_pool{pool}, m_placement{placement}, m_sections{sections}, m_thread_count{thread_count} {}
+
+    Result Crypt(u8* data, u64 size, u64 offset);
+
+private:
+    ThreadPool* const m_pool;
+    const Placement m_placement;
+    const std::span<const ncz::Section> m_sections;
+    const u32 m_thread_count;
+};
+
+} // namespace sphaira::yati
@@ -1,6 +1,8 @@
 #pragma once
 
 #include <switch.h>
+#include <algorithm>
+#include <cstring>
 
 namespace sphaira::crypto {
 
@@ -46,10 +48,62 @@ private:
     bool m_is_encryptor;
 };
 
+// nca style aes-ctr, the upper 8 bytes of the counter are fixed and the lower
+// 8 bytes are the big-endian block index of the offset.
+// as the counter is computed from the offset, any range can be crypted on its own,
+// which allows for a buffer to be split up and crypted in parallel.
+struct Aes128Ctr {
+    Aes128Ctr(const void* key, const void* counter, u64 offset) {
+        std::memcpy(m_counter, counter, 0x8);
+        aes128CtrContextCreate(&m_ctx, key, m_counter);
+        Seek(offset);
+    }
+
+    void Seek(u64 offset) {
+        const auto block = __builtin_bswap64(offset >> 4);
+        std::memcpy(m_counter + 0x8, &block, 0x8);
+        aes128CtrContextResetCtr(&m_ctx, m_counter);
+
+        // advance the keystream if the offset is not block aligned.
+        if (const auto skip = offset & 0xF) {
+            u8 temp[0x10]{};
+            aes128CtrCrypt(&m_ctx, temp, temp, skip);
+        }
+    }
+
+    void Run(void *dst, const void *src, u64 size) {
+        aes128CtrCrypt(&m_ctx, dst, src, size);
+    }
+
+private:
+    Aes128CtrContext m_ctx;
+    u8 m_counter[0x10];
+};
+
 static inline void cryptoAes128(const void *in, void *out, const void* key, bool is_encryptor) {
     Aes128(key, is_encryptor).Run(out, in);
 }
 
+static inline void cryptoAes128Ctr(const void* in, void* out, const void* key, const void* counter, u64 offset, u64 size) {
+    Aes128Ctr(key, counter, offset).Run(out, in, size);
+}
+
+// size of each tile of a fused crypt + hash, small enough that the tile is
+// still in the l1 cache when it is hashed.
+constexpr u64 CRYPT_HASH_TILE_SIZE = 1024 * 16;
+
+// crypts the data and hashes the output in a single sweep, a tile at a time,
+// rather than streaming the whole buffer through the cache once per pass.
+// only built on the libnx aes / sha primitives, so it is the same on every target.
+static inline void cryptoAes128CtrSha256(const void* in, void* out, const void* key, const void* counter, u64 offset, u64 size, Sha256Context* sha256) {
+    Aes128Ctr ctr{key, counter, offset};
+    for (u64 pos = 0; pos < size; pos += CRYPT_HASH_TILE_SIZE) {
+        const auto tile = std::min(CRYPT_HASH_TILE_SIZE, size - pos);
+        ctr.Run(static_cast<u8*>(out) + pos, static_cast<const u8*>(in) + pos, tile);
+        sha256ContextUpdate(sha256, static_cast<const u8*>(out) + pos, tile);
+    }
+}
+
 static inline void cryptoAes128Xts(const void* in, void* out, const u8* key, u64 sector, u64 sector_size, u64 data_size, bool is_encryptor) {
     Aes128Xts(key, is_encryptor).Run(out, in, sector, sector_size, data_size);
 }
@@ -0,0 +1,242 @@
+/*
+* Notes:
+* - state shared by the stages of a single nca install, which are
+*   read -> decompress -> (hash) -> write, each running on its own worker.
+* - stages pass pooled buffers to each other through SpscRings, and store
+*   their result here so that the other stages can stop early.
+* - the source / ncm / journal side of an install is added by yati's
+*   ThreadData, so the stages in here can be run by the host tests.
+*/
+
+#pragma once
+
+#include "yati/buffer_pool.hpp"
+#include "yati/spsc_ring.hpp"
+#include "yati/tuner.hpp"
+#include "yati/nx/ncz.hpp"
+#include "defines.hpp"
+#include <switch.h>
+#include <zstd.h>
+#include <atomic>
+#include <vector>
+
+namespace sphaira::yati {
+
+constexpr u64 INFLATE_BUFFER_MAX = 1024*1024*4;
+// inflate buffer may go over the max by a single zstd output chunk (128KiB).
+static_assert(pool::BUFFER_SIZE >= INFLATE_BUFFER_MAX + 1024*128);
+
+struct ThreadBuffer {
+    // valid data, skipping the first start bytes of the buffer.
+    auto data() -> u8* {
+        return buf.data() + start;
+    }
+
+    auto size() const -> u64 {
+        return buf.size() - start;
+    }
+
+    PooledBuffer buf{};
+    s64 off{};
+    // offset of the first valid byte, set when a read buffer is passed
+    // through as is, rather than copying its tail into a fresh buffer.
+    u64 start{};
+    // hash state once this buffer has been hashed, saved to the journal by the write thread.
+    Sha256Context sha256{};
+};
+
+struct PipelineData {
+    // write_size is the size of the nca, until the header says otherwise.
+    PipelineData(bool _hash, s64 _write_size) : hash_enabled{_hash}, hash_running{_hash} {
+        ueventCreate(&m_uevent_done, false);
+        ueventCreate(&m_uevent_progres, true);
+
+        sha256ContextCreate(&sha256);
+        write_size = _write_size;
+
+        read_buffer_size = tuner::MAX_CHUNK_SIZE;
+    }
+
+    virtual ~PipelineData() = default;
+
+    // result of the first stage to fail, checked by every stage.
+    virtual auto GetResults() volatile -> Result;
+    void WakeAllThreads();
+
+    auto IsAnyRunning() volatile const -> bool {
+        return read_running || decompress_running || hash_running || write_running;
+    }
+
+    auto GetWriteOffset() volatile const -> s64 {
+        return write_offset;
+    }
+
+    auto GetWriteSize() volatile const -> s64 {
+        return write_size;
+    }
+
+    auto GetDoneEvent() {
+        return &m_uevent_done;
+    }
+
+    auto GetProgressEvent() {
+        return &m_uevent_progres;
+    }
+
+    void SetReadResult(Result result) {
+        read_result = result;
+        if (R_FAILED(result)) {
+            WakeAllThreads();
+            ueventSignal(GetDoneEvent());
+        }
+    }
+
+    void SetDecompressResult(Result result) {
+        decompress_result = result;
+        if (R_FAILED(result)) {
+            WakeAllThreads();
+            ueventSignal(GetDoneEvent());
+        }
+    }
+
+    void SetHashResult(Result result) {
+        hash_result = result;
+        if (R_FAILED(result)) {
+            WakeAllThreads();
+            ueventSignal(GetDoneEvent());
+        }
+    }
+
+    void SetWriteResult(Result result) {
+        write_result = result;
+        if (R_FAILED(result)) {
+            WakeAllThreads();
+        }
+        ueventSignal(GetDoneEvent());
+    }
+
+    // decompressed size of the ncz block at index.
+    auto GetNczBlockDecompressedSize(u64 index) const -> u64 {
+        const u64 block_size = 1ULL << ncz_block_header.block_size_exponent;
+        // https://github.com/nicoboss/nsz/issues/79
+        // the last block may be smaller, unless the size is a multiple of the block size.
+        if (index == ncz_blocks.size() - 1) {
+            if (const auto remainder = ncz_block_header.decompressed_size % block_size) {
+                return remainder;
+            }
+        }
+        return block_size;
+    }
+
+    // borrows a buffer from the pool if buf doesn't already hold one.
+    Result AcquireBuffer(PooledBuffer& buf) {
+        if (!buf.IsValid()) {
+            R_TRY(pool::Acquire(buf));
+        }
+        R_SUCCEED();
+    }
+
+    // passes the buffer to the decompress thread, buf is empty on return.
+    Result PushDecompressBuf(ThreadBuffer& buf) {
+        if (!read_buffers.Push(buf)) {
+            // the decompress thread has exited, report its result (if any).
+            return GetResults();
+        }
+        R_SUCCEED();
+    }
+
+    // passes the buffer to the hash thread if enabled, otherwise straight
+    // to the write thread. buf is empty on return.
+    Result PushWriteBuf(ThreadBuffer& buf) {
+        return hash_enabled ? PushWriteBuf<true>(buf) : PushWriteBuf<false>(buf);
+    }
+
+    // same as above, with the output ring picked at compile time.
+    // data that was already written before resuming is dropped.
+    template<bool Hash>
+    Result PushWriteBuf(ThreadBuffer& buf) {
+        const auto offset = push_offset;
+        push_offset += buf.size();
+
+        if (push_offset <= resume_offset) {
+            buf.buf.Release();
+            buf.start = 0;
+            R_SUCCEED();
+        } else if (offset < resume_offset) {
+            buf.start += resume_offset - offset;
+        }
+
+        const auto pushed = Hash ? hash_buffers.Push(buf) : write_buffers.Push(buf);
+        buf.start = 0;
+        if (!pushed) {
+            return GetResults();
+        }
+        R_SUCCEED();
+    }
+
+    // accounts for output that was skipped rather than pushed, only valid before the resume offset.
+    void SkipOutput(u64 size) {
+        push_offset += size;
+    }
+
+    // closes the ring the decompress thread outputs to.
+    void CloseDecompressOutput() {
+        if (hash_enabled) {
+            hash_buffers.Close();
+        } else {
+            write_buffers.Close();
+        }
+    }
+
+    // these need to be created
+    UEvent m_uevent_done{};
+    UEvent m_uevent_progres{};
+
+    // read / write depth is set by the tuner.
+    SpscRing<ThreadBuffer, tuner::MAX_DEPTH> read_buffers{};
+    SpscRing<ThreadBuffer, 2> hash_buffers{};
+    SpscRing<ThreadBuffer, tuner::MAX_DEPTH> write_buffers{};
+
+    ncz::BlockHeader ncz_block_header{};
+    std::vector<ncz::Section> ncz_sections{};
+    std::vector<ncz::BlockInfo> ncz_blocks{};
+
+    // zstd context of the worker running the decompress stage.
+    ZSTD_DCtx* dctx{};
+
+    // output below this offset was written by a previous install and is dropped.
+    s64 resume_offset{};
+    // first ncz block that needs decompressing when resuming.
+    u64 resume_block{};
+    // nca offset of the next byte output by the decompress thread.
+    s64 push_offset{};
+    // only set if resume_installs is enabled.
+    bool journal_enabled{};
+
+    Sha256Context sha256{};
+    // set if the hash thread is running, only used if verifying the nca hash.
+    const bool hash_enabled;
+
+    // size of each source read and placeholder write, set by the tuner.
+    std::atomic<u64> read_buffer_size{};
+
+    // these are shared between threads
+    std::atomic<s64> read_offset{};
+    std::atomic<s64> decompress_offset{};
+    std::atomic<s64> write_offset{};
+    std::atomic<s64> write_size{};
+    // bytes memcpy'd by the pipeline, excluding the source read itself.
+    std::atomic<u64> copied_size{};
+
+    std::atomic<Result> read_result{};
+    std::atomic<Result> decompress_result{};
+    std::atomic<Result> hash_result{};
+    std::atomic<Result> write_result{};
+
+    std::atomic_bool read_running{true};
+    std::atomic_bool decompress_running{true};
+    std::atomic_bool hash_running;
+    std::atomic_bool write_running{true};
+};
+
+} // namespace sphaira::yati
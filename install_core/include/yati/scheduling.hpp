@@ -0,0 +1,67 @@
+/*
+* Notes:
+* - describes which cores / priority each part of the install runs on.
+* - pipeline stages run as tasks on the thread pool, the worker running a
+*   task is moved to the task's placement before running it.
+* - haze (mtp) runs its usb threads on core 2, which is why some presets
+*   keep off it.
+*/
+
+#pragma once
+
+#include "defines.hpp"
+#include <switch.h>
+
+namespace sphaira::yati {
+
+// cores that the application is allowed to run on.
+constexpr u32 APPLICATION_CORE_MASK = 0b111;
+
+struct Placement {
+    // cores the thread may run on, the lowest core is preferred.
+    // 0 leaves the thread on the core it was created on.
+    u32 core_mask{};
+    s32 priority{PRIO_PREEMPTIVE};
+
+    auto operator==(const Placement&) const -> bool = default;
+};
+
+struct SchedulingPolicy {
+    Placement read{};
+    Placement decompress{};
+    Placement hash{};
+    Placement write{};
+    // ncz block decompress / crypt jobs.
+    Placement ncz_worker{};
+    // thread that drives the whole install, such as the mtp install thread.
+    Placement install{};
+};
+
+enum SchedulingPreset : u8 {
+    // stages run on whichever worker picks them up, workers are spread over every core.
+    SchedulingPreset_Spread,
+    // read on core 1, decompress on core 2 and hash / write on core 0, the default.
+    SchedulingPreset_Pinned,
+    // io on core 0 and decompress / hash on core 1, keeps core 2 free for usb.
+    SchedulingPreset_TwoCore,
+    // everything on core 0.
+    SchedulingPreset_SingleCore,
+};
+
+// every preset, in the order they are benchmarked.
+constexpr SchedulingPreset SCHEDULING_PRESETS[]{
+    SchedulingPreset_Spread,
+    SchedulingPreset_Pinned,
+    SchedulingPreset_TwoCore,
+    SchedulingPreset_SingleCore,
+};
+
+auto GetSchedulingPolicy(SchedulingPreset preset) -> SchedulingPolicy;
+auto GetSchedulingPresetName(SchedulingPreset preset) -> const char*;
+
+// core to create a thread on, -2 (process default) if the placement has no mask.
+auto GetPreferredCore(const Placement& placement) -> int;
+// moves the thread to the placement, use CUR_THREAD_HANDLE for the calling thread.
+Result ApplyPlacement(Handle thread, const Placement& placement);
+
+} // namespace sphaira::yati
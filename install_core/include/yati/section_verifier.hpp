@@ -0,0 +1,81 @@
+/*
+* Notes:
+* - verifies the hash tree of every nca section whilst the nca is being
+*   installed, HierarchicalSha256 for pfs0 and HierarchicalIntegrity (ivfc) for romfs.
+* - data is fed in order as it is written to the placeholder (encrypted),
+*   any range that is part of a hash tree is decrypted into a small tile and hashed,
+*   so nothing has to be read back from the placeholder.
+* - every hash level is kept in memory as it holds the expected hashes of the
+*   level below it, the data level itself is never kept.
+* - sections that can't be verified like this (patch / sparse / compressed
+*   sections and skip layer hash crypto) are skipped.
+*/
+
+#pragma once
+
+#include "yati/nx/nca.hpp"
+#include "yati/nx/keys.hpp"
+#include <switch.h>
+#include <vector>
+
+namespace sphaira::yati {
+
+struct SectionVerifier {
+    // sections whose hash levels are bigger than this are skipped.
+    static constexpr u64 MAX_HASH_LEVELS_SIZE = 1024 * 1024 * 16;
+    // size of the tile that is decrypted and hashed at a time.
+    static constexpr u64 TILE_SIZE = 1024 * 16;
+
+    // header is the decrypted, unmodified nca header.
+    // key is the aes-ctr key of the nca body, either key area 2 or the title key.
+    Result Setup(const nca::Header& header, const keys::KeyEntry& key);
+
+    // hashes size bytes of the nca at offset, data must be fed in order.
+    Result Update(const u8* data, u64 size, s64 offset);
+
+    // checks that every level of every section has been hashed.
+    Result Finish();
+
+    auto GetSectionCount() const -> u32 {
+        return m_sections.size();
+    }
+
+private:
+    struct Level {
+        // nca offset / size of the level.
+        s64 offset{};
+        s64 size{};
+        u64 block_size{};
+        // ivfc zero pads the last block, sha256 hashes it as is.
+        bool pad{};
+        // hash levels are kept as they hold the hashes of the next level.
+        bool keep{};
+
+        std::vector<u8> data{};
+        Sha256Context block_ctx{};
+        u64 block_index{};
+        u64 block_filled{};
+        // bytes of the level hashed so far.
+        s64 done{};
+    };
+
+    struct Section {
+        u32 index{};
+        bool encrypted{};
+        u8 counter[0x10]{};
+        // hashes of the first level.
+        std::vector<u8> master_hash{};
+        std::vector<Level> levels{};
+    };
+
+    Result AddSection(const nca::Header& header, u32 index);
+    Result Feed(Section& section, u32 level_index, const u8* data, u64 size);
+    Result FinishBlock(Section& section, u32 level_index);
+
+private:
+    keys::KeyEntry m_key{};
+    std::vector<Section> m_sections{};
+    std::vector<u8> m_tile{};
+};
+
+} // namespace sphaira::yati
@@ -1,5 +1,6 @@
 #pragma once
 
+#include "yati/buffer_pool.hpp"
 #include <vector>
 #include <switch.h>
 
@@ -14,6 +15,31 @@ struct Base {
         return false;
     }
 
+    // how far back from the furthest offset read so far a read may start.
+    // unlimited for random access sources, 0 for streams without a rewind window.
+    virtual auto GetRewindWindow() const -> s64 {
+        return IsStream() ? 0 : INT64_MAX;
+    }
+
+    // true if a read may start past the end of the last one without the data
+    // in between being transferred, false if it has to be read in order.
+    virtual bool CanSkipForward() const {
+        return !IsStream();
+    }
+
+    // keeps the last size bytes of a stream so that short backward seeks work.
+    // does nothing for random access sources.
+    virtual Result SetRewindWindow(s64 size) {
+        return 0;
+    }
+
+    // hands over a pooled buffer holding up to size bytes at off, rather than copying into one.
+    // out is left empty if the source can't do so, in which case Read() should be used.
+    virtual Result ReadBuffer(PooledBuffer& out, s64 off, s64 size) {
+        out.Release();
+        return 0;
+    }
+
     virtual void SignalCancel() {
 
     }
@@ -1,6 +1,7 @@
 #pragma once
 
 #include "base.hpp"
+#include <cstdio>
 #include <vector>
 #include <switch.h>
 
@@ -9,24 +10,72 @@ namespace sphaira::yati::source {
 // streams are for data that do not allow for random access,
 // such as FTP or MTP.
 struct Stream : Base {
-    virtual ~Stream() = default;
+    // windows bigger than this are kept in a file on the sd card rather than in memory.
+    static constexpr s64 MAX_MEMORY_WINDOW = 1024 * 1024 * 16;
+    // file used for windows bigger than the above.
+    static constexpr const char* WINDOW_SPILL_PATH = "/config/BBI/rewind.bin";
+
+    virtual ~Stream();
     virtual Result ReadChunk(void* buf, s64 size, u64* bytes_read) = 0;
 
+    // discards up to size bytes, used when seeking forwards.
+    // the default reads into a scratch buffer, implementations should
+    // override this if they can drop / seek past the data instead.
+    virtual Result SkipChunk(s64 size, u64* bytes_skipped);
+
+    // hands over a whole buffer of up to size bytes, leaving out empty if
+    // the next data isn't in a buffer of its own. the default never does.
+    virtual Result TakeChunk(PooledBuffer& out, s64 size);
+
     Result Read(void* buf, s64 off, s64 size, u64* bytes_read) override;
 
+    // data handed over is not kept in the rewind window.
+    Result ReadBuffer(PooledBuffer& out, s64 off, s64 size) override;
+
     bool IsStream() const override {
         return true;
     }
 
+    // forward reads go through SkipChunk().
+    bool CanSkipForward() const override {
+        return true;
+    }
+
+    auto GetRewindWindow() const -> s64 override {
+        return m_window_size;
+    }
+
+    // the window starts at the current offset, data already read can't be rewound to.
+    Result SetRewindWindow(s64 size) override;
+
     void Reset() {
         m_offset = 0;
+        m_window_start = 0;
     }
 
 protected:
     Result m_open_result{};
 
+private:
+    // reads / skips forward from the current offset, keeping a copy in the window.
+    Result ReadForward(u8* buf, s64 size, u64* bytes_read);
+    Result SkipForward(s64 size, u64* bytes_skipped);
+
+    // the window is a ring indexed by the stream offset, modulo the window size.
+    Result WindowWrite(s64 off, const u8* data, s64 size);
+    Result WindowRead(s64 off, u8* data, s64 size);
+    void WindowClose();
+
 private:
     s64 m_offset{};
+    // re-used by the default SkipChunk().
+    std::vector<u8> m_skip_buf{};
+
+    s64 m_window_size{};
+    // offset the window was enabled at, nothing before this is kept.
+    s64 m_window_start{};
+    std::vector<u8> m_window{};
+    std::FILE* m_window_file{};
 };
 
 } // namespace sphaira::yati::source
@@ -0,0 +1,133 @@
+/*
+* Notes:
+* - single-producer / single-consumer ring used to pass buffers between
+*   the install pipeline threads.
+* - the producer only ever writes the head and the consumer only ever writes
+*   the tail, so the handoff itself is lock-free.
+* - a thread only parks (via address arbitration) if the ring is full / empty.
+* - the depth can be changed at runtime, up to Size.
+*/
+
+#pragma once
+
+#include "defines.hpp"
+#include <switch.h>
+#include <algorithm>
+#include <atomic>
+#include <memory>
+
+namespace sphaira::yati {
+
+template<typename T, std::size_t Size>
+struct SpscRing {
+private:
+    static_assert((Size & (Size - 1)) == 0, "Must be power of 2!");
+
+    T buf[Size]{};
+    std::atomic<u32> head{};
+    std::atomic<u32> tail{};
+    std::atomic<u32> depth{Size};
+    std::atomic_bool closed{};
+
+    // ticks spent parked by each side, used to tune the depth.
+    std::atomic<u64> push_wait_ticks{};
+    std::atomic<u64> pop_wait_ticks{};
+
+    // bumped on every state change, the parked thread waits on this value.
+    std::atomic<s32> seq{};
+    std::atomic<u32> waiters{};
+
+    template<typename F>
+    void Park(std::atomic<u64>& wait_ticks, F&& should_wait) {
+        const auto start = armGetSystemTick();
+        ON_SCOPE_EXIT(wait_ticks += armGetSystemTick() - start);
+
+        waiters.fetch_add(1);
+        const auto value = seq.load();
+        if (should_wait() && !closed.load()) {
+            svcWaitForAddress(std::addressof(seq), ArbitrationType_WaitIfEqual, value, -1);
+        }
+        waiters.fetch_sub(1);
+    }
+
+    void Notify() {
+        seq.fetch_add(1);
+        if (waiters.load()) {
+            svcSignalToAddress(std::addressof(seq), SignalType_Signal, 0, -1);
+        }
+    }
+
+public:
+    unsigned capacity() const {
+        return depth.load();
+    }
+
+    // sets the max number of slots in use, clamped to [1, Size].
+    // if shrinking, the producer blocks until the ring has drained below the new depth.
+    void SetCapacity(unsigned count) {
+        depth = std::clamp<unsigned>(count, 1, Size);
+        Notify();
+    }
+
+    auto GetPushWaitTicks() const -> u64 {
+        return push_wait_ticks.load();
+    }
+
+    auto GetPopWaitTicks() const -> u64 {
+        return pop_wait_ticks.load();
+    }
+
+    unsigned size() const {
+        return head.load(std::memory_order_acquire) - tail.load(std::memory_order_acquire);
+    }
+
+    // moves in to the next free slot, blocks whilst the ring is full.
+    // returns false if the ring has been closed, in which case in is left untouched.
+    bool Push(T& in) {
+        const auto w_index = head.load(std::memory_order_relaxed);
+        const auto is_full = [&]{ return w_index - tail.load(std::memory_order_acquire) >= depth.load(); };
+
+        while (is_full()) {
+            if (closed.load()) {
+                return false;
+            }
+            Park(push_wait_ticks, is_full);
+        }
+
+        if (closed.load()) {
+            return false;
+        }
+
+        buf[w_index % Size] = std::move(in);
+        head.store(w_index + 1, std::memory_order_release);
+        Notify();
+        return true;
+    }
+
+    // moves the oldest slot out, blocks whilst the ring is empty.
+    // returns false once the ring is closed and fully drained.
+    bool Pop(T& out) {
+        const auto r_index = tail.load(std::memory_order_relaxed);
+        const auto is_empty = [&]{ return head.load(std::memory_order_acquire) == r_index; };
+
+        while (is_empty()) {
+            if (closed.load()) {
+                return false;
+            }
+            Park(pop_wait_ticks, is_empty);
+        }
+
+        out = std::move(buf[r_index % Size]);
+        tail.store(r_index + 1, std::memory_order_release);
+        Notify();
+        return true;
+    }
+
+    // wakes up both sides, no more data can be pushed after this.
+    void Close() {
+        closed = true;
+        Notify();
+    }
+};
+
+} // namespace sphaira::yati
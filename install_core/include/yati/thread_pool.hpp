@@ -0,0 +1,123 @@
+/*
+* Notes:
+* - long lived worker pool owned by the install session, so that threads
+*   are created once rather than for every nca.
+* - every worker has its own task deque, idle workers steal from the back
+*   of the other deques.
+* - every worker owns a zstd context which is re-used by the tasks it runs.
+* - a task may have a placement, the worker running it is moved to those
+*   cores / priority first, and moved back home for tasks without one.
+* - tasks may block (pipeline stages do), so the pool must be sized so that
+*   every blocking task can run at the same time, with workers to spare.
+*/
+
+#pragma once
+
+#include "yati/scheduling.hpp"
+#include <switch.h>
+#include <zstd.h>
+#include <atomic>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <vector>
+
+namespace sphaira::yati {
+
+struct ThreadPool {
+    // per worker state, passed to every task the worker runs.
+    struct Context {
+        u32 index{};
+        // reset before use, as the previous task may have left it mid frame.
+        ZSTD_DCtx* dctx{};
+    };
+
+    using Func = std::function<Result(Context&)>;
+
+    struct TaskState {
+        TaskState() {
+            ueventCreate(&done, false);
+        }
+
+        UEvent done{};
+        std::atomic<Result> rc{};
+    };
+
+    // completion handle of a submitted task.
+    struct Future {
+        Future() = default;
+        Future(std::shared_ptr<TaskState> state) : m_state{std::move(state)} {}
+
+        auto IsValid() const -> bool {
+            return m_state != nullptr;
+        }
+
+        // blocks until the task has finished, returns the result of the task.
+        Result Wait() {
+            waitSingle(waiterForUEvent(GetEvent()), UINT64_MAX);
+            return m_state->rc.load();
+        }
+
+        // signalled once the task has finished, can be used with waitMulti().
+        auto GetEvent() -> UEvent* {
+            return std::addressof(m_state->done);
+        }
+
+    private:
+        std::shared_ptr<TaskState> m_state{};
+    };
+
+    ThreadPool() = default;
+    ~ThreadPool();
+
+    ThreadPool(const ThreadPool&) = delete;
+    ThreadPool& operator=(const ThreadPool&) = delete;
+
+    Result Create(u32 count, u64 stack_size);
+
+    auto Submit(Func&& func, const Placement& placement = {}) -> Future;
+
+    auto GetWorkerCount() const -> u32 {
+        return m_workers.size();
+    }
+
+private:
+    struct Task {
+        Func func{};
+        std::shared_ptr<TaskState> state{};
+        Placement placement{};
+    };
+
+    struct Worker {
+        ThreadPool* pool{};
+        Thread thread{};
+        Context ctx{};
+        Mutex mutex{};
+        std::deque<Task> tasks{};
+        // placement the worker was created with.
+        Placement home{};
+        // placement the worker is currently running with.
+        Placement current{};
+        bool started{};
+    };
+
+    auto Pop(Worker& worker, Task& out) -> bool;
+    void Place(Worker& worker, const Placement& placement);
+    void Run(Worker& worker);
+    static void WorkerFunc(void* d);
+
+private:
+    std::vector<std::unique_ptr<Worker>> m_workers{};
+
+    // idle workers wait on this until a task is queued.
+    Mutex m_idle_mutex{};
+    CondVar m_idle_cond{};
+    u64 m_pending{};
+    bool m_quit{};
+
+    std::atomic<u32> m_next_worker{};
+    std::atomic<u64> m_completed{};
+    std::atomic<u64> m_stolen{};
+};
+
+} // namespace sphaira::yati
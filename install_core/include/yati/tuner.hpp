@@ -0,0 +1,100 @@
+/*
+* Notes:
+* - adjusts the install pipeline's ring depth and chunk size whilst an nca
+*   is being installed, based on how long the stages spend stalled.
+* - the best values differ a lot between sources (bursty mtp / usb vs file)
+*   and outputs (sd vs nand, ncz vs nca), so the learned values are kept
+*   per source type and used as the starting point of the next install.
+* - the tuner only decides, the caller owns the buffers / memory budget.
+* - file access only uses stdio, so it can be built / tested on the host.
+*/
+
+#pragma once
+
+#include <switch.h>
+
+namespace sphaira::yati::tuner {
+
+constexpr u32 MAGIC = 0x4E555442; // BTUN
+constexpr u32 VERSION = 1;
+
+// folder that learned profiles are stored in.
+constexpr const char* TUNING_PATH = "/config/BBI/tuning";
+
+// depth of the read and write rings.
+constexpr u32 MIN_DEPTH = 2;
+constexpr u32 MAX_DEPTH = 8;
+constexpr u32 DEFAULT_DEPTH = 4;
+
+// size of each source read / placeholder write.
+constexpr u64 MIN_CHUNK_SIZE = 1024 * 1024;
+constexpr u64 MAX_CHUNK_SIZE = 1024 * 1024 * 4;
+constexpr u64 CHUNK_STEP = 1024 * 512;
+
+// how often the stall times are sampled.
+constexpr s64 SAMPLE_PERIOD_NS = 2.5e+8; // 250ms
+// samples needed before a profile is worth saving.
+constexpr u32 MIN_SAMPLES_TO_SAVE = 4;
+
+// what a profile is learned for.
+struct Key {
+    // mtp / usb, data arrives in bursts and can't be re-read.
+    bool stream{};
+    // NcmStorageId being installed to.
+    u8 storage_id{};
+    // ncz, decompression sits between the read and write.
+    bool compressed{};
+};
+
+struct Profile {
+    u32 magic{MAGIC};
+    u32 version{VERSION};
+    u32 depth{DEFAULT_DEPTH};
+    u32 _0xC{};
+    u64 chunk_size{MAX_CHUNK_SIZE};
+};
+
+// time the stages spent stalled during one sample period.
+struct Sample {
+    s64 period_ns{};
+    // read stage blocked on a full read ring, everything after it is slower.
+    s64 read_full_ns{};
+    // write stage blocked on an empty write ring, everything before it is slower.
+    s64 write_empty_ns{};
+};
+
+struct Tuner {
+    explicit Tuner(const Profile& profile);
+
+    // updates the wanted profile from the last sample period.
+    void Update(const Sample& sample);
+
+    // the depth the caller was able to apply, may be less than wanted.
+    void SetDepth(u32 depth) {
+        m_profile.depth = depth;
+    }
+
+    auto GetWanted() const -> const Profile& {
+        return m_wanted;
+    }
+
+    auto GetProfile() const -> const Profile& {
+        return m_profile;
+    }
+
+    auto GetSampleCount() const -> u32 {
+        return m_samples;
+    }
+
+private:
+    Profile m_profile{};
+    Profile m_wanted{};
+    u32 m_samples{};
+};
+
+// loads the profile for the key, fails if not found or invalid.
+Result Load(const Key& key, Profile& out);
+// writes (or replaces) the profile for the key.
+Result Save(const Key& key, const Profile& profile);
+
+} // namespace sphaira::yati::tuner
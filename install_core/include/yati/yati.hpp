@@ -11,11 +11,23 @@
 #include "source/base.hpp"
 #include "container/base.hpp"
 #include "ui/progress_box.hpp"
+#include "yati/scheduling.hpp"
 #include <memory>
 #include <optional>
+#include <vector>
 
 namespace sphaira::yati {
 
+// how much the write thread backs off between placeholder writes.
+enum WritePacing : u8 {
+    // never sleeps, only yields the core between writes.
+    WritePacing_MaxThroughput,
+    // sleeps for a small fraction of the time spent writing.
+    WritePacing_Balanced,
+    // sleeps for a large fraction of the time spent writing, keeps the system responsive.
+    WritePacing_Background,
+};
+
 struct Config {
     bool sd_card_install{};
 
@@ -63,11 +75,59 @@ struct Config {
     // if mkey is higher than fw version, the game still won't launch
     // as the fw won't have the key to decrypt keak.
     bool lower_system_version{};
+
+    // max memory the shared buffer pool can allocate for the install pipeline.
+    // defaults to a pipeline per nca_install_threads plus source_buffer_count,
+    // limited to the free heap.
+    u64 buffer_pool_memory_cap{};
+
+    // buffers the source itself reserves from the pool, such as mtp streams.
+    u32 source_buffer_count{};
+
+    // pacing policy of the write thread.
+    WritePacing write_pacing{};
+
+    // number of threads used to decompress block ncz, 1 decompresses serially.
+    u32 ncz_decompress_threads{};
+
+    // number of nca's installed at once, only used for non-stream sources.
+    // limited by the buffer pool memory cap.
+    u32 nca_install_threads{};
+
+    // nca's up to this size are installed on the calling thread, without the pipeline.
+    // 0 disables.
+    u64 small_nca_threshold{};
+
+    // keeps a journal of each nca's progress, so that a failed install
+    // can continue from where it stopped when the same file is sent again.
+    bool resume_installs{};
+
+    // adjusts the ring depth and chunk size of each nca install from how long
+    // the stages spend stalled, within the buffer pool memory cap.
+    bool auto_tune{};
+
+    // saves the tuned values per source type to the sd card, so the next
+    // install starts from them.
+    bool persist_tuning{};
+
+    // cores / priority of every pipeline stage.
+    SchedulingPolicy scheduling{};
+
+    // verifies the hash tree of every nca section as it's installed, which
+    // also catches corrupt modified / converted nca's, whose content id
+    // no longer matches their sha256.
+    bool verify_section_hashes{};
+
+    // bytes kept of a stream install so that short backward seeks work,
+    // such as reading tickets stored after the nca's. 0 disables.
+    // windows over 16MiB are kept in a file on the sd card.
+    s64 stream_rewind_window{};
 };
 
 // overridable options, set to avoid
 struct ConfigOverride {
     std::optional<bool> sd_card_install{};
+    std::optional<bool> skip_if_already_installed{};
     std::optional<bool> skip_nca_hash_verify{};
     std::optional<bool> skip_rsa_header_fixed_key_verify{};
     std::optional<bool> skip_rsa_npdm_fixed_key_verify{};
@@ -76,6 +136,18 @@ struct ConfigOverride {
     std::optional<bool> convert_to_standard_crypto{};
     std::optional<bool> lower_master_key{};
     std::optional<bool> lower_system_version{};
+    std::optional<u64> buffer_pool_memory_cap{};
+    std::optional<u32> source_buffer_count{};
+    std::optional<WritePacing> write_pacing{};
+    std::optional<u32> ncz_decompress_threads{};
+    std::optional<u32> nca_install_threads{};
+    std::optional<u64> small_nca_threshold{};
+    std::optional<bool> resume_installs{};
+    std::optional<bool> auto_tune{};
+    std::optional<bool> persist_tuning{};
+    std::optional<SchedulingPolicy> scheduling{};
+    std::optional<bool> verify_section_hashes{};
+    std::optional<s64> stream_rewind_window{};
 };
 
 Result InstallFromFile(ui::ProgressBox* pbox, fs::Fs* fs, const fs::FsPath& path, const ConfigOverride& override = {});
@@ -83,4 +155,20 @@ Result InstallFromSource(ui::ProgressBox* pbox, source::Base* source, const fs::
 Result InstallFromContainer(ui::ProgressBox* pbox, container::Base* container, const ConfigOverride& override = {});
 Result InstallFromCollections(ui::ProgressBox* pbox, source::Base* source, const container::Collections& collections, const ConfigOverride& override = {});
 
+#ifdef BBI_DEBUG
+struct SchedulingBenchmark {
+    SchedulingPreset preset{};
+    Result rc{};
+    // time taken to install the file.
+    u64 ms{};
+    // size of the file.
+    s64 size{};
+};
+
+// installs the file once with every scheduling preset, timing each install.
+// the file is re-installed every time, so it can't be a stream.
+// only built for debug builds (DEBUG=1).
+Result BenchmarkScheduling(ui::ProgressBox* pbox, fs::Fs* fs, const fs::FsPath& path, std::vector<SchedulingBenchmark>& out, const ConfigOverride& override = {});
+#endif // BBI_DEBUG
+
 } // namespace sphaira::yati
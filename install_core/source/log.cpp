@@ -2,37 +2,319 @@
 #include "fs.hpp"
 #include <cstdio>
 #include <cstdarg>
+#include <algorithm>
+#include <ctime>
+#include <atomic>
 #include <unistd.h>
 #include <mutex>
 #include <switch.h>
 
+/*
+* Notes:
+* - lines are formatted on the calling thread into a slot of a fixed size
+*   multi-producer / single-consumer ring, the slot is claimed with a single cas.
+* - a background thread drains the ring and writes whole batches to the
+*   log file, which is kept open, rather than an fopen / fclose per line.
+* - the drain thread is only woken if it is asleep, so a line costs a
+*   vsnprintf and a couple of atomics on the hot path.
+* - a producer facing a full ring sleeps on a condvar until the drain thread
+*   frees a slot, if that takes too long the line is dropped and counted,
+*   logging must never stall an install.
+* - if the drain thread could not be started, lines are written synchronously
+*   on the calling thread instead of being lost.
+*/
+
 #if sphaira_USE_LOG
 namespace {
 
 constexpr const char* logpath = "/config/BBI/log.txt";
 
+// max length of a single line, longer lines are truncated.
+constexpr u32 LINE_SIZE = 512;
+// number of lines that can be queued, must be a power of 2.
+constexpr u32 RING_SIZE = 256;
+static_assert((RING_SIZE & (RING_SIZE - 1)) == 0, "Must be power of 2!");
+// size of the buffer lines are batched into before being written.
+constexpr u32 BATCH_SIZE = 1024 * 32;
+// how long a line waits for a free slot before being dropped.
+constexpr u64 FULL_TIMEOUT_NS = 1000000ULL * 100ULL;
+
+struct Slot {
+    // RING_SIZE * lap + index when free, one more than that once published.
+    std::atomic<u32> seq{};
+    s32 level{};
+    std::time_t time{};
+    char text[LINE_SIZE]{};
+};
+
+Slot g_ring[RING_SIZE]{};
+std::atomic<u32> g_enqueue_pos{};
+// only touched by the drain thread.
+u32 g_dequeue_pos{};
+// everything below this has been written.
+std::atomic<u32> g_drained_pos{};
+std::atomic<u32> g_dropped{};
+
+Thread g_thread{};
+UEvent g_wake{};
+std::atomic_bool g_running{};
+std::atomic_bool g_drain_waiting{};
+char g_batch[BATCH_SIZE]{};
+
+// producers waiting for a free slot and log_flush() callers waiting on the drain thread.
+Mutex g_drained_mutex{};
+CondVar g_drained_cond{};
+std::atomic<u32> g_drained_waiters{};
+
 int nxlink_socket{};
-bool g_file_open{};
+std::FILE* g_file{};
 std::mutex mutex{};
+std::atomic_bool g_init{};
 
-void log_write_arg_internal(const char* s, std::va_list* v) {
-    const auto t = std::time(nullptr);
-    const auto tm = std::localtime(&t);
+void UpdateInit() {
+    g_init = g_file || nxlink_socket;
+}
 
-    static char buf[512];
-    const auto len = std::snprintf(buf, sizeof(buf), "[%02u:%02u:%02u] -> ", tm->tm_hour, tm->tm_min, tm->tm_sec);
-    std::vsnprintf(buf + len, sizeof(buf) - len, s, *v);
+void WriteBatch(const char* data, size_t size) {
+    if (!size) {
+        return;
+    }
 
-    if (g_file_open) {
-        auto file = std::fopen(logpath, "a");
-        if (file) {
-            std::fprintf(file, "%s", buf);
-            std::fclose(file);
-        }
+    if (g_file) {
+        std::fwrite(data, 1, size, g_file);
     }
     if (nxlink_socket) {
-        std::printf("%s", buf);
+        std::fwrite(data, 1, size, stdout);
+    }
+}
+
+auto LevelTag(s32 level) -> const char* {
+    switch (level) {
+        case LOG_LEVEL_DEBUG: return "[D] ";
+        case LOG_LEVEL_WARN: return "[W] ";
+        case LOG_LEVEL_ERROR: return "[E] ";
+        default: return "";
+    }
+}
+
+auto FormatLine(char* out, size_t size, s32 level, std::time_t time, const char* text) -> size_t {
+    std::tm tm{};
+    localtime_r(&time, &tm);
+    return std::snprintf(out, size, "[%02u:%02u:%02u] -> %s%s", tm.tm_hour, tm.tm_min, tm.tm_sec, LevelTag(level), text);
+}
+
+// wakes everyone waiting for the drain thread to make progress.
+void WakeDrainedWaiters() {
+    // pairs with the increment in WaitDrained(), either the waiter sees the
+    // new position or we see the waiter.
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    if (g_drained_waiters.load()) {
+        mutexLock(&g_drained_mutex);
+        condvarWakeAll(&g_drained_cond);
+        mutexUnlock(&g_drained_mutex);
+    }
+}
+
+// blocks until done() returns true, the drain thread stops or timeout_ns has passed.
+auto WaitDrained(auto done, u64 timeout_ns) -> bool {
+    const auto start = armGetSystemTick();
+
+    g_drained_waiters++;
+    mutexLock(&g_drained_mutex);
+    while (!done() && g_running) {
+        const auto elapsed = armTicksToNs(armGetSystemTick() - start);
+        if (elapsed >= timeout_ns) {
+            break;
+        }
+        condvarWaitTimeout(&g_drained_cond, &g_drained_mutex, timeout_ns - elapsed);
+    }
+    const auto result = done();
+    mutexUnlock(&g_drained_mutex);
+    g_drained_waiters--;
+
+    return result;
+}
+
+auto IsPublished(u32 pos) -> bool {
+    return g_ring[pos & (RING_SIZE - 1)].seq.load(std::memory_order_acquire) == pos + 1;
+}
+
+// writes every published line, returns the number of lines written.
+auto Drain() -> u32 {
+    std::scoped_lock lock{mutex};
+
+    u32 count{};
+    size_t batch_size{};
+
+    if (const auto dropped = g_dropped.exchange(0)) {
+        batch_size += std::snprintf(g_batch, sizeof(g_batch), "[log] dropped %u lines\n", dropped);
+    }
+
+    while (IsPublished(g_dequeue_pos)) {
+        auto& slot = g_ring[g_dequeue_pos & (RING_SIZE - 1)];
+
+        if (batch_size + LINE_SIZE + 64 > sizeof(g_batch)) {
+            WriteBatch(g_batch, batch_size);
+            batch_size = 0;
+        }
+
+        batch_size += FormatLine(g_batch + batch_size, sizeof(g_batch) - batch_size, slot.level, slot.time, slot.text);
+
+        // hand the slot back to the producers for the next lap.
+        slot.seq.store(g_dequeue_pos + RING_SIZE, std::memory_order_release);
+        g_dequeue_pos++;
+        count++;
+    }
+
+    WriteBatch(g_batch, batch_size);
+    if (count && g_file) {
+        std::fflush(g_file);
+    }
+
+    g_drained_pos = g_dequeue_pos;
+    if (count) {
+        WakeDrainedWaiters();
     }
+    return count;
+}
+
+void DrainThreadFunc(void*) {
+    while (true) {
+        if (Drain()) {
+            continue;
+        }
+
+        if (!g_running) {
+            break;
+        }
+
+        // check again after saying we are asleep, so that a line published
+        // in between either is seen here or wakes us.
+        g_drain_waiting = true;
+        if (IsPublished(g_dequeue_pos) || !g_running) {
+            g_drain_waiting = false;
+            continue;
+        }
+
+        waitSingle(waiterForUEvent(&g_wake), UINT64_MAX);
+    }
+}
+
+void WakeDrainThread() {
+    if (g_drain_waiting.exchange(false)) {
+        ueventSignal(&g_wake);
+    }
+}
+
+// called with the mutex held.
+void StartDrainThread() {
+    if (g_running) {
+        return;
+    }
+
+    for (u32 i = 0; i < RING_SIZE; i++) {
+        g_ring[i].seq = i;
+    }
+    g_enqueue_pos = 0;
+    g_dequeue_pos = 0;
+    g_drained_pos = 0;
+
+    ueventCreate(&g_wake, true);
+    mutexInit(&g_drained_mutex);
+    condvarInit(&g_drained_cond);
+    if (R_FAILED(threadCreate(&g_thread, DrainThreadFunc, nullptr, nullptr, 1024 * 16, 0x3B, -2))) {
+        return;
+    }
+
+    g_running = true;
+    if (R_FAILED(threadStart(&g_thread))) {
+        g_running = false;
+        threadClose(&g_thread);
+    }
+}
+
+// called without the mutex held, as the drain thread takes it.
+void StopDrainThread() {
+    if (!g_running.exchange(false)) {
+        return;
+    }
+
+    g_drain_waiting = false;
+    ueventSignal(&g_wake);
+    threadWaitForExit(&g_thread);
+    threadClose(&g_thread);
+
+    // anyone still waiting sees that the thread is gone.
+    mutexLock(&g_drained_mutex);
+    condvarWakeAll(&g_drained_cond);
+    mutexUnlock(&g_drained_mutex);
+}
+
+// used when the drain thread is not running, so that lines are not lost.
+void WriteSync(s32 level, const char* s, std::va_list* v) {
+    std::scoped_lock lock{mutex};
+    if (!g_file && !nxlink_socket) {
+        return;
+    }
+
+    char text[LINE_SIZE];
+    std::vsnprintf(text, sizeof(text), s, *v);
+
+    char line[LINE_SIZE + 64];
+    const auto size = std::min<size_t>(FormatLine(line, sizeof(line), level, std::time(nullptr), text), sizeof(line) - 1);
+    WriteBatch(line, size);
+    if (g_file) {
+        std::fflush(g_file);
+    }
+}
+
+void log_write_arg_internal(s32 level, const char* s, std::va_list* v) {
+    if (!g_running) {
+        WriteSync(level, s, v);
+        return;
+    }
+
+    // claim a slot, waiting a little for one to free up if the ring is full.
+    Slot* slot{};
+    auto pos = g_enqueue_pos.load(std::memory_order_relaxed);
+    u64 full_start{};
+    while (true) {
+        slot = &g_ring[pos & (RING_SIZE - 1)];
+        const auto seq = slot->seq.load(std::memory_order_acquire);
+        const auto diff = static_cast<s32>(seq - pos);
+
+        if (!diff) {
+            if (g_enqueue_pos.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+                break;
+            }
+        } else if (diff < 0) {
+            if (!full_start) {
+                full_start = armGetSystemTick();
+            }
+
+            const auto elapsed = armTicksToNs(armGetSystemTick() - full_start);
+            if (elapsed >= FULL_TIMEOUT_NS) {
+                g_dropped++;
+                return;
+            }
+
+            // sleep until the drain thread hands the slot back.
+            WakeDrainThread();
+            WaitDrained([slot, pos] {
+                return static_cast<s32>(slot->seq.load() - pos) >= 0;
+            }, FULL_TIMEOUT_NS - elapsed);
+            pos = g_enqueue_pos.load(std::memory_order_relaxed);
+        } else {
+            pos = g_enqueue_pos.load(std::memory_order_relaxed);
+        }
+    }
+
+    slot->level = level;
+    slot->time = std::time(nullptr);
+    std::vsnprintf(slot->text, sizeof(slot->text), s, *v);
+    slot->seq.store(pos + 1, std::memory_order_release);
+
+    WakeDrainThread();
 }
 
 } // namespace
@@ -41,17 +323,17 @@ extern "C" {
 
 auto log_file_init() -> bool {
     std::scoped_lock lock{mutex};
-    if (g_file_open) {
+    if (g_file) {
         return false;
     }
 
     // Ensure log directory exists.
     fs::CreateDirectoryRecursively("/config/BBI");
 
-    auto file = std::fopen(logpath, "w");
-    if (file) {
-        g_file_open = true;
-        std::fclose(file);
+    g_file = std::fopen(logpath, "w");
+    if (g_file) {
+        UpdateInit();
+        StartDrainThread();
         return true;
     }
 
@@ -65,27 +347,83 @@ auto log_nxlink_init() -> bool {
     }
 
     nxlink_socket = nxlinkConnectToHost(true, false);
+    UpdateInit();
+    if (nxlink_socket) {
+        StartDrainThread();
+    }
     return nxlink_socket != 0;
 }
 
 void log_file_exit() {
-    std::scoped_lock lock{mutex};
-    if (g_file_open) {
-        g_file_open = false;
+    bool last;
+    {
+        std::scoped_lock lock{mutex};
+        if (!g_file) {
+            return;
+        }
+        last = !nxlink_socket;
+    }
+
+    // write out anything still queued before closing.
+    if (last) {
+        StopDrainThread();
+    } else {
+        log_flush();
     }
+
+    std::scoped_lock lock{mutex};
+    std::fclose(g_file);
+    g_file = nullptr;
+    UpdateInit();
 }
 
 void log_nxlink_exit() {
-    std::scoped_lock lock{mutex};
-    if (nxlink_socket) {
-        close(nxlink_socket);
-        nxlink_socket = 0;
+    bool last;
+    {
+        std::scoped_lock lock{mutex};
+        if (!nxlink_socket) {
+            return;
+        }
+        last = !g_file;
+    }
+
+    if (last) {
+        StopDrainThread();
+    } else {
+        log_flush();
     }
+
+    std::scoped_lock lock{mutex};
+    close(nxlink_socket);
+    nxlink_socket = 0;
+    UpdateInit();
 }
 
 bool log_is_init() {
-    std::scoped_lock lock{mutex};
-    return g_file_open || nxlink_socket;
+    return g_init;
+}
+
+void log_flush() {
+    if (!g_running) {
+        return;
+    }
+
+    const auto target = g_enqueue_pos.load();
+    WakeDrainThread();
+    WaitDrained([target] {
+        return static_cast<s32>(g_drained_pos.load() - target) >= 0;
+    }, UINT64_MAX);
+}
+
+void log_write_level(int level, const char* s, ...) {
+    if (!log_is_init()) {
+        return;
+    }
+
+    std::va_list v{};
+    va_start(v, s);
+    log_write_arg_internal(level, s, &v);
+    va_end(v);
 }
 
 void log_write(const char* s, ...) {
@@ -93,10 +431,9 @@ void log_write(const char* s, ...) {
         return;
     }
 
-    std::scoped_lock lock{mutex};
     std::va_list v{};
     va_start(v, s);
-    log_write_arg_internal(s, &v);
+    log_write_arg_internal(LOG_LEVEL_INFO, s, &v);
     va_end(v);
 }
 
@@ -105,8 +442,7 @@ void log_write_arg(const char* s, va_list* v) {
         return;
     }
 
-    std::scoped_lock lock{mutex};
-    log_write_arg_internal(s, v);
+    log_write_arg_internal(LOG_LEVEL_INFO, s, v);
 }
 
 } // extern "C"
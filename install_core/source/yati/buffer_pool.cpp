@@ -0,0 +1,161 @@
+#include "yati/buffer_pool.hpp"
+#include "defines.hpp"
+#include "log.hpp"
+
+#include <cstdlib>
+#include <vector>
+
+namespace sphaira::yati {
+namespace pool {
+namespace {
+
+Mutex g_mutex{};
+CondVar g_can_acquire{};
+CondVar g_can_reserve{};
+// buffers that have been returned and can be handed out again.
+std::vector<u8*> g_free{};
+Stats g_stats{BUFFER_SIZE, DEFAULT_MEMORY_CAP};
+
+void ReleaseInternal(u8* data) {
+    SCOPED_MUTEX(&g_mutex);
+    g_free.emplace_back(data);
+    g_stats.in_use -= BUFFER_SIZE;
+    condvarWakeOne(&g_can_acquire);
+}
+
+} // namespace
+
+void SetMemoryCap(u64 size) {
+    SCOPED_MUTEX(&g_mutex);
+    g_stats.memory_cap = std::max<u64>(size / BUFFER_SIZE, 1) * BUFFER_SIZE;
+    log_write("[POOL] memory cap: %zu MiB\n", g_stats.memory_cap / 1024 / 1024);
+    condvarWakeAll(&g_can_acquire);
+    condvarWakeAll(&g_can_reserve);
+}
+
+auto GetMemoryCapFor(u64 count) -> u64 {
+    const auto wanted = count * BUFFER_SIZE;
+
+    u64 total{}, used{};
+    if (R_FAILED(svcGetInfo(&total, InfoType_TotalMemorySize, CUR_PROCESS_HANDLE, 0)) ||
+        R_FAILED(svcGetInfo(&used, InfoType_UsedMemorySize, CUR_PROCESS_HANDLE, 0))) {
+        return wanted;
+    }
+
+    u64 allocated{};
+    {
+        SCOPED_MUTEX(&g_mutex);
+        allocated = g_stats.allocated;
+    }
+
+    const auto available = total - std::min(total, used) + allocated;
+    if (available <= HEAP_HEADROOM) {
+        return 0;
+    }
+
+    return std::min(wanted, available - HEAP_HEADROOM);
+}
+
+Result Acquire(PooledBuffer& out, u64 timeout) {
+    out.Release();
+
+    SCOPED_MUTEX(&g_mutex);
+    g_stats.acquire_count++;
+
+    const auto start = armGetSystemTick();
+    while (g_free.empty() && g_stats.allocated + BUFFER_SIZE > g_stats.memory_cap) {
+        g_stats.wait_count++;
+
+        u64 remaining = UINT64_MAX;
+        if (timeout != UINT64_MAX) {
+            const auto elapsed = armTicksToNs(armGetSystemTick() - start);
+            R_UNLESS(elapsed < timeout, Result_YatiBufferPoolTimeout);
+            remaining = timeout - elapsed;
+        }
+
+        condvarWaitTimeout(&g_can_acquire, &g_mutex, remaining);
+    }
+
+    u8* data{};
+    if (!g_free.empty()) {
+        data = g_free.back();
+        g_free.pop_back();
+    } else {
+        data = static_cast<u8*>(std::aligned_alloc(BUFFER_ALIGN, BUFFER_SIZE));
+        R_UNLESS(data, Result_YatiBufferPoolOutOfMemory);
+        g_stats.allocated += BUFFER_SIZE;
+        g_stats.alloc_count++;
+    }
+
+    g_stats.in_use += BUFFER_SIZE;
+    g_stats.high_water = std::max(g_stats.high_water, g_stats.in_use);
+
+    out.m_data = data;
+    out.m_size = 0;
+    R_SUCCEED();
+}
+
+void Reserve(u64 count) {
+    SCOPED_MUTEX(&g_mutex);
+    while (g_stats.reserved + count * BUFFER_SIZE > g_stats.memory_cap) {
+        condvarWait(&g_can_reserve, &g_mutex);
+    }
+    g_stats.reserved += count * BUFFER_SIZE;
+}
+
+bool TryReserve(u64 count) {
+    SCOPED_MUTEX(&g_mutex);
+    if (g_stats.reserved + count * BUFFER_SIZE > g_stats.memory_cap) {
+        return false;
+    }
+    g_stats.reserved += count * BUFFER_SIZE;
+    return true;
+}
+
+void Unreserve(u64 count) {
+    SCOPED_MUTEX(&g_mutex);
+    g_stats.reserved -= std::min(g_stats.reserved, count * BUFFER_SIZE);
+    condvarWakeAll(&g_can_reserve);
+}
+
+void Trim() {
+    SCOPED_MUTEX(&g_mutex);
+    for (auto data : g_free) {
+        std::free(data);
+        g_stats.allocated -= BUFFER_SIZE;
+    }
+    g_free.clear();
+    g_free.shrink_to_fit();
+}
+
+auto GetStats() -> Stats {
+    SCOPED_MUTEX(&g_mutex);
+    return g_stats;
+}
+
+void ResetStats() {
+    SCOPED_MUTEX(&g_mutex);
+    g_stats.high_water = g_stats.in_use;
+    g_stats.acquire_count = 0;
+    g_stats.alloc_count = 0;
+    g_stats.wait_count = 0;
+}
+
+void LogStats() {
+    const auto stats = GetStats();
+    log_write("[POOL] cap: %zu KiB allocated: %zu KiB in use: %zu KiB high water: %zu KiB acquires: %zu allocs: %zu waits: %zu\n",
+        stats.memory_cap / 1024, stats.allocated / 1024, stats.in_use / 1024, stats.high_water / 1024,
+        stats.acquire_count, stats.alloc_count, stats.wait_count);
+}
+
+} // namespace pool
+
+void PooledBuffer::Release() {
+    if (m_data) {
+        pool::ReleaseInternal(m_data);
+        m_data = nullptr;
+        m_size = 0;
+    }
+}
+
+} // namespace sphaira::yati
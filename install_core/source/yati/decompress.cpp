@@ -0,0 +1,235 @@
+#include "yati/decompress.hpp"
+#include "log.hpp"
+
+#include <algorithm>
+#include <cstring>
+
+namespace sphaira::yati {
+namespace {
+
+// policy the decompress loop is instantiated over, so that the per buffer
+// loop doesn't have to check the type of nca / config.
+template<NcaMode Mode, bool Hash, bool Crypt, bool Fused = false>
+struct InstallTraits {
+    static constexpr auto mode = Mode;
+    // ncz output is crypted and hashed in a single sweep by the decompress
+    // thread, which then skips the hash thread.
+    static constexpr bool fused = Fused;
+    // output goes to the hash thread rather than straight to the write thread.
+    static constexpr bool hash = Hash && !Fused;
+    // ncz output needs re-encrypting, false if every section is plaintext.
+    static constexpr bool crypt = Crypt;
+};
+
+template<typename Traits>
+Result DecompressLoop(PipelineData* t, DecompressState& s) {
+    constexpr auto is_ncz = Traits::mode != NcaMode::Plain;
+
+    auto& buf = s.tbuf.buf;
+    auto& inflate_buf = s.inflate_tbuf.buf;
+    auto& inflate_offset = s.inflate_offset;
+
+    const auto dctx = t->dctx;
+    const auto chunk_size = ZSTD_DStreamOutSize();
+    const ncz::BlockInfo* ncz_block{};
+    s64 block_offset{};
+
+    // encrypts data in place, also hashing it if fused.
+    const auto crypt = [&](ThreadBuffer& tbuf, u8* data, u64 size) -> Result {
+        if constexpr (Traits::fused) {
+            R_TRY(CryptHashNczSections(t->ncz_sections, data, size, s.written, std::addressof(t->sha256)));
+            if (t->journal_enabled) {
+                tbuf.sha256 = t->sha256;
+            }
+        } else if constexpr (Traits::crypt) {
+            R_TRY(s.ctr_crypter->Crypt(data, size, s.written));
+        }
+        R_SUCCEED();
+    };
+
+    // encrypts the nca and passes the whole buffer to the write thread.
+    // output is never written past INFLATE_BUFFER_MAX, so there is no tail to keep.
+    // block ncz output has already been encrypted by the block workers.
+    const auto ncz_flush = [&](bool encrypted) -> Result {
+        if (!inflate_offset) {
+            R_SUCCEED();
+        }
+
+        if (!encrypted) {
+            R_TRY(crypt(s.inflate_tbuf, inflate_buf.data(), inflate_offset));
+        }
+        s.written += inflate_offset;
+
+        inflate_buf.resize(inflate_offset);
+        R_TRY(t->template PushWriteBuf<Traits::hash>(s.inflate_tbuf));
+        inflate_offset = 0;
+        R_SUCCEED();
+    };
+
+    // each job output is a whole number of blocks, so it is flushed as is.
+    const auto ncz_block_output = [&](PooledBuffer& out) -> Result {
+        t->decompress_offset += out.size();
+        inflate_offset = out.size();
+        inflate_buf = std::move(out);
+        return ncz_flush(true);
+    };
+
+    while (t->decompress_offset < t->write_size && R_SUCCEEDED(t->GetResults())) {
+        if (!t->read_buffers.Pop(s.tbuf)) {
+            break;
+        }
+
+        if constexpr (Traits::mode == NcaMode::Plain) {
+            // nothing to do, pass buffer directly to write.
+            s.written += buf.size();
+            t->decompress_offset += buf.size();
+            R_TRY(t->template PushWriteBuf<Traits::hash>(s.tbuf));
+        } else if constexpr (Traits::mode == NcaMode::NczBlockParallel) {
+            R_TRY(s.block_decompressor->Feed(std::span{buf.data(), buf.size()}, ncz_block_output));
+        } else {
+            auto decompress_buf_off = s.tbuf.off;
+            u64 buf_off{};
+            while (buf_off < buf.size()) {
+                std::span<const u8> buffer{buf.data() + buf_off, buf.size() - buf_off};
+                bool compressed = true;
+
+                // todo: blocks need to use read offset, as the offset + size is compressed range.
+                if constexpr (Traits::mode == NcaMode::NczBlock) {
+                    if (!ncz_block || !ncz_block->InRange(decompress_buf_off)) {
+                        block_offset = 0;
+                        log_debug("[NCZ] looking for new block: %zu\n", decompress_buf_off);
+                        auto it = std::ranges::find_if(t->ncz_blocks, [decompress_buf_off](auto& e){
+                            return e.InRange(decompress_buf_off);
+                        });
+
+                        R_UNLESS(it != t->ncz_blocks.cend(), Result_YatiNczBlockNotFound);
+                        log_debug("[NCZ] found new block: %zu off: %zd size: %zd\n", decompress_buf_off, it->offset, it->size);
+                        ncz_block = &(*it);
+                    }
+
+                    // check if this block is compressed.
+                    const auto decompressedBlockSize = t->GetNczBlockDecompressedSize(ncz_block - t->ncz_blocks.data());
+                    compressed = ncz_block->size < decompressedBlockSize;
+
+                    // clip read size as blocks can be up to 32GB in size!
+                    const auto size = std::min<u64>(buffer.size(), ncz_block->size - block_offset);
+                    buffer = buffer.subspan(0, size);
+                }
+
+                if (compressed) {
+                    ZSTD_inBuffer input = { buffer.data(), buffer.size(), 0 };
+                    // zstd may still hold output once the input is consumed, so
+                    // keep draining for as long as it fills the output.
+                    bool output_full{};
+                    while (input.pos < input.size || output_full) {
+                        R_TRY(t->GetResults());
+
+                        // decompress straight into the buffer that is passed to the write thread,
+                        // clipping the output so that it never has to be split.
+                        R_TRY(t->AcquireBuffer(inflate_buf));
+                        const auto out_size = std::min<u64>(chunk_size, INFLATE_BUFFER_MAX - inflate_offset);
+                        ZSTD_outBuffer output = { inflate_buf.data() + inflate_offset, out_size, 0 };
+                        const auto res = ZSTD_decompressStream(dctx, std::addressof(output), std::addressof(input));
+                        if (ZSTD_isError(res)) {
+                            log_write("[NCZ] ZSTD_decompressStream() pos: %zu size: %zu res: %zd msg: %s\n", input.pos, input.size, res, ZSTD_getErrorName(res));
+                        }
+                        R_UNLESS(!ZSTD_isError(res), Result_YatiInvalidNczZstdError);
+
+                        output_full = output.pos == output.size;
+                        t->decompress_offset += output.pos;
+                        inflate_offset += output.pos;
+                        if (static_cast<u64>(inflate_offset) >= INFLATE_BUFFER_MAX) {
+                            R_TRY(ncz_flush(false));
+                        }
+                    }
+                } else if (!inflate_offset && buf_off + buffer.size() == buf.size()) {
+                    // the rest of the read buffer is stored data, so it is
+                    // crypted in place and passed on as is.
+                    log_debug("[NCZ] passing through stored data: %zu\n", buffer.size());
+                    R_TRY(crypt(s.tbuf, buf.data() + buf_off, buffer.size()));
+                    s.written += buffer.size();
+                    t->decompress_offset += buffer.size();
+
+                    s.tbuf.start = buf_off;
+                    R_TRY(t->template PushWriteBuf<Traits::hash>(s.tbuf));
+                } else {
+                    // stored data that shares the read buffer with compressed data.
+                    // clip so that the copy never goes over the max, the rest
+                    // is passed through / copied on the next loop once the buffer is flushed.
+                    buffer = buffer.subspan(0, std::min<u64>(buffer.size(), INFLATE_BUFFER_MAX - inflate_offset));
+
+                    R_TRY(t->AcquireBuffer(inflate_buf));
+                    std::memcpy(inflate_buf.data() + inflate_offset, buffer.data(), buffer.size());
+                    t->copied_size += buffer.size();
+
+                    t->decompress_offset += buffer.size();
+                    inflate_offset += buffer.size();
+                    if (static_cast<u64>(inflate_offset) >= INFLATE_BUFFER_MAX) {
+                        R_TRY(ncz_flush(false));
+                    }
+                }
+
+                buf_off += buffer.size();
+                decompress_buf_off += buffer.size();
+                block_offset += buffer.size();
+            }
+        }
+    }
+
+    // wait for the block workers to finish.
+    if constexpr (Traits::mode == NcaMode::NczBlockParallel) {
+        R_TRY(s.block_decompressor->Finish(ncz_block_output));
+    }
+
+    // flush remaining data.
+    if constexpr (is_ncz) {
+        if (inflate_offset) {
+            log_write("flushing remaining\n");
+            R_TRY(ncz_flush(false));
+        }
+    }
+
+    log_write("decompress thread done!\n");
+    R_SUCCEED();
+}
+
+template<NcaMode Mode, bool Crypt, bool Fused>
+Result DecompressDispatch(PipelineData* t, DecompressState& s) {
+    log_write("decompress variant: %u hash: %u crypt: %u fused: %u\n", static_cast<u32>(Mode), t->hash_enabled, Crypt, Fused);
+    if constexpr (Fused) {
+        return DecompressLoop<InstallTraits<Mode, true, Crypt, true>>(t, s);
+    } else if (t->hash_enabled) {
+        return DecompressLoop<InstallTraits<Mode, true, Crypt>>(t, s);
+    } else {
+        return DecompressLoop<InstallTraits<Mode, false, Crypt>>(t, s);
+    }
+}
+
+// fusing always crypts, there is nothing to gain otherwise.
+template<NcaMode Mode>
+Result DecompressNcz(PipelineData* t, DecompressState& s, bool crypt, bool fused) {
+    if (fused) {
+        return DecompressDispatch<Mode, true, true>(t, s);
+    }
+    return crypt ? DecompressDispatch<Mode, true, false>(t, s) : DecompressDispatch<Mode, false, false>(t, s);
+}
+
+} // namespace
+
+Result DecompressNca(PipelineData* t, DecompressState& s, NcaMode mode, bool crypt, bool fused) {
+    switch (mode) {
+        case NcaMode::Plain:
+            return DecompressDispatch<NcaMode::Plain, false, false>(t, s);
+        case NcaMode::NczSolid:
+            return DecompressNcz<NcaMode::NczSolid>(t, s, crypt, fused);
+        case NcaMode::NczBlock:
+            return DecompressNcz<NcaMode::NczBlock>(t, s, crypt, fused);
+        // the block workers crypt their own output.
+        case NcaMode::NczBlockParallel:
+            return DecompressDispatch<NcaMode::NczBlockParallel, false, false>(t, s);
+    }
+
+    R_SUCCEED();
+}
+
+} // namespace sphaira::yati
@@ -0,0 +1,145 @@
+#include "yati/journal.hpp"
+#include "defines.hpp"
+#include "fs.hpp"
+#include "log.hpp"
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdio>
+#include <cstring>
+#include <ctime>
+#include <string_view>
+#include <dirent.h>
+
+namespace sphaira::yati::journal {
+namespace {
+
+auto GetPath(const NcmContentId& content_id, const char* dir) -> fs::FsPath {
+    char id[0x21]{};
+    for (u32 i = 0; i < sizeof(content_id.c); i++) {
+        std::snprintf(id + i * 2, 3, "%02x", content_id.c[i]);
+    }
+
+    fs::FsPath path;
+    std::snprintf(path, sizeof(path), "%s/%s.bin", dir, id);
+    return path;
+}
+
+// reads whatever the file holds, which may be short or from another version.
+// returns true if it names a placeholder, which has to be deleted along with it.
+auto ReadRaw(const char* path, Entry& out) -> bool {
+    auto f = std::fopen(path, "rb");
+    if (!f) {
+        return false;
+    }
+    ON_SCOPE_EXIT(std::fclose(f));
+
+    out = {};
+    out.magic = 0;
+    const auto read = std::fread(&out, 1, sizeof(out), f);
+    return out.magic == MAGIC && read > offsetof(Entry, storage_id);
+}
+
+} // namespace
+
+Result Load(const NcmContentId& content_id, Entry& out, const char* dir) {
+    const auto path = GetPath(content_id, dir);
+    auto f = std::fopen(path, "rb");
+    R_UNLESS(f, Result_YatiJournalNotFound);
+    ON_SCOPE_EXIT(std::fclose(f));
+
+    Entry entry{};
+    R_UNLESS(std::fread(&entry, 1, sizeof(entry), f) == sizeof(entry), Result_YatiJournalInvalid);
+    R_UNLESS(entry.magic == MAGIC && entry.version == VERSION, Result_YatiJournalInvalid);
+    R_UNLESS(!std::memcmp(&entry.content_id, &content_id, sizeof(content_id)), Result_YatiJournalInvalid);
+    R_UNLESS(entry.written >= 0 && entry.written <= entry.write_size, Result_YatiJournalInvalid);
+
+    out = entry;
+    R_SUCCEED();
+}
+
+Result Save(const Entry& entry, const char* dir) {
+    fs::CreateDirectoryRecursively(dir);
+
+    const auto path = GetPath(entry.content_id, dir);
+    auto f = std::fopen(path, "wb");
+    if (!f) {
+        R_TRY(fsdevGetLastResult());
+        return Result_FsUnknownStdioError;
+    }
+    ON_SCOPE_EXIT(std::fclose(f));
+
+    auto out = entry;
+    out.saved_at = std::time(nullptr);
+    R_UNLESS(std::fwrite(&out, 1, sizeof(out), f) == sizeof(out), Result_FsUnknownStdioError);
+    R_SUCCEED();
+}
+
+void Remove(const NcmContentId& content_id, const char* dir) {
+    std::remove(GetPath(content_id, dir));
+}
+
+auto Prune(u64 now, u64 max_age, s64 max_size, const char* dir) -> std::vector<Entry> {
+    std::vector<Entry> removed{};
+    std::vector<Entry> kept{};
+
+    auto d = opendir(dir);
+    if (!d) {
+        return removed;
+    }
+    ON_SCOPE_EXIT(closedir(d));
+
+    while (const auto e = readdir(d)) {
+        const std::string_view name{e->d_name};
+        if (!name.ends_with(".bin")) {
+            continue;
+        }
+
+        fs::FsPath path;
+        std::snprintf(path, sizeof(path), "%s/%s", dir, e->d_name);
+
+        Entry entry{};
+        const auto has_placeholder = ReadRaw(path, entry);
+        // an entry whose id doesn't match its file name is damaged too.
+        const auto valid = has_placeholder && !std::strcmp(GetPath(entry.content_id, dir).s, path.s) && R_SUCCEEDED(Load(entry.content_id, entry, dir));
+        const auto age = now > entry.saved_at ? now - entry.saved_at : 0;
+
+        if (valid && age <= max_age) {
+            kept.emplace_back(entry);
+            continue;
+        }
+
+        log_write("[JOURNAL] pruning: %s valid: %u age: %zu\n", e->d_name, valid, age);
+        std::remove(path);
+        if (has_placeholder) {
+            removed.emplace_back(entry);
+        }
+    }
+
+    // newest first, so that the oldest go over the budget.
+    std::ranges::sort(kept, [](auto& lhs, auto& rhs) {
+        return lhs.saved_at > rhs.saved_at;
+    });
+
+    s64 total{};
+    for (u64 i = 0; i < kept.size(); i++) {
+        total += kept[i].write_size;
+        if (i && total > max_size) {
+            log_write("[JOURNAL] pruning over budget: %zd\n", kept[i].write_size);
+            Remove(kept[i].content_id, dir);
+            removed.emplace_back(kept[i]);
+        }
+    }
+
+    return removed;
+}
+
+auto CanResume(const Entry& entry, const Target& target, bool has_placeholder) -> bool {
+    if (entry.source_size != target.source_size || entry.storage_id != target.storage_id || entry.flags != target.flags) {
+        return false;
+    }
+
+    return has_placeholder;
+}
+
+} // namespace sphaira::yati::journal
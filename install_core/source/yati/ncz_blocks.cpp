@@ -0,0 +1,72 @@
+#include "yati/ncz_blocks.hpp"
+#include "yati/ncz_crypt.hpp"
+#include "log.hpp"
+
+#include <algorithm>
+
+namespace sphaira::yati {
+
+auto NczBlockDecompressor::CanDecompress(const PipelineData* t) -> bool {
+    for (u64 i = 0; i < t->ncz_blocks.size(); i++) {
+        const auto decompressed_size = t->GetNczBlockDecompressedSize(i);
+        if (decompressed_size > INFLATE_BUFFER_MAX || t->ncz_blocks[i].size > decompressed_size) {
+            return false;
+        }
+    }
+    return !t->ncz_blocks.empty();
+}
+
+NczBlockDecompressor::NczBlockDecompressor(ThreadPool* pool, const Placement& placement, PipelineData* _t, u32 worker_count)
+: m_pool{pool}, m_placement{placement}, t{_t} {
+    m_max_jobs = std::clamp<u32>(worker_count, 1, MAX_WORKERS) * JOBS_PER_WORKER;
+}
+
+NczBlockDecompressor::~NczBlockDecompressor() {
+    // jobs point into this, so wait for them before going away.
+    for (auto& e : m_in_flight) {
+        e.future.Wait();
+    }
+
+    pool::Unreserve(m_reserved_jobs * 2);
+}
+
+Result NczBlockDecompressor::Decompress(ZSTD_DCtx* dctx, NczBlockJob& job) const {
+    // if every block is stored, the input already is the output.
+    if (job.in.size() == job.out_size) {
+        job.out = std::move(job.in);
+        return CryptNczSections(t->ncz_sections, job.out.data(), job.out.size(), job.nca_offset);
+    }
+
+    R_TRY(pool::Acquire(job.out));
+
+    u64 in_off{};
+    for (u64 i = job.first_block; i < job.first_block + job.block_count; i++) {
+        // bail between blocks so a cancel doesn't wait on the whole job.
+        R_TRY(t->GetResults());
+
+        const auto compressed_size = t->ncz_blocks[i].size;
+        const auto decompressed_size = t->GetNczBlockDecompressedSize(i);
+        const auto dst = job.out.data() + job.out.size();
+
+        if (compressed_size < decompressed_size) {
+            const auto res = ZSTD_decompressDCtx(dctx, dst, decompressed_size, job.in.data() + in_off, compressed_size);
+            if (ZSTD_isError(res) || res != decompressed_size) {
+                log_write("[NCZ] ZSTD_decompressDCtx() block: %zu res: %zd msg: %s\n", i, res, ZSTD_getErrorName(res));
+                R_THROW(Result_YatiInvalidNczZstdError);
+            }
+        } else {
+            std::memcpy(dst, job.in.data() + in_off, decompressed_size);
+            t->copied_size += decompressed_size;
+        }
+
+        in_off += compressed_size;
+        job.out.resize(job.out.size() + decompressed_size);
+    }
+
+    // give back the input early as the job may wait a while to be collected.
+    job.in.Release();
+
+    return CryptNczSections(t->ncz_sections, job.out.data(), job.out.size(), job.nca_offset);
+}
+
+} // namespace sphaira::yati
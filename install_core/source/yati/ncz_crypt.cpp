@@ -0,0 +1,80 @@
+#include "yati/ncz_crypt.hpp"
+#include "yati/nx/nca.hpp"
+#include "yati/nx/crypto.hpp"
+#include "defines.hpp"
+
+#include <algorithm>
+#include <vector>
+
+namespace sphaira::yati {
+
+Result CryptNczSections(std::span<const ncz::Section> sections, u8* data, u64 size, u64 offset) {
+    for (u64 off = 0; off < size;) {
+        const auto nca_offset = offset + off;
+        auto it = std::ranges::find_if(sections, [nca_offset](auto& e){
+            return e.InRange(nca_offset);
+        });
+        R_UNLESS(it != sections.end(), Result_YatiNczSectionNotFound);
+
+        const auto chunk_size = std::min<u64>(it->offset + it->size - nca_offset, size - off);
+        if (it->crypto_type >= nca::EncryptionType_AesCtr) {
+            crypto::cryptoAes128Ctr(data + off, data + off, it->key, it->counter, nca_offset, chunk_size);
+        }
+
+        off += chunk_size;
+    }
+
+    R_SUCCEED();
+}
+
+Result CryptHashNczSections(std::span<const ncz::Section> sections, u8* data, u64 size, u64 offset, Sha256Context* sha256) {
+    for (u64 off = 0; off < size;) {
+        const auto nca_offset = offset + off;
+        auto it = std::ranges::find_if(sections, [nca_offset](auto& e){
+            return e.InRange(nca_offset);
+        });
+        R_UNLESS(it != sections.end(), Result_YatiNczSectionNotFound);
+
+        const auto chunk_size = std::min<u64>(it->offset + it->size - nca_offset, size - off);
+        if (it->crypto_type >= nca::EncryptionType_AesCtr) {
+            crypto::cryptoAes128CtrSha256(data + off, data + off, it->key, it->counter, nca_offset, chunk_size, sha256);
+        } else {
+            sha256ContextUpdate(sha256, data + off, chunk_size);
+        }
+
+        off += chunk_size;
+    }
+
+    R_SUCCEED();
+}
+
+Result NczCtrCrypter::Crypt(u8* data, u64 size, u64 offset) {
+    const auto shard_count = std::clamp<u64>(size / MIN_SHARD_SIZE, 1, m_thread_count);
+    // keep every shard but the last block aligned.
+    const u64 shard_size = ((size / shard_count) + 0xF) & ~u64{0xF};
+
+    std::vector<ThreadPool::Future> shards{};
+    for (u64 start = shard_size; start < size; start += shard_size) {
+        const auto shard_data = data + start;
+        const auto shard_len = std::min(shard_size, size - start);
+        const auto shard_offset = offset + start;
+
+        shards.emplace_back(m_pool->Submit([this, shard_data, shard_len, shard_offset](ThreadPool::Context&) {
+            return CryptNczSections(m_sections, shard_data, shard_len, shard_offset);
+        }, m_placement));
+    }
+
+    auto rc = CryptNczSections(m_sections, data, std::min(shard_size, size), offset);
+
+    // every shard has to finish before returning as they point into data.
+    for (auto& shard : shards) {
+        const auto shard_rc = shard.Wait();
+        if (R_SUCCEEDED(rc)) {
+            rc = shard_rc;
+        }
+    }
+
+    return rc;
+}
+
+} // namespace sphaira::yati
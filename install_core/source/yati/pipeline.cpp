@@ -0,0 +1,19 @@
+#include "yati/pipeline.hpp"
+
+namespace sphaira::yati {
+
+auto PipelineData::GetResults() volatile -> Result {
+    R_TRY(read_result.load());
+    R_TRY(decompress_result.load());
+    R_TRY(hash_result.load());
+    R_TRY(write_result.load());
+    R_SUCCEED();
+}
+
+void PipelineData::WakeAllThreads() {
+    read_buffers.Close();
+    hash_buffers.Close();
+    write_buffers.Close();
+}
+
+} // namespace sphaira::yati
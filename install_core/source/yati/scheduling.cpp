@@ -0,0 +1,81 @@
+#include "yati/scheduling.hpp"
+
+namespace sphaira::yati {
+namespace {
+
+constexpr u32 CORE_0 = 1 << 0;
+constexpr u32 CORE_1 = 1 << 1;
+constexpr u32 CORE_2 = 1 << 2;
+
+} // namespace
+
+auto GetSchedulingPolicy(SchedulingPreset preset) -> SchedulingPolicy {
+    SchedulingPolicy policy{};
+
+    switch (preset) {
+        case SchedulingPreset_Spread:
+            break;
+
+        case SchedulingPreset_Pinned:
+            policy.read.core_mask = CORE_1;
+            policy.decompress.core_mask = CORE_2;
+            // hashing shares core 0 with write, which mostly waits on the storage,
+            // rather than being fused into decompress on core 2.
+            policy.hash.core_mask = CORE_0;
+            policy.write.core_mask = CORE_0;
+            policy.ncz_worker.core_mask = CORE_1 | CORE_2;
+            break;
+
+        case SchedulingPreset_TwoCore:
+            policy.read.core_mask = CORE_0;
+            policy.decompress.core_mask = CORE_1;
+            policy.hash.core_mask = CORE_1;
+            policy.write.core_mask = CORE_0;
+            policy.ncz_worker.core_mask = CORE_0 | CORE_1;
+            policy.install.core_mask = CORE_0;
+            break;
+
+        case SchedulingPreset_SingleCore:
+            policy.read.core_mask = CORE_0;
+            policy.decompress.core_mask = CORE_0;
+            policy.hash.core_mask = CORE_0;
+            policy.write.core_mask = CORE_0;
+            policy.ncz_worker.core_mask = CORE_0;
+            policy.install.core_mask = CORE_0;
+            break;
+    }
+
+    return policy;
+}
+
+auto GetSchedulingPresetName(SchedulingPreset preset) -> const char* {
+    switch (preset) {
+        case SchedulingPreset_Spread: return "Spread";
+        case SchedulingPreset_Pinned: return "Pinned";
+        case SchedulingPreset_TwoCore: return "TwoCore";
+        case SchedulingPreset_SingleCore: return "SingleCore";
+    }
+
+    return "Unknown";
+}
+
+auto GetPreferredCore(const Placement& placement) -> int {
+    const auto mask = placement.core_mask & APPLICATION_CORE_MASK;
+    if (!mask) {
+        return -2;
+    }
+
+    return __builtin_ctz(mask);
+}
+
+Result ApplyPlacement(Handle thread, const Placement& placement) {
+    const auto mask = placement.core_mask & APPLICATION_CORE_MASK;
+    if (mask) {
+        R_TRY(svcSetThreadCoreMask(thread, GetPreferredCore(placement), mask));
+    }
+
+    R_TRY(svcSetThreadPriority(thread, placement.priority));
+    R_SUCCEED();
+}
+
+} // namespace sphaira::yati
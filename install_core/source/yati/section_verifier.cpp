@@ -0,0 +1,237 @@
+#include "yati/section_verifier.hpp"
+#include "yati/nx/crypto.hpp"
+#include "defines.hpp"
+#include "log.hpp"
+
+#include <algorithm>
+#include <cstring>
+
+namespace sphaira::yati {
+namespace {
+
+constexpr u32 IVFC_MAGIC = 0x43465649; // IVFC
+constexpr u64 HASH_SIZE = 0x20;
+
+template<typename T>
+auto IsZero(const T& data) -> bool {
+    const T empty{};
+    return !std::memcmp(&data, &empty, sizeof(data));
+}
+
+} // namespace
+
+Result SectionVerifier::Setup(const nca::Header& header, const keys::KeyEntry& key) {
+    m_key = key;
+    m_sections.clear();
+    m_tile.resize(TILE_SIZE);
+
+    for (u32 i = 0; i < NCA_SECTION_TOTAL; i++) {
+        if (!header.fs_table[i].media_end_offset) {
+            continue;
+        }
+
+        if (R_FAILED(AddSection(header, i))) {
+            log_write("[VERIFY] skipping section: %u\n", i);
+            m_sections.pop_back();
+        }
+    }
+
+    log_write("[VERIFY] verifying %zu sections\n", m_sections.size());
+    R_SUCCEED();
+}
+
+Result SectionVerifier::AddSection(const nca::Header& header, u32 index) {
+    auto& section = m_sections.emplace_back();
+    section.index = index;
+
+    const auto& entry = header.fs_table[index];
+    const auto& fs_header = header.fs_header[index];
+    R_UNLESS(entry.media_end_offset > entry.media_start_offset, Result_YatiInvalidNcaSectionHash);
+
+    // patch (bktr), sparse and compressed sections don't hash the data as stored.
+    R_UNLESS(IsZero(fs_header.patch_info), Result_YatiInvalidNcaSectionHash);
+    R_UNLESS(IsZero(fs_header.spares_info), Result_YatiInvalidNcaSectionHash);
+    R_UNLESS(IsZero(fs_header.compression_info), Result_YatiInvalidNcaSectionHash);
+
+    switch (fs_header.encryption_type) {
+        case nca::EncryptionType_None: section.encrypted = false; break;
+        case nca::EncryptionType_AesCtr: section.encrypted = true; break;
+        default: R_THROW(Result_YatiInvalidNcaSectionHash);
+    }
+
+    // the upper 8 bytes of the counter are the big-endian section ctr.
+    const auto ctr = __builtin_bswap64(fs_header.section_ctr);
+    std::memcpy(section.counter, &ctr, sizeof(ctr));
+
+    const s64 section_offset = NCA_MEDIA_REAL(static_cast<s64>(entry.media_start_offset));
+    const s64 section_size = NCA_MEDIA_REAL(static_cast<s64>(entry.media_end_offset)) - section_offset;
+
+    if (fs_header.hash_type == nca::HashType_HierarchicalSha256) {
+        const auto& data = fs_header.hash_data.hierarchical_sha256_data;
+        R_UNLESS(data.layer_count == 2 && data.block_size, Result_YatiInvalidNcaSectionHash);
+
+        section.master_hash.assign(data.master_hash, data.master_hash + sizeof(data.master_hash));
+
+        // the master hash covers the whole hash table.
+        auto& table = section.levels.emplace_back();
+        table.offset = data.hash_layer.offset;
+        table.size = data.hash_layer.size;
+        table.block_size = data.hash_layer.size;
+        table.keep = true;
+
+        auto& pfs0 = section.levels.emplace_back();
+        pfs0.offset = data.pfs0_layer.offset;
+        pfs0.size = data.pfs0_layer.size;
+        pfs0.block_size = data.block_size;
+    } else if (fs_header.hash_type == nca::HashType_HierarchicalIntegrity) {
+        const auto& data = fs_header.hash_data.integrity_meta_info;
+        const auto& info = data.info_level_hash;
+        R_UNLESS(data.magic == IVFC_MAGIC, Result_YatiInvalidNcaSectionHash);
+        R_UNLESS(info.max_layers >= 2 && info.max_layers - 1 <= std::size(info.levels), Result_YatiInvalidNcaSectionHash);
+        R_UNLESS(data.master_hash_size && data.master_hash_size <= sizeof(data.master_hash), Result_YatiInvalidNcaSectionHash);
+
+        section.master_hash.assign(data.master_hash, data.master_hash + data.master_hash_size);
+
+        for (u32 i = 0; i < info.max_layers - 1; i++) {
+            R_UNLESS(info.levels[i].block_size < 32, Result_YatiInvalidNcaSectionHash);
+
+            auto& level = section.levels.emplace_back();
+            level.offset = info.levels[i].logical_offset;
+            level.size = info.levels[i].hash_data_size;
+            level.block_size = u64{1} << info.levels[i].block_size;
+            level.pad = true;
+            level.keep = i + 2 < info.max_layers;
+        }
+    } else {
+        R_THROW(Result_YatiInvalidNcaSectionHash);
+    }
+
+    u64 kept_size{};
+    for (u32 i = 0; i < section.levels.size(); i++) {
+        auto& level = section.levels[i];
+        R_UNLESS(level.size > 0 && level.block_size, Result_YatiInvalidNcaSectionHash);
+        R_UNLESS(level.offset >= 0 && level.offset + level.size <= section_size, Result_YatiInvalidNcaSectionHash);
+
+        // streaming needs the expected hashes before the data, so every level
+        // has to come after the level holding its hashes.
+        if (i) {
+            const auto& parent = section.levels[i - 1];
+            R_UNLESS(level.offset >= parent.offset + parent.size, Result_YatiInvalidNcaSectionHash);
+        }
+
+        if (level.keep) {
+            kept_size += level.size;
+            R_UNLESS(kept_size <= MAX_HASH_LEVELS_SIZE, Result_YatiInvalidNcaSectionHash);
+            level.data.reserve(level.size);
+        }
+
+        level.offset += section_offset;
+        sha256ContextCreate(std::addressof(level.block_ctx));
+    }
+
+    R_SUCCEED();
+}
+
+Result SectionVerifier::Update(const u8* data, u64 size, s64 offset) {
+    const auto end = offset + static_cast<s64>(size);
+
+    for (auto& section : m_sections) {
+        for (u32 i = 0; i < section.levels.size(); i++) {
+            auto& level = section.levels[i];
+            const auto level_pos = level.offset + level.done;
+            const auto level_end = level.offset + level.size;
+            if (level.done == level.size || end <= level_pos || offset >= level_end) {
+                continue;
+            }
+
+            // data is only ever fed in order, so a gap means data was missed.
+            R_UNLESS(offset <= level_pos, Result_YatiInvalidNcaSectionHash);
+
+            for (auto pos = level_pos; pos < std::min(end, level_end);) {
+                const auto tile_size = std::min<u64>(TILE_SIZE, std::min(end, level_end) - pos);
+                const auto src = data + (pos - offset);
+
+                if (section.encrypted) {
+                    crypto::cryptoAes128Ctr(src, m_tile.data(), m_key.key, section.counter, pos, tile_size);
+                    R_TRY(Feed(section, i, m_tile.data(), tile_size));
+                } else {
+                    R_TRY(Feed(section, i, src, tile_size));
+                }
+
+                pos += tile_size;
+            }
+        }
+    }
+
+    R_SUCCEED();
+}
+
+Result SectionVerifier::Feed(Section& section, u32 level_index, const u8* data, u64 size) {
+    auto& level = section.levels[level_index];
+
+    while (size) {
+        const auto take = std::min(size, level.block_size - level.block_filled);
+        sha256ContextUpdate(std::addressof(level.block_ctx), data, take);
+        if (level.keep) {
+            level.data.insert(level.data.end(), data, data + take);
+        }
+
+        data += take;
+        size -= take;
+        level.block_filled += take;
+        level.done += take;
+
+        if (level.block_filled == level.block_size || level.done == level.size) {
+            R_TRY(FinishBlock(section, level_index));
+        }
+    }
+
+    R_SUCCEED();
+}
+
+Result SectionVerifier::FinishBlock(Section& section, u32 level_index) {
+    auto& level = section.levels[level_index];
+
+    if (level.pad && level.block_filled < level.block_size) {
+        const u8 zeros[0x200]{};
+        for (auto left = level.block_size - level.block_filled; left;) {
+            const auto pad_size = std::min<u64>(left, sizeof(zeros));
+            sha256ContextUpdate(std::addressof(level.block_ctx), zeros, pad_size);
+            left -= pad_size;
+        }
+    }
+
+    u8 hash[HASH_SIZE];
+    sha256ContextGetHash(std::addressof(level.block_ctx), hash);
+
+    const auto& expected = level_index ? section.levels[level_index - 1].data : section.master_hash;
+    const auto hash_offset = level.block_index * HASH_SIZE;
+    R_UNLESS(hash_offset + HASH_SIZE <= expected.size(), Result_YatiInvalidNcaSectionHash);
+
+    if (std::memcmp(hash, expected.data() + hash_offset, HASH_SIZE)) {
+        log_write("[VERIFY] hash mismatch section: %u level: %u block: %zu\n", section.index, level_index, level.block_index);
+        R_THROW(Result_YatiInvalidNcaSectionHash);
+    }
+
+    level.block_index++;
+    level.block_filled = 0;
+    sha256ContextCreate(std::addressof(level.block_ctx));
+    R_SUCCEED();
+}
+
+Result SectionVerifier::Finish() {
+    for (const auto& section : m_sections) {
+        for (u32 i = 0; i < section.levels.size(); i++) {
+            const auto& level = section.levels[i];
+            if (level.done != level.size) {
+                log_write("[VERIFY] section: %u level: %u only hashed: %zd / %zd\n", section.index, i, level.done, level.size);
+                R_THROW(Result_YatiInvalidNcaSectionHash);
+            }
+        }
+    }
+
+    log_write("[VERIFY] all %zu sections are valid\n", m_sections.size());
+    R_SUCCEED();
+}
+
+} // namespace sphaira::yati
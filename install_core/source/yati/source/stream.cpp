@@ -1,49 +1,184 @@
 #include "yati/source/stream.hpp"
 #include "defines.hpp"
+#include "fs.hpp"
 #include "log.hpp"
+#include <algorithm>
+#include <cstring>
 
 namespace sphaira::yati::source {
 
+Stream::~Stream() {
+    WindowClose();
+}
+
+Result Stream::SkipChunk(s64 size, u64* bytes_skipped) {
+    // 使用分块跳过，避免分配巨大内存（XCI secure 分区可能在几 GB 偏移处）
+    constexpr s64 SKIP_CHUNK_SIZE = 1024 * 1024 * 8;  // 8MB 每次
+
+    if (m_skip_buf.empty()) {
+        m_skip_buf.resize(SKIP_CHUNK_SIZE);
+    }
+
+    return ReadChunk(m_skip_buf.data(), std::min<s64>(size, m_skip_buf.size()), bytes_skipped);
+}
+
+Result Stream::TakeChunk(PooledBuffer& out, s64 size) {
+    out.Release();
+    R_SUCCEED();
+}
+
+Result Stream::SetRewindWindow(s64 size) {
+    WindowClose();
+    m_window_size = 0;
+
+    if (size <= 0) {
+        R_SUCCEED();
+    }
+
+    if (size <= MAX_MEMORY_WINDOW) {
+        m_window.resize(size);
+    } else {
+        fs::CreateDirectoryRecursively("/config/BBI");
+        m_window_file = std::fopen(WINDOW_SPILL_PATH, "w+b");
+        if (!m_window_file) {
+            R_TRY(fsdevGetLastResult());
+            return Result_FsUnknownStdioError;
+        }
+    }
+
+    log_write("[Stream] rewind window: %zd bytes in %s\n", size, m_window_file ? "file" : "memory");
+    m_window_size = size;
+    m_window_start = m_offset;
+    R_SUCCEED();
+}
+
+void Stream::WindowClose() {
+    m_window.clear();
+    m_window.shrink_to_fit();
+
+    if (m_window_file) {
+        std::fclose(m_window_file);
+        m_window_file = nullptr;
+        std::remove(WINDOW_SPILL_PATH);
+    }
+}
+
+Result Stream::WindowWrite(s64 off, const u8* data, s64 size) {
+    // only the last window size bytes are ever read back.
+    if (size > m_window_size) {
+        data += size - m_window_size;
+        off += size - m_window_size;
+        size = m_window_size;
+    }
+
+    while (size) {
+        const auto index = off % m_window_size;
+        const auto chunk = std::min(size, m_window_size - index);
+
+        if (m_window_file) {
+            R_UNLESS(!std::fseek(m_window_file, index, SEEK_SET), Result_FsUnknownStdioError);
+            R_UNLESS(std::fwrite(data, 1, chunk, m_window_file) == static_cast<size_t>(chunk), Result_FsUnknownStdioError);
+        } else {
+            std::memcpy(m_window.data() + index, data, chunk);
+        }
+
+        data += chunk;
+        off += chunk;
+        size -= chunk;
+    }
+
+    R_SUCCEED();
+}
+
+Result Stream::WindowRead(s64 off, u8* data, s64 size) {
+    while (size) {
+        const auto index = off % m_window_size;
+        const auto chunk = std::min(size, m_window_size - index);
+
+        if (m_window_file) {
+            R_UNLESS(!std::fseek(m_window_file, index, SEEK_SET), Result_FsUnknownStdioError);
+            R_UNLESS(std::fread(data, 1, chunk, m_window_file) == static_cast<size_t>(chunk), Result_FsUnknownStdioError);
+        } else {
+            std::memcpy(data, m_window.data() + index, chunk);
+        }
+
+        data += chunk;
+        off += chunk;
+        size -= chunk;
+    }
+
+    R_SUCCEED();
+}
+
+Result Stream::ReadForward(u8* buf, s64 size, u64* bytes_read) {
+    R_TRY(ReadChunk(buf, size, bytes_read));
+    if (m_window_size) {
+        R_TRY(WindowWrite(m_offset, buf, *bytes_read));
+    }
+    m_offset += *bytes_read;
+    R_SUCCEED();
+}
+
+Result Stream::SkipForward(s64 size, u64* bytes_skipped) {
+    // data that would fall out of the window anyway is dropped as before,
+    // the rest has to be read so that it can be rewound to.
+    if (!m_window_size || size > m_window_size) {
+        R_TRY(SkipChunk(m_window_size ? size - m_window_size : size, bytes_skipped));
+        m_offset += *bytes_skipped;
+        R_SUCCEED();
+    }
+
+    if (m_skip_buf.empty()) {
+        m_skip_buf.resize(std::min<s64>(m_window_size, 1024 * 1024 * 8));
+    }
+
+    return ReadForward(m_skip_buf.data(), std::min<s64>(size, m_skip_buf.size()), bytes_skipped);
+}
+
 Result Stream::Read(void* _buf, s64 off, s64 size, u64* bytes_read_out) {
-    // streams don't allow for random access (seeking backwards).
-    R_UNLESS(off >= m_offset, Result_StreamBadSeek);
+    // streams only allow seeking backwards within the rewind window.
+    const auto window_begin = std::max(m_window_start, m_offset - m_window_size);
+    R_UNLESS(off >= m_offset || (m_window_size && off >= window_begin), Result_StreamBadSeek);
 
     auto buf = static_cast<u8*>(_buf);
     *bytes_read_out = 0;
 
+    // serve what we can from the window first.
+    if (off < m_offset) {
+        const auto rewind_size = std::min(size, m_offset - off);
+        R_TRY(WindowRead(off, buf, rewind_size));
+
+        *bytes_read_out += rewind_size;
+        buf += rewind_size;
+        off += rewind_size;
+        size -= rewind_size;
+    }
+
     // check if we already have some data in the buffer.
     while (size) {
         // while it is invalid to seek backwards, it is valid to seek forwards.
         // this can be done to skip padding, skip undeeded files etc.
-        // to handle this, simply read the data into a buffer and discard it.
+        // to handle this, the data before off is discarded.
         if (off > m_offset) {
-            const auto skip_size = off - m_offset;
-            
-            // 使用分块跳过，避免分配巨大内存（XCI secure 分区可能在几 GB 偏移处）
-            constexpr s64 SKIP_CHUNK_SIZE = 1024 * 1024 * 8;  // 8MB 每次
-            std::vector<u8> temp_buf(std::min<s64>(skip_size, SKIP_CHUNK_SIZE));
-            
-            s64 remaining = skip_size;
-            while (remaining > 0) {
-                const auto chunk = std::min<s64>(remaining, SKIP_CHUNK_SIZE);
-                u64 bytes_read;
-                R_TRY(ReadChunk(temp_buf.data(), chunk, &bytes_read));
-                m_offset += bytes_read;
-                remaining -= bytes_read;
-                
-                if (bytes_read < (u64)chunk) {
-                    // 数据不足，可能是流结束
-                    break;
-                }
+            u64 bytes_skipped;
+            R_TRY(SkipForward(off - m_offset, &bytes_skipped));
+
+            // 数据不足，可能是流结束
+            if (!bytes_skipped) {
+                break;
             }
         } else {
             u64 bytes_read;
-            R_TRY(ReadChunk(buf, size, &bytes_read));
+            R_TRY(ReadForward(buf, size, &bytes_read));
+
+            // 数据不足，流结束
+            if (!bytes_read) {
+                break;
+            }
 
             *bytes_read_out += bytes_read;
             buf += bytes_read;
             off += bytes_read;
-            m_offset += bytes_read;
             size -= bytes_read;
         }
     }
@@ -51,4 +186,30 @@ Result Stream::Read(void* _buf, s64 off, s64 size, u64* bytes_read_out) {
     R_SUCCEED();
 }
 
+Result Stream::ReadBuffer(PooledBuffer& out, s64 off, s64 size) {
+    out.Release();
+
+    // data before the current offset is only in the window, so has to be copied.
+    if (off < m_offset) {
+        R_SUCCEED();
+    }
+
+    while (off > m_offset) {
+        u64 bytes_skipped;
+        R_TRY(SkipForward(off - m_offset, &bytes_skipped));
+        if (!bytes_skipped) {
+            R_SUCCEED();
+        }
+    }
+
+    R_TRY(TakeChunk(out, size));
+    m_offset += out.size();
+    // the window can't rewind past data it never saw.
+    if (!out.empty()) {
+        m_window_start = m_offset;
+    }
+
+    R_SUCCEED();
+}
+
 } // namespace sphaira::yati::source
@@ -1,5 +1,6 @@
 #include "yati/source/stream_file.hpp"
 #include "log.hpp"
+#include <algorithm>
 
 namespace sphaira::yati::source {
 
@@ -14,4 +15,15 @@ Result StreamFile::ReadChunk(void* buf, s64 size, u64* bytes_read) {
     return rc;
 }
 
+Result StreamFile::SkipChunk(s64 size, u64* bytes_skipped) {
+    R_TRY(GetOpenResult());
+
+    // files can seek, so there's no need to read the data.
+    s64 file_size;
+    R_TRY(m_file.GetSize(&file_size));
+    *bytes_skipped = std::clamp<s64>(file_size - m_offset, 0, size);
+    m_offset += *bytes_skipped;
+    R_SUCCEED();
+}
+
 } // namespace sphaira::yati::source
@@ -0,0 +1,149 @@
+#include "yati/thread_pool.hpp"
+#include "defines.hpp"
+#include "log.hpp"
+
+namespace sphaira::yati {
+namespace {
+
+// workers are spread over the cores the application is allowed to use.
+constexpr int WORKER_CORES[]{0, 1, 2};
+
+} // namespace
+
+ThreadPool::~ThreadPool() {
+    {
+        SCOPED_MUTEX(&m_idle_mutex);
+        m_quit = true;
+        condvarWakeAll(&m_idle_cond);
+    }
+
+    for (auto& w : m_workers) {
+        if (w->started) {
+            threadWaitForExit(std::addressof(w->thread));
+            threadClose(std::addressof(w->thread));
+        }
+        ZSTD_freeDCtx(w->ctx.dctx);
+    }
+
+    log_write("[POOL] workers: %zu tasks completed: %zu stolen: %zu\n", m_workers.size(), m_completed.load(), m_stolen.load());
+}
+
+Result ThreadPool::Create(u32 count, u64 stack_size) {
+    for (u32 i = 0; i < count; i++) {
+        auto& w = m_workers.emplace_back(std::make_unique<Worker>());
+        w->pool = this;
+        w->ctx.index = i;
+        w->ctx.dctx = ZSTD_createDCtx();
+        R_UNLESS(w->ctx.dctx, Result_YatiInvalidNczZstdError);
+
+        const auto core = WORKER_CORES[i % std::size(WORKER_CORES)];
+        w->home.core_mask = 1 << core;
+        w->current = w->home;
+
+        R_TRY(threadCreate(std::addressof(w->thread), WorkerFunc, w.get(), nullptr, stack_size, w->home.priority, core));
+        if (const auto rc = threadStart(std::addressof(w->thread)); R_FAILED(rc)) {
+            threadClose(std::addressof(w->thread));
+            R_THROW(rc);
+        }
+        w->started = true;
+    }
+
+    log_write("[POOL] created %u workers\n", count);
+    R_SUCCEED();
+}
+
+auto ThreadPool::Submit(Func&& func, const Placement& placement) -> Future {
+    auto state = std::make_shared<TaskState>();
+    auto& w = m_workers[m_next_worker++ % m_workers.size()];
+
+    SCOPED_MUTEX(&m_idle_mutex);
+    {
+        SCOPED_MUTEX(&w->mutex);
+        w->tasks.emplace_back(std::move(func), state, placement);
+    }
+
+    m_pending++;
+    condvarWakeOne(&m_idle_cond);
+    return Future{state};
+}
+
+auto ThreadPool::Pop(Worker& worker, Task& out) -> bool {
+    bool found{};
+
+    // take the oldest task of our own deque first.
+    {
+        SCOPED_MUTEX(&worker.mutex);
+        if (!worker.tasks.empty()) {
+            out = std::move(worker.tasks.front());
+            worker.tasks.pop_front();
+            found = true;
+        }
+    }
+
+    // otherwise steal the newest task from another worker.
+    for (u32 i = 1; !found && i < m_workers.size(); i++) {
+        auto& victim = m_workers[(worker.ctx.index + i) % m_workers.size()];
+        SCOPED_MUTEX(&victim->mutex);
+        if (!victim->tasks.empty()) {
+            out = std::move(victim->tasks.back());
+            victim->tasks.pop_back();
+            found = true;
+            m_stolen++;
+        }
+    }
+
+    if (found) {
+        SCOPED_MUTEX(&m_idle_mutex);
+        m_pending--;
+    }
+
+    return found;
+}
+
+void ThreadPool::Place(Worker& worker, const Placement& placement) {
+    auto wanted = placement;
+    if (!wanted.core_mask) {
+        wanted.core_mask = worker.home.core_mask;
+    }
+
+    if (wanted == worker.current) {
+        return;
+    }
+
+    if (R_FAILED(ApplyPlacement(CUR_THREAD_HANDLE, wanted))) {
+        log_write("[POOL] failed to move worker: %u mask: 0x%X prio: 0x%X\n", worker.ctx.index, wanted.core_mask, wanted.priority);
+        return;
+    }
+
+    worker.current = wanted;
+}
+
+void ThreadPool::Run(Worker& worker) {
+    for (;;) {
+        Task task;
+        if (Pop(worker, task)) {
+            Place(worker, task.placement);
+            task.state->rc = task.func(worker.ctx);
+            ueventSignal(std::addressof(task.state->done));
+            m_completed++;
+            continue;
+        }
+
+        SCOPED_MUTEX(&m_idle_mutex);
+        while (!m_pending && !m_quit) {
+            condvarWait(&m_idle_cond, &m_idle_mutex);
+        }
+
+        // only exit once every queued task has been run.
+        if (m_quit && !m_pending) {
+            break;
+        }
+    }
+}
+
+void ThreadPool::WorkerFunc(void* d) {
+    auto w = static_cast<Worker*>(d);
+    w->pool->Run(*w);
+}
+
+} // namespace sphaira::yati
@@ -0,0 +1,103 @@
+#include "yati/tuner.hpp"
+#include "defines.hpp"
+#include "fs.hpp"
+#include "log.hpp"
+
+#include <algorithm>
+#include <cstdio>
+
+namespace sphaira::yati::tuner {
+namespace {
+
+// a stage stalled for more than this much of a period is the bottleneck.
+constexpr s64 STALLED_PERCENT = 25;
+// a stage stalled for less than this much of a period is keeping up.
+constexpr s64 IDLE_PERCENT = 5;
+
+auto GetPath(const Key& key) -> fs::FsPath {
+    fs::FsPath path;
+    std::snprintf(path, sizeof(path), "%s/%s_%u_%s.bin", TUNING_PATH,
+        key.stream ? "stream" : "file", key.storage_id, key.compressed ? "ncz" : "nca");
+    return path;
+}
+
+auto Clamp(const Profile& profile) -> Profile {
+    auto out = profile;
+    out.depth = std::clamp(out.depth, MIN_DEPTH, MAX_DEPTH);
+    out.chunk_size = std::clamp(out.chunk_size, MIN_CHUNK_SIZE, MAX_CHUNK_SIZE);
+    out.chunk_size -= out.chunk_size % CHUNK_STEP;
+    return out;
+}
+
+} // namespace
+
+Tuner::Tuner(const Profile& profile) : m_profile{Clamp(profile)}, m_wanted{m_profile} {
+
+}
+
+void Tuner::Update(const Sample& sample) {
+    if (sample.period_ns <= 0) {
+        return;
+    }
+
+    m_samples++;
+    m_wanted = m_profile;
+
+    const auto read_full = sample.read_full_ns * 100 / sample.period_ns;
+    const auto write_empty = sample.write_empty_ns * 100 / sample.period_ns;
+
+    if (write_empty >= STALLED_PERCENT && read_full <= IDLE_PERCENT) {
+        // source bound, the writer is starved whilst the rings never fill up.
+        // deeper rings soak up bursts from the source and smaller chunks get
+        // data moving sooner after each burst.
+        m_wanted.depth++;
+        m_wanted.chunk_size -= CHUNK_STEP;
+    } else if (read_full >= STALLED_PERCENT && write_empty <= IDLE_PERCENT) {
+        // output bound, the rings are always full so the extra depth is wasted
+        // memory, and bigger chunks mean fewer placeholder writes.
+        m_wanted.depth--;
+        m_wanted.chunk_size += CHUNK_STEP;
+    }
+
+    m_wanted = Clamp(m_wanted);
+
+    if (m_wanted.depth != m_profile.depth || m_wanted.chunk_size != m_profile.chunk_size) {
+        log_write("[TUNER] read full: %zd%% write empty: %zd%% depth: %u -> %u chunk: %zu -> %zu\n",
+            read_full, write_empty, m_profile.depth, m_wanted.depth, m_profile.chunk_size, m_wanted.chunk_size);
+    }
+
+    // chunk size needs no memory, so it always applies.
+    m_profile.chunk_size = m_wanted.chunk_size;
+}
+
+Result Load(const Key& key, Profile& out) {
+    const auto path = GetPath(key);
+    auto f = std::fopen(path, "rb");
+    R_UNLESS(f, Result_YatiTuningNotFound);
+    ON_SCOPE_EXIT(std::fclose(f));
+
+    Profile profile{};
+    R_UNLESS(std::fread(&profile, 1, sizeof(profile), f) == sizeof(profile), Result_YatiTuningInvalid);
+    R_UNLESS(profile.magic == MAGIC && profile.version == VERSION, Result_YatiTuningInvalid);
+
+    out = Clamp(profile);
+    R_SUCCEED();
+}
+
+Result Save(const Key& key, const Profile& profile) {
+    fs::CreateDirectoryRecursively(TUNING_PATH);
+
+    const auto path = GetPath(key);
+    auto f = std::fopen(path, "wb");
+    if (!f) {
+        R_TRY(fsdevGetLastResult());
+        return Result_FsUnknownStdioError;
+    }
+    ON_SCOPE_EXIT(std::fclose(f));
+
+    const auto out = Clamp(profile);
+    R_UNLESS(std::fwrite(&out, 1, sizeof(out), f) == sizeof(out), Result_FsUnknownStdioError);
+    R_SUCCEED();
+}
+
+} // namespace sphaira::yati::tuner
@@ -1,4 +1,11 @@
 #include "yati/yati.hpp"
+#include "yati/buffer_pool.hpp"
+#include "yati/thread_pool.hpp"
+#include "yati/decompress.hpp"
+#include "yati/journal.hpp"
+#include "yati/tuner.hpp"
+#include "yati/section_verifier.hpp"
+#include "yati/ncz_crypt.hpp"
 #include "yati/source/file.hpp"
 #include "yati/source/stream_file.hpp"
 #include "yati/container/nsp.hpp"
@@ -20,6 +27,8 @@
 #include <zstd.h>
 #include <algorithm>
 #include <atomic>
+#include <bit>
+#include <ctime>
 
 namespace sphaira::yati {
 namespace {
@@ -43,6 +52,9 @@ struct NcaCollection : container::CollectionEntry {
     bool modified{};
     // set if the nca was not installed.
     bool skipped{};
+    // set if a journal entry exists for the placeholder, the placeholder
+    // is kept if the install fails so that it can be resumed.
+    bool resumable{};
 };
 
 struct CnmtCollection : NcaCollection {
@@ -75,252 +87,140 @@ struct TikCollection {
 
 struct Yati;
 
-const u64 INFLATE_BUFFER_MAX = 1024*1024*4;
-
-struct ThreadBuffer {
-    ThreadBuffer() {
-        buf.reserve(INFLATE_BUFFER_MAX);
+// a pipeline installing a single nca from the source into its placeholder.
+struct ThreadData final : PipelineData {
+    ThreadData(Yati* _yati, std::span<TikCollection> _tik, NcaCollection* _nca, bool _hash)
+    : PipelineData{_hash, _nca->size}, yati{_yati}, tik{_tik}, nca{_nca} {
     }
 
-    std::vector<u8> buf;
-    s64 off;
-};
-
-template<std::size_t Size>
-struct RingBuf {
-private:
-    ThreadBuffer buf[Size]{};
-    unsigned r_index{};
-    unsigned w_index{};
-
-    static_assert((sizeof(RingBuf::buf) & (sizeof(RingBuf::buf) - 1)) == 0, "Must be power of 2!");
-
-public:
-    void ringbuf_reset() {
-        this->r_index = this->w_index;
-    }
+    // also fails once the install is cancelled, or another nca has failed.
+    auto GetResults() volatile -> Result override;
 
-    unsigned ringbuf_capacity() const {
-        return sizeof(this->buf) / sizeof(this->buf[0]);
-    }
-
-    unsigned ringbuf_size() const {
-        return (this->w_index - this->r_index) % (ringbuf_capacity() * 2U);
-    }
-
-    unsigned ringbuf_free() const {
-        return ringbuf_capacity() - ringbuf_size();
-    }
+    Result Read(void* buf, s64 size, u64* bytes_read);
+    // same as above, but takes the buffer from the source rather than copying into one.
+    // buf is left empty if the source can't hand it over.
+    Result ReadBuffer(PooledBuffer& buf);
 
-    void ringbuf_push(std::vector<u8>& buf_in, s64 off_in) {
-        auto& value = this->buf[this->w_index % ringbuf_capacity()];
-        value.off = off_in;
-        std::swap(value.buf, buf_in);
+    // saves the journal if enough has been written since the last save and
+    // the write offset is a point the install can be resumed from.
+    void UpdateJournal(NcmContentStorage* cs, const Sha256Context& hash_state);
 
-        this->w_index = (this->w_index + 1U) % (ringbuf_capacity() * 2U);
-    }
+    // these need to be copied
+    Yati* yati{};
+    std::span<TikCollection> tik{};
+    NcaCollection* nca{};
 
-    void ringbuf_pop(std::vector<u8>& buf_out, s64& off_out) {
-        auto& value = this->buf[this->r_index % ringbuf_capacity()];
-        off_out = value.off;
-        std::swap(value.buf, buf_out);
+    // only used if resume_installs is enabled.
+    journal::Entry journal{};
 
-        this->r_index = (this->r_index + 1U) % (ringbuf_capacity() * 2U);
-    }
+    // checks the section hash trees in the hash thread, only set if verify_section_hashes is enabled.
+    std::unique_ptr<SectionVerifier> verifier{};
 };
 
-struct ThreadData {
-    ThreadData(Yati* _yati, std::span<TikCollection> _tik, NcaCollection* _nca)
-    : yati{_yati}, tik{_tik}, nca{_nca} {
-        mutexInit(std::addressof(read_mutex));
-        mutexInit(std::addressof(write_mutex));
-
-        condvarInit(std::addressof(can_read));
-        condvarInit(std::addressof(can_decompress));
-        condvarInit(std::addressof(can_decompress_write));
-        condvarInit(std::addressof(can_write));
-
-        ueventCreate(&m_uevent_done, false);
-        ueventCreate(&m_uevent_progres, true);
-
-        sha256ContextCreate(&sha256);
-        // this will be updated with the actual size from nca header.
-        write_size = nca->size;
-
-        // reduce buffer size to preve
-        read_buffer_size = 1024*1024*4;
-
-        max_buffer_size = std::max(read_buffer_size, INFLATE_BUFFER_MAX);
-    }
-
-    auto GetResults() volatile -> Result;
-    void WakeAllThreads();
-
-    auto IsAnyRunning() volatile const -> bool {
-        return read_running || decompress_result || write_running;
-    }
-
-    auto GetWriteOffset() volatile const -> s64 {
-        return write_offset;
-    }
-
-    auto GetWriteSize() volatile const -> s64 {
-        return write_size;
-    }
-
-    auto GetDoneEvent() {
-        return &m_uevent_done;
-    }
-
-    auto GetProgressEvent() {
-        return &m_uevent_progres;
-    }
-
-    void SetReadResult(Result result) {
-        read_result = result;
-        if (R_FAILED(result)) {
-            ueventSignal(GetDoneEvent());
+// measures how long each placeholder write takes and sleeps for a fraction
+// of it, so that the write thread backs off in proportion to how busy the
+// storage is, rather than a fixed amount per write.
+struct WritePacer {
+    // sleeps shorter than this are carried over to the next write.
+    static constexpr s64 MIN_SLEEP_NS = 1e+5; // 100us
+    // a single sleep is never longer than this.
+    static constexpr s64 MAX_SLEEP_NS = 2e+7; // 20ms
+
+    explicit WritePacer(WritePacing policy) {
+        switch (policy) {
+            case WritePacing_MaxThroughput: sleep_percent = 0; break;
+            case WritePacing_Balanced: sleep_percent = 5; break;
+            case WritePacing_Background: sleep_percent = 50; break;
         }
     }
 
-    void SetDecompressResult(Result result) {
-        decompress_result = result;
-        if (R_FAILED(result)) {
-            ueventSignal(GetDoneEvent());
-        }
-    }
-
-    void SetWriteResult(Result result) {
-        write_result = result;
-        ueventSignal(GetDoneEvent());
+    void Begin() {
+        start_tick = armGetSystemTick();
     }
 
-    Result Read(void* buf, s64 size, u64* bytes_read);
-
-    Result SetDecompressBuf(std::vector<u8>& buf, s64 off, s64 size) {
-        buf.resize(size);
+    void End(u64 size) {
+        const s64 elapsed = armTicksToNs(armGetSystemTick() - start_tick);
+        total_write_ns += elapsed;
+        total_bytes += size;
 
-        mutexLock(std::addressof(read_mutex));
-        if (!read_buffers.ringbuf_free()) {
-            if (!write_running) {
-                R_SUCCEED();
-            }
-            R_TRY(condvarWait(std::addressof(can_read), std::addressof(read_mutex)));
+        debt_ns = std::min(debt_ns + elapsed * sleep_percent / 100, MAX_SLEEP_NS);
+        if (debt_ns < MIN_SLEEP_NS) {
+            // let other threads on this core run, but don't wait.
+            svcSleepThread(YieldType_WithoutCoreMigration);
+            return;
         }
 
-        ON_SCOPE_EXIT(mutexUnlock(std::addressof(read_mutex)));
-        R_TRY(GetResults());
-        read_buffers.ringbuf_push(buf, off);
-        return condvarWakeOne(std::addressof(can_decompress));
-    }
-
-    Result GetDecompressBuf(std::vector<u8>& buf_out, s64& off_out) {
-        mutexLock(std::addressof(read_mutex));
-        if (!read_buffers.ringbuf_size()) {
-            if (!read_running) {
-                buf_out.resize(0);
-                R_SUCCEED();
-            }
-            R_TRY(condvarWait(std::addressof(can_decompress), std::addressof(read_mutex)));
-        }
+        const auto sleep_tick = armGetSystemTick();
+        svcSleepThread(debt_ns);
+        const s64 slept = armTicksToNs(armGetSystemTick() - sleep_tick);
+        total_sleep_ns += slept;
 
-        ON_SCOPE_EXIT(mutexUnlock(std::addressof(read_mutex)));
-        R_TRY(GetResults());
-        read_buffers.ringbuf_pop(buf_out, off_out);
-        return condvarWakeOne(std::addressof(can_read));
+        // oversleeping is paid back by the next writes.
+        debt_ns = std::max(debt_ns - slept, -MAX_SLEEP_NS);
     }
 
-    Result SetWriteBuf(std::vector<u8>& buf, s64 size, bool skip_verify) {
-        buf.resize(size);
-        if (!skip_verify) {
-            sha256ContextUpdate(std::addressof(sha256), buf.data(), buf.size());
-        }
-
-        mutexLock(std::addressof(write_mutex));
-        if (!write_buffers.ringbuf_free()) {
-            if (!decompress_running) {
-                R_SUCCEED();
-            }
-            R_TRY(condvarWait(std::addressof(can_decompress_write), std::addressof(write_mutex)));
-        }
-
-        ON_SCOPE_EXIT(mutexUnlock(std::addressof(write_mutex)));
-        R_TRY(GetResults());
-        write_buffers.ringbuf_push(buf, 0);
-        return condvarWakeOne(std::addressof(can_write));
-    }
-
-    Result GetWriteBuf(std::vector<u8>& buf_out, s64& off_out) {
-        mutexLock(std::addressof(write_mutex));
-        if (!write_buffers.ringbuf_size()) {
-            if (!decompress_running) {
-                buf_out.resize(0);
-                R_SUCCEED();
-            }
-            R_TRY(condvarWait(std::addressof(can_write), std::addressof(write_mutex)));
-        }
-
-        ON_SCOPE_EXIT(mutexUnlock(std::addressof(write_mutex)));
-        R_TRY(GetResults());
-        write_buffers.ringbuf_pop(buf_out, off_out);
-        return condvarWakeOne(std::addressof(can_decompress_write));
+    void Log() const {
+        const auto write_ms = total_write_ns / 1000000;
+        const auto mib_s = write_ms ? (total_bytes * 1000 / write_ms) / (1024 * 1024) : 0;
+        log_write("[PACER] wrote: %zu bytes write time: %zd ms slept: %zd ms speed: %zu MiB/s\n",
+            total_bytes, write_ms, total_sleep_ns / 1000000, mib_s);
     }
 
-    // these need to be copied
-    Yati* yati{};
-    std::span<TikCollection> tik{};
-    NcaCollection* nca{};
-
-    // these need to be created
-    Mutex read_mutex{};
-    Mutex write_mutex{};
-
-    CondVar can_read{};
-    CondVar can_decompress{};
-    CondVar can_decompress_write{};
-    CondVar can_write{};
-
-    UEvent m_uevent_done{};
-    UEvent m_uevent_progres{};
-
-    RingBuf<4> read_buffers{};
-    RingBuf<4> write_buffers{};
-
-    ncz::BlockHeader ncz_block_header{};
-    std::vector<ncz::Section> ncz_sections{};
-    std::vector<ncz::BlockInfo> ncz_blocks{};
-
-    Sha256Context sha256{};
-
-    u64 read_buffer_size{};
-    u64 max_buffer_size{};
-
-    // these are shared between threads
-    std::atomic<s64> read_offset{};
-    std::atomic<s64> decompress_offset{};
-    std::atomic<s64> write_offset{};
-    std::atomic<s64> write_size{};
+    s64 sleep_percent{};
+    s64 debt_ns{};
+    u64 start_tick{};
+    u64 total_bytes{};
+    s64 total_write_ns{};
+    s64 total_sleep_ns{};
+};
 
-    std::atomic<Result> read_result{};
-    std::atomic<Result> decompress_result{};
-    std::atomic<Result> write_result{};
+// max number of buffers a single nca install can hold at once.
+// every ring full, plus one held by read / hash / write and four by decompress.
+// this is reserved from the pool for every nca being installed.
+constexpr auto GetPipelineBufferCount(u32 depth) -> u64 {
+    return depth + 2 + depth + 1 + 1 + 1 + 4;
+}
 
-    std::atomic_bool read_running{true};
-    std::atomic_bool decompress_running{true};
-    std::atomic_bool write_running{true};
-};
+constexpr u64 PIPELINE_BUFFER_COUNT = GetPipelineBufferCount(tuner::DEFAULT_DEPTH);
 
 struct Yati {
     Yati(ui::ProgressBox*, source::Base*);
     ~Yati();
 
     Result Setup(const ConfigOverride& override);
+    Result ReadSource(void* buf, s64 off, s64 size, u64* bytes_read);
+    Result ReadSourceBuffer(PooledBuffer& out, s64 off, s64 size);
+    Result InstallNcas(std::span<TikCollection> tickets, std::span<NcaCollection> ncas);
     Result InstallNca(std::span<TikCollection> tickets, NcaCollection& nca);
     Result InstallNcaInternal(std::span<TikCollection> tickets, NcaCollection& nca);
+    // installs a small nca on the calling thread, sets handled to false if it has to use the pipeline.
+    Result InstallNcaInline(std::span<TikCollection> tickets, NcaCollection& nca, bool& handled);
+    Result VerifyNcaHash(const NcaCollection& nca);
     Result InstallCnmtNca(std::span<TikCollection> tickets, CnmtCollection& cnmt, const container::Collections& collections);
+    // moves the source past size bytes without reading them, used to skip an installed nca.
+    Result ConsumeSource(s64 off, s64 size);
+
+    // the hash stage runs if hashing the nca or verifying its sections.
+    auto HasHashStage(bool verify_sections) const -> bool {
+        return !config.skip_nca_hash_verify || verify_sections;
+    }
+
+    auto GetJournalFlags() const -> u32;
+    auto CanResume(const NcaCollection& nca, const journal::Entry& entry) -> bool;
+    // deletes the placeholder (and journal) of the nca, unless the install
+    // failed and the nca can be resumed, which a cancel by the user never is.
+    void CleanupPlaceHolder(const NcaCollection& nca, bool failed);
+    // deletes journal entries (and their placeholders) that are too old or over the size budget.
+    void PruneJournal();
 
     Result readFuncInternal(ThreadData* t);
+    // sets up verifier (if not null) with the sections of the nca.
+    Result ParseNcaHeader(std::span<TikCollection> tickets, NcaCollection& nca, u8* data, s64& write_size, SectionVerifier* verifier);
     Result decompressFuncInternal(ThreadData* t);
+    // true if the decompress thread should crypt and hash ncz output itself.
+    auto CanFuseCryptHash(const ThreadData* t) const -> bool;
+    Result hashFuncInternal(ThreadData* t);
+    template<bool Journal>
     Result writeFuncInternal(ThreadData* t);
 
     Result ParseTicketsIntoCollection(std::vector<TikCollection>& tickets, const container::Collections& collections, bool read_data);
@@ -345,31 +245,33 @@ struct Yati {
 
     Service ns_app{};
     std::unique_ptr<container::Base> container{};
+    // runs every pipeline stage and ncz job for the session.
+    std::unique_ptr<ThreadPool> thread_pool{};
     Config config{};
     keys::Keys keys{};
+
+    // the below are used when installing nca's concurrently.
+    // sources are not thread safe, so reads are serialised.
+    Mutex source_mutex{};
+    // protects the ticket collection, which is updated whilst parsing nca headers.
+    Mutex ticket_mutex{};
+    // set by the first nca to fail, stops all other nca's.
+    std::atomic<Result> install_result{};
+    // set if progress is reported for all nca's, rather than per nca.
+    std::atomic_bool batch_progress{};
+    std::atomic<s64> batch_offset{};
+    s64 batch_size{};
 };
 
 auto ThreadData::GetResults() volatile -> Result {
     R_TRY(yati->pbox->ShouldExitResult());
-    R_TRY(read_result.load());
-    R_TRY(decompress_result.load());
-    R_TRY(write_result.load());
-    R_SUCCEED();
-}
-
-void ThreadData::WakeAllThreads() {
-    condvarWakeAll(std::addressof(can_read));
-    condvarWakeAll(std::addressof(can_decompress));
-    condvarWakeAll(std::addressof(can_decompress_write));
-    condvarWakeAll(std::addressof(can_write));
-
-    mutexUnlock(std::addressof(read_mutex));
-    mutexUnlock(std::addressof(write_mutex));
+    R_TRY(yati->install_result.load());
+    return PipelineData::GetResults();
 }
 
 Result ThreadData::Read(void* buf, s64 size, u64* bytes_read) {
     size = std::min<s64>(size, nca->size - read_offset);
-    const auto rc = yati->source->Read(buf, nca->offset + read_offset, size, bytes_read);
+    const auto rc = yati->ReadSource(buf, nca->offset + read_offset, size, bytes_read);
     R_TRY(rc);
 
     R_UNLESS(static_cast<u64>(size) == *bytes_read, Result_YatiInvalidNcaReadSize);
@@ -377,6 +279,51 @@ Result ThreadData::Read(void* buf, s64 size, u64* bytes_read) {
     return rc;
 }
 
+Result ThreadData::ReadBuffer(PooledBuffer& buf) {
+    R_TRY(yati->ReadSourceBuffer(buf, nca->offset + read_offset, nca->size - read_offset));
+    read_offset += buf.size();
+    R_SUCCEED();
+}
+
+void ThreadData::UpdateJournal(NcmContentStorage* cs, const Sha256Context& hash_state) {
+    // saving flushes the placeholder, so only do it every so often.
+    constexpr s64 JOURNAL_INTERVAL = 1024 * 1024 * 64;
+
+    const auto offset = write_offset.load();
+    if (offset - journal.written < JOURNAL_INTERVAL && offset != write_size) {
+        return;
+    }
+
+    // block ncz can only be resumed from the start of a block, blocks start after the nca header.
+    u64 block_index{};
+    if (!ncz_blocks.empty()) {
+        const s64 block_size = 1LL << ncz_block_header.block_size_exponent;
+        if (offset < 0x4000 || ((offset - 0x4000) % block_size && offset != write_size)) {
+            return;
+        }
+        block_index = (offset - 0x4000 + block_size - 1) / block_size;
+    }
+
+    // make sure the data has hit the placeholder before saying it has.
+    if (R_FAILED(ncmContentStorageFlushPlaceHolder(cs))) {
+        return;
+    }
+
+    journal.written = offset;
+    journal.write_size = write_size;
+    journal.block_index = block_index;
+    if (hash_enabled) {
+        journal.sha256 = hash_state;
+    }
+
+    if (const auto rc = journal::Save(journal); R_FAILED(rc)) {
+        log_write("[JOURNAL] failed to save: 0x%X\n", rc);
+        return;
+    }
+
+    nca->resumable = true;
+}
+
 auto isRightsIdValid(FsRightsId id) -> bool {
     FsRightsId empty_id{};
     return 0 != std::memcmp(std::addressof(id), std::addressof(empty_id), sizeof(id));
@@ -426,19 +373,37 @@ Result HasRequiredTicket(const nca::Header& header, std::span<TikCollection> tik
     return HasRequiredTicket(header, ticket);
 }
 
+// decrypts the title key of the ticket, which is the key of the nca body.
+Result GetNcaTitleKey(const keys::Keys& keys, const TikCollection& ticket, const nca::Header& header, keys::KeyEntry& out) {
+    // fetch ticket data block.
+    es::TicketData ticket_data;
+    R_TRY(es::GetTicketData(ticket.ticket, std::addressof(ticket_data)));
+
+    // validate that this indeed the correct ticket.
+    R_UNLESS(!std::memcmp(std::addressof(header.rights_id), std::addressof(ticket_data.rights_id), sizeof(header.rights_id)), Result_YatiInvalidTicketBadRightsId);
+
+    // decrypt title key.
+    R_TRY(es::GetTitleKey(out, ticket_data, keys));
+    R_TRY(es::DecryptTitleKey(out, header.key_gen, keys));
+    R_SUCCEED();
+}
+
 // read thread reads all data from the source, it also handles
 // parsing ncz headers, sections and reading ncz blocks
 Result Yati::readFuncInternal(ThreadData* t) {
-    ON_SCOPE_EXIT( t->read_running = false; );
+    ON_SCOPE_EXIT(
+        t->read_running = false;
+        t->read_buffers.Close();
+    );
 
     // the main buffer which data is read into.
-    std::vector<u8> buf;
+    ThreadBuffer tbuf;
+    auto& buf = tbuf.buf;
     // workaround ncz block reading ahead. if block isn't found, we usually
     // would seek back to the offset, however this is not possible in stream
-    // mode, so we instead store the data to the temp buffer and pre-pend it.
-    std::vector<u8> temp_buf;
-    buf.reserve(t->max_buffer_size);
-    temp_buf.reserve(t->max_buffer_size);
+    // mode, so the block header is read into the start of the next buffer.
+    // if it turns out not to be a block header, the data is kept in place.
+    PooledBuffer next_buf;
 
     while (t->read_offset < t->nca->size && R_SUCCEEDED(t->GetResults())) {
         const auto buffer_offset = t->read_offset.load();
@@ -449,14 +414,26 @@ Result Yati::readFuncInternal(ThreadData* t) {
             read_size = NCZ_SECTION_OFFSET;
         }
 
+        // sources that keep their data in pooled buffers hand them over as is, saving a copy.
+        // the headers at the start of the nca are always copied, as they need to be contiguous.
+        if (t->read_offset && !next_buf.IsValid()) {
+            R_TRY(t->ReadBuffer(buf));
+            if (!buf.empty()) {
+                tbuf.off = buffer_offset;
+                R_TRY(t->PushDecompressBuf(tbuf));
+                continue;
+            }
+        }
+
         s64 buf_offset = 0;
-        if (!temp_buf.empty()) {
-            buf = temp_buf;
-            read_size -= temp_buf.size();
-            buf_offset = temp_buf.size();
-            temp_buf.clear();
+        if (next_buf.IsValid()) {
+            buf = std::move(next_buf);
+            read_size -= buf.size();
+            buf_offset = buf.size();
         }
 
+        R_TRY(t->AcquireBuffer(buf));
+
         u64 bytes_read{};
         buf.resize(buf_offset + read_size);
         R_TRY(t->Read(buf.data() + buf_offset, read_size, std::addressof(bytes_read)));
@@ -480,13 +457,16 @@ Result Yati::readFuncInternal(ThreadData* t) {
                 R_TRY(t->Read(t->ncz_sections.data(), t->ncz_sections.size() * sizeof(ncz::Section), std::addressof(bytes_read)));
 
                 // check for ncz block header.
-                R_TRY(t->Read(std::addressof(t->ncz_block_header), sizeof(t->ncz_block_header), std::addressof(bytes_read)));
+                R_TRY(t->AcquireBuffer(next_buf));
+                R_TRY(t->Read(next_buf.data(), sizeof(t->ncz_block_header), std::addressof(bytes_read)));
+                std::memcpy(std::addressof(t->ncz_block_header), next_buf.data(), sizeof(t->ncz_block_header));
                 if (t->ncz_block_header.magic != NCZ_BLOCK_MAGIC) {
-                    // didn't find block, keep the data we just read in the temp buffer.
-                    temp_buf.resize(sizeof(t->ncz_block_header));
-                    std::memcpy(temp_buf.data(), std::addressof(t->ncz_block_header), temp_buf.size());
-                    log_write("storing temp data of size: %zu\n", temp_buf.size());
+                    // didn't find block, the data is already at the start of the next buffer.
+                    next_buf.resize(sizeof(t->ncz_block_header));
+                    log_write("keeping read ahead data of size: %zu\n", next_buf.size());
                 } else {
+                    next_buf.Release();
+
                     // validate block header.
                     R_UNLESS(t->ncz_block_header.version == 0x2, Result_YatiInvalidNczBlockVersion);
                     R_UNLESS(t->ncz_block_header.type == 0x1, Result_YatiInvalidNczBlockType);
@@ -507,332 +487,285 @@ Result Yati::readFuncInternal(ThreadData* t) {
             }
         }
 
-        R_TRY(t->SetDecompressBuf(buf, buffer_offset, buf_size));
+        buf.resize(buf_size);
+        tbuf.off = buffer_offset;
+        R_TRY(t->PushDecompressBuf(tbuf));
     }
 
     log_write("read success\n");
     R_SUCCEED();
 }
 
-// decompress thread handles decrypting / modifying the nca header, decompressing ncz
-// and calculating the running sha256.
-Result Yati::decompressFuncInternal(ThreadData* t) {
-    ON_SCOPE_EXIT( t->decompress_running = false; );
-
-    // only used for ncz files.
-    auto dctx = ZSTD_createDCtx();
-    ON_SCOPE_EXIT(ZSTD_freeDCtx(dctx));
-    const auto chunk_size = ZSTD_DStreamOutSize();
-    const ncz::Section* ncz_section{};
-    const ncz::BlockInfo* ncz_block{};
-    bool is_ncz{};
-
-    s64 inflate_offset{};
-    Aes128CtrContext ctx{};
-    std::vector<u8> inflate_buf{};
-    inflate_buf.reserve(t->max_buffer_size);
-
-    s64 written{};
-    s64 block_offset{};
-    std::vector<u8> buf{};
-    buf.reserve(t->max_buffer_size);
+// parses / verifies the nca header, which is at the start of data.
+// the header is re-encrypted in place if it had to be modified.
+// write_size is set to the size of the nca once installed.
+Result Yati::ParseNcaHeader(std::span<TikCollection> tickets, NcaCollection& nca, u8* data, s64& write_size, SectionVerifier* verifier) {
+    log_write("reading nca header\n");
 
-    // encrypts the nca and passes the buffer to the write thread.
-    const auto ncz_flush = [&](s64 size) -> Result {
-        if (!inflate_offset) {
-            R_SUCCEED();
-        }
+    nca::Header header{};
+    crypto::cryptoAes128Xts(data, std::addressof(header), keys.header_key, 0, 0x200, sizeof(header), false);
+    log_write("verifying nca header magic\n");
+    R_UNLESS(header.magic == 0x3341434E, Result_YatiInvalidNcaMagic);
+    log_write("nca magic is ok! type: %u\n", header.content_type);
+
+    // store the unmodified header.
+    nca.header = header;
+
+    if (!config.skip_rsa_header_fixed_key_verify) {
+        log_write("verifying nca fixed key\n");
+        R_TRY(nca::VerifyFixedKey(header));
+        log_write("nca fixed key is ok! type: %u\n", header.content_type);
+    } else {
+        log_write("skipping nca verification\n");
+    }
 
-        // if we are not moving the whole vector, then we need to keep
-        // the remaining data.
-        // rather that copying the entire vector to the write thread,
-        // only copy (store) the remaining amount.
-        std::vector<u8> temp_vector{};
-        if (size < inflate_offset) {
-            temp_vector.resize(inflate_offset - size);
-            std::memcpy(temp_vector.data(), inflate_buf.data() + size, temp_vector.size());
-        }
+    write_size = header.size;
+    log_write("setting placeholder size: %zu\n", write_size);
+    R_TRY(ncmContentStorageSetPlaceHolderSize(std::addressof(cs), std::addressof(nca.placeholder_id), write_size));
 
-        for (s64 off = 0; off < size;) {
-            if (!ncz_section || !ncz_section->InRange(written)) {
-                log_write("[NCZ] looking for new section: %zu\n", written);
-                auto it = std::ranges::find_if(t->ncz_sections, [written](auto& e){
-                    return e.InRange(written);
-                });
+    if (!config.ignore_distribution_bit && header.distribution_type == nca::DistributionType_GameCard) {
+        header.distribution_type = nca::DistributionType_System;
+        nca.modified = true;
+    }
 
-                R_UNLESS(it != t->ncz_sections.cend(), Result_YatiNczSectionNotFound);
-                ncz_section = &(*it);
-                log_write("[NCZ] found new section: %zu\n", written);
+    // other nca's may be parsing their header at the same time.
+    SCOPED_MUTEX(&ticket_mutex);
 
-                if (ncz_section->crypto_type >= nca::EncryptionType_AesCtr) {
-                    const auto swp = s_byteswap<u64>(u64(written) >> 4);
-                    u8 counter[0x16];
-                    std::memcpy(counter + 0x0, ncz_section->counter, 0x8);
-                    std::memcpy(counter + 0x8, &swp, 0x8);
-                    aes128CtrContextCreate(&ctx, ncz_section->key, counter);
-                }
-            }
+    // try and get the ticket, if the nca requires it.
+    auto ticket = GetTicketCollection(header, tickets);
+    R_TRY(HasRequiredTicket(header, ticket));
 
-            const auto total_size = ncz_section->offset + ncz_section->size;
-            const auto chunk_size = std::min<u64>(total_size - written, size - off);
+    // the body is crypted with the title key, or key area 2 if standard crypto.
+    if (verifier) {
+        keys::KeyEntry body_key{};
+        if (ticket) {
+            R_TRY(GetNcaTitleKey(keys, *ticket, header, body_key));
+        } else {
+            auto keak_header = header;
+            R_TRY(nca::DecryptKeak(keys, keak_header));
+            std::memcpy(body_key.key, keak_header.key_area[0x2].area, sizeof(body_key.key));
+        }
 
-            if (ncz_section->crypto_type >= nca::EncryptionType_AesCtr) {
-                aes128CtrCrypt(&ctx, inflate_buf.data() + off, inflate_buf.data() + off, chunk_size);
-            }
+        R_TRY(verifier->Setup(nca.header, body_key));
+    }
 
-            written += chunk_size;
-            off += chunk_size;
-        }
+    if ((config.convert_to_standard_crypto && ticket) || config.lower_master_key) {
+        nca.modified = true;
+        u8 keak_generation{};
 
-        R_TRY(t->SetWriteBuf(inflate_buf, size, config.skip_nca_hash_verify));
-        inflate_offset -= size;
+        if (ticket) {
+            const auto key_gen = header.key_gen;
+            log_write("converting to standard crypto: 0x%X 0x%X\n", key_gen, header.key_gen);
 
-        // restore remaining data to the swapped buffer.
-        if (!temp_vector.empty()) {
-            log_write("[NCZ] storing data size: %zu\n", temp_vector.size());
-            inflate_buf = temp_vector;
-        }
+            keys::KeyEntry title_key;
+            R_TRY(GetNcaTitleKey(keys, *ticket, header, title_key));
 
-        R_SUCCEED();
-    };
+            std::memset(header.key_area, 0, sizeof(header.key_area));
+            std::memcpy(&header.key_area[0x2], &title_key, sizeof(title_key));
 
-    while (t->decompress_offset < t->write_size && R_SUCCEEDED(t->GetResults())) {
-        s64 decompress_buf_off{};
-        R_TRY(t->GetDecompressBuf(buf, decompress_buf_off));
-        if (buf.empty()) {
-            break;
+            keak_generation = key_gen;
+            ticket->required = false;
+        } else if (config.lower_master_key) {
+            R_TRY(nca::DecryptKeak(keys, header));
         }
 
-        // do we have an nsz? if so, setup buffers.
-        if (!is_ncz && !t->ncz_sections.empty()) {
-            log_write("YES IT FOUND NCZ\n");
-            is_ncz = true;
+        if (config.lower_master_key) {
+            keak_generation = 0;
         }
 
-        // if we don't have a ncz or it's before the ncz header, pass buffer directly to write
-        if (!is_ncz || !decompress_buf_off) {
-            // check nca header
-            if (!decompress_buf_off) {
-                log_write("reading nca header\n");
-
-                nca::Header header{};
-                crypto::cryptoAes128Xts(buf.data(), std::addressof(header), keys.header_key, 0, 0x200, sizeof(header), false);
-                log_write("verifying nca header magic\n");
-                R_UNLESS(header.magic == 0x3341434E, Result_YatiInvalidNcaMagic);
-                log_write("nca magic is ok! type: %u\n", header.content_type);
-
-                // store the unmodified header.
-                t->nca->header = header;
-
-                if (!config.skip_rsa_header_fixed_key_verify) {
-                    log_write("verifying nca fixed key\n");
-                    R_TRY(nca::VerifyFixedKey(header));
-                    log_write("nca fixed key is ok! type: %u\n", header.content_type);
-                } else {
-                    log_write("skipping nca verification\n");
-                }
+        R_TRY(nca::EncryptKeak(keys, header, keak_generation));
+        std::memset(&header.rights_id, 0, sizeof(header.rights_id));
+    }
 
-                t->write_size = header.size;
-                log_write("setting placeholder size: %zu\n", t->write_size.load());
-                R_TRY(ncmContentStorageSetPlaceHolderSize(std::addressof(cs), std::addressof(t->nca->placeholder_id), t->write_size));
+    if (nca.modified) {
+        crypto::cryptoAes128Xts(std::addressof(header), data, keys.header_key, 0, 0x200, sizeof(header), true);
+    }
 
-                if (!config.ignore_distribution_bit && header.distribution_type == nca::DistributionType_GameCard) {
-                    header.distribution_type = nca::DistributionType_System;
-                    t->nca->modified = true;
-                }
+    R_SUCCEED();
+}
 
-                // try and get the ticket, if the nca requires it.
-                auto ticket = GetTicketCollection(header, t->tik);
-                R_TRY(HasRequiredTicket(header, ticket));
+// decompress thread handles decrypting / modifying the nca header and decompressing ncz.
+// the header is handled here, the rest of the nca goes through a variant of
+// DecompressLoop() that is picked once the type of nca is known.
+Result Yati::decompressFuncInternal(ThreadData* t) {
+    ON_SCOPE_EXIT(
+        t->decompress_running = false;
+        // unblocks the read thread if we exit early.
+        t->read_buffers.Close();
+        t->CloseDecompressOutput();
+    );
 
-                if ((config.convert_to_standard_crypto && ticket) || config.lower_master_key) {
-                    t->nca->modified = true;
-                    u8 keak_generation{};
+    DecompressState s{};
+    auto& buf = s.tbuf.buf;
 
-                    if (ticket) {
-                        const auto key_gen = header.key_gen;
-                        log_write("converting to standard crypto: 0x%X 0x%X\n", key_gen, header.key_gen);
+    // the first buffer always starts with the nca header, by the time it
+    // has been read, the read thread has also parsed the ncz header (if any).
+    if (!t->read_buffers.Pop(s.tbuf)) {
+        return t->GetResults();
+    }
 
-                        // fetch ticket data block.
-                        es::TicketData ticket_data;
-                        R_TRY(es::GetTicketData(ticket->ticket, std::addressof(ticket_data)));
+    s64 write_size{};
+    R_TRY(ParseNcaHeader(t->tik, *t->nca, buf.data(), write_size, t->verifier.get()));
+    t->write_size = write_size;
+    s.written += buf.size();
+    t->decompress_offset += buf.size();
+
+    // nothing needs re-encrypting if every section is plaintext.
+    const auto crypt = std::ranges::any_of(t->ncz_sections, [](auto& e){
+        return e.crypto_type >= nca::EncryptionType_AesCtr;
+    });
+
+    const auto parallel = config.ncz_decompress_threads > 1 && NczBlockDecompressor::CanDecompress(t);
+    const auto fused = crypt && !parallel && CanFuseCryptHash(t);
+
+    // the header has to be hashed here too, so that the hash stays in order.
+    if (fused) {
+        sha256ContextUpdate(std::addressof(t->sha256), s.tbuf.data(), s.tbuf.size());
+        if (t->journal_enabled) {
+            s.tbuf.sha256 = t->sha256;
+        }
+        R_TRY(t->PushWriteBuf<false>(s.tbuf));
+    } else {
+        R_TRY(t->PushWriteBuf(s.tbuf));
+    }
 
-                        // validate that this indeed the correct ticket.
-                        R_UNLESS(!std::memcmp(std::addressof(header.rights_id), std::addressof(ticket_data.rights_id), sizeof(header.rights_id)), Result_YatiInvalidTicketBadRightsId);
+    if (t->ncz_sections.empty()) {
+        return DecompressNca(t, s, NcaMode::Plain, false, false);
+    }
 
-                        // decrypt title key.
-                        keys::KeyEntry title_key;
-                        R_TRY(es::GetTitleKey(title_key, ticket_data, keys));
-                        R_TRY(es::DecryptTitleKey(title_key, key_gen, keys));
+    log_write("YES IT FOUND NCZ\n");
+    if (parallel) {
+        s.block_decompressor = std::make_unique<NczBlockDecompressor>(thread_pool.get(), config.scheduling.ncz_worker, t, config.ncz_decompress_threads);
+        return DecompressNca(t, s, NcaMode::NczBlockParallel, crypt, false);
+    }
 
-                        std::memset(header.key_area, 0, sizeof(header.key_area));
-                        std::memcpy(&header.key_area[0x2], &title_key, sizeof(title_key));
+    // only used for ncz files, owned by the worker so it may have been used before.
+    ZSTD_DCtx_reset(t->dctx, ZSTD_reset_session_only);
 
-                        keak_generation = key_gen;
-                        ticket->required = false;
-                    } else if (config.lower_master_key) {
-                        R_TRY(nca::DecryptKeak(keys, header));
-                    }
+    if (crypt && !fused) {
+        s.ctr_crypter = std::make_unique<NczCtrCrypter>(thread_pool.get(), config.scheduling.ncz_worker, t->ncz_sections, config.ncz_decompress_threads);
+    }
 
-                    if (config.lower_master_key) {
-                        keak_generation = 0;
-                    }
+    const auto mode = t->ncz_blocks.empty() ? NcaMode::NczSolid : NcaMode::NczBlock;
+    return DecompressNca(t, s, mode, crypt, fused);
+}
 
-                    R_TRY(nca::EncryptKeak(keys, header, keak_generation));
-                    std::memset(&header.rights_id, 0, sizeof(header.rights_id));
-                }
+auto Yati::CanFuseCryptHash(const ThreadData* t) const -> bool {
+    // resumed data below the resume offset must not be hashed, which only
+    // PushWriteBuf() knows about, so leave it to the hash thread.
+    if (!t->hash_enabled || t->resume_offset) {
+        return false;
+    }
 
-                if (t->nca->modified) {
-                    crypto::cryptoAes128Xts(std::addressof(header), buf.data(), keys.header_key, 0, 0x200, sizeof(header), true);
-                }
-            }
+    // the section verifier runs on the hash thread.
+    if (t->verifier) {
+        return false;
+    }
 
-            written += buf.size();
-            t->decompress_offset += buf.size();
-            R_TRY(t->SetWriteBuf(buf, buf.size(), config.skip_nca_hash_verify));
-        } else if (is_ncz) {
-            u64 buf_off{};
-            while (buf_off < buf.size()) {
-                std::span<const u8> buffer{buf.data() + buf_off, buf.size() - buf_off};
-                bool compressed = true;
-
-                // todo: blocks need to use read offset, as the offset + size is compressed range.
-                if (t->ncz_blocks.size()) {
-                    if (!ncz_block || !ncz_block->InRange(decompress_buf_off)) {
-                        block_offset = 0;
-                        log_write("[NCZ] looking for new block: %zu\n", decompress_buf_off);
-                        auto it = std::ranges::find_if(t->ncz_blocks, [decompress_buf_off](auto& e){
-                            return e.InRange(decompress_buf_off);
-                        });
-
-                        R_UNLESS(it != t->ncz_blocks.cend(), Result_YatiNczBlockNotFound);
-                        log_write("[NCZ] found new block: %zu off: %zd size: %zd\n", decompress_buf_off, it->offset, it->size);
-                        ncz_block = &(*it);
-                    }
+    // fusing loses the hash thread running alongside decompression, which is
+    // only free if both are pinned to the same (single) core.
+    const auto& decompress = config.scheduling.decompress;
+    const auto& hash = config.scheduling.hash;
+    return decompress.core_mask == hash.core_mask && std::popcount(decompress.core_mask & APPLICATION_CORE_MASK) == 1;
+}
 
-                    // https://github.com/nicoboss/nsz/issues/79
-                    auto decompressedBlockSize = 1 << t->ncz_block_header.block_size_exponent;
-                    // special handling for the last block to check it's actually compressed
-                    if (ncz_block->offset == t->ncz_blocks.back().offset) {
-                        log_write("[NCZ] last block special handling\n");
-                        decompressedBlockSize = t->ncz_block_header.decompressed_size % decompressedBlockSize;
-                    }
+// hash thread calculates the running sha256 of the nca, then passes the
+// buffer on to the write thread.
+Result Yati::hashFuncInternal(ThreadData* t) {
+    ON_SCOPE_EXIT(
+        t->hash_running = false;
+        // unblocks the decompress / write thread if we exit early.
+        t->hash_buffers.Close();
+        t->write_buffers.Close();
+    );
 
-                    // check if this block is compressed.
-                    compressed = ncz_block->size < static_cast<u64>(decompressedBlockSize);
+    ThreadBuffer tbuf;
+    u64 total_size{};
+    u64 total_ticks{};
+    u64 verify_ticks{};
 
-                    // clip read size as blocks can be up to 32GB in size!
-                    const auto size = std::min<u64>(buffer.size(), ncz_block->size - block_offset);
-                    buffer = buffer.subspan(0, size);
-                }
+    while (R_SUCCEEDED(t->GetResults())) {
+        if (!t->hash_buffers.Pop(tbuf)) {
+            break;
+        }
 
-                if (compressed) {
-                    log_write("[NCZ] COMPRESSED block\n");
-                    ZSTD_inBuffer input = { buffer.data(), buffer.size(), 0 };
-                    while (input.pos < input.size) {
-                        R_TRY(t->GetResults());
-
-                        inflate_buf.resize(inflate_offset + chunk_size);
-                        ZSTD_outBuffer output = { inflate_buf.data() + inflate_offset, chunk_size, 0 };
-                        const auto res = ZSTD_decompressStream(dctx, std::addressof(output), std::addressof(input));
-                        if (ZSTD_isError(res)) {
-                            log_write("[NCZ] ZSTD_decompressStream() pos: %zu size: %zu res: %zd msg: %s\n", input.pos, input.size, res, ZSTD_getErrorName(res));
-                        }
-                        R_UNLESS(!ZSTD_isError(res), Result_YatiInvalidNczZstdError);
-
-                        t->decompress_offset += output.pos;
-                        inflate_offset += output.pos;
-                        if (static_cast<u64>(inflate_offset) >= INFLATE_BUFFER_MAX) {
-                            log_write("[NCZ] flushing compressed data: %zd vs %zd diff: %zd\n", inflate_offset, INFLATE_BUFFER_MAX, inflate_offset - INFLATE_BUFFER_MAX);
-                            R_TRY(ncz_flush(INFLATE_BUFFER_MAX));
-                        }
-                    }
-                } else {
-                    inflate_buf.resize(inflate_offset + buffer.size());
-                    std::memcpy(inflate_buf.data() + inflate_offset, buffer.data(), buffer.size());
-
-                    t->decompress_offset += buffer.size();
-                    inflate_offset += buffer.size();
-                    if (static_cast<u64>(inflate_offset) >= INFLATE_BUFFER_MAX) {
-                        log_write("[NCZ] flushing copy data\n");
-                        R_TRY(ncz_flush(INFLATE_BUFFER_MAX));
-                    }
-                }
+        const auto start = armGetSystemTick();
+        sha256ContextUpdate(std::addressof(t->sha256), tbuf.data(), tbuf.size());
+        total_ticks += armGetSystemTick() - start;
 
-                buf_off += buffer.size();
-                decompress_buf_off += buffer.size();
-                block_offset += buffer.size();
-            }
+        // buffers are in order and nothing is dropped when verifying, so the offset is the running total.
+        if (t->verifier) {
+            const auto verify_start = armGetSystemTick();
+            R_TRY(t->verifier->Update(tbuf.data(), tbuf.size(), total_size));
+            verify_ticks += armGetSystemTick() - verify_start;
         }
-    }
 
-    // flush remaining data.
-    if (is_ncz && inflate_offset) {
-        log_write("flushing remaining\n");
-        R_TRY(ncz_flush(inflate_offset));
-    }
+        total_size += tbuf.size();
+
+        if (t->journal_enabled) {
+            tbuf.sha256 = t->sha256;
+        }
 
-    log_write("decompress thread done!\n");
+        if (!t->write_buffers.Push(tbuf)) {
+            return t->GetResults();
+        }
+    }
 
     // get final hash output.
     sha256ContextGetHash(std::addressof(t->sha256), t->nca->hash);
 
+    const auto hash_ms = armTicksToNs(total_ticks) / 1000000;
+    const auto mib_s = hash_ms ? (total_size * 1000 / hash_ms) / (1024 * 1024) : 0;
+    log_write("[HASH] hashed: %zu bytes hash time: %zu ms speed: %zu MiB/s\n", total_size, hash_ms, mib_s);
+    if (t->verifier) {
+        log_write("[HASH] section verify time: %zu ms\n", armTicksToNs(verify_ticks) / 1000000);
+    }
     R_SUCCEED();
 }
 
 // write thread writes data to the nca placeholder.
+template<bool Journal>
 Result Yati::writeFuncInternal(ThreadData* t) {
-    ON_SCOPE_EXIT( t->write_running = false; );
+    ON_SCOPE_EXIT(
+        t->write_running = false;
+        // unblocks the decompress thread if we exit early.
+        t->write_buffers.Close();
+    );
 
-    std::vector<u8> buf;
-    buf.reserve(t->max_buffer_size);
+    ThreadBuffer tbuf;
+    WritePacer pacer{config.write_pacing};
+    ON_SCOPE_EXIT(pacer.Log());
 
     while (t->write_offset < t->write_size && R_SUCCEEDED(t->GetResults())) {
-        s64 dummy_off;
-        R_TRY(t->GetWriteBuf(buf, dummy_off));
-        if (buf.empty()) {
+        if (!t->write_buffers.Pop(tbuf)) {
             break;
         }
 
         s64 off{};
-        while (static_cast<size_t>(off) < buf.size() && t->write_offset < t->write_size && R_SUCCEEDED(t->GetResults())) {
-            const auto wsize = std::min<s64>(t->read_buffer_size, buf.size() - off);
-            R_TRY(ncmContentStorageWritePlaceHolder(std::addressof(cs), std::addressof(t->nca->placeholder_id), t->write_offset, buf.data() + off, wsize));
+        while (static_cast<size_t>(off) < tbuf.size() && t->write_offset < t->write_size && R_SUCCEEDED(t->GetResults())) {
+            const auto wsize = std::min<s64>(t->read_buffer_size, tbuf.size() - off);
+            pacer.Begin();
+            R_TRY(ncmContentStorageWritePlaceHolder(std::addressof(cs), std::addressof(t->nca->placeholder_id), t->write_offset, tbuf.data() + off, wsize));
 
             off += wsize;
             t->write_offset += wsize;
             ueventSignal(t->GetProgressEvent());
 
-            // todo: check how much time elapsed and sleep the diff
-            // rather than always sleeping a fixed amount.
-            // ie, writing a small buffer (nca header) should not sleep the full 2 ms.
-            svcSleepThread(2e+6); // 2ms
+            pacer.End(wsize);
         }
+
+        if constexpr (Journal) {
+            t->UpdateJournal(std::addressof(cs), tbuf.sha256);
+        }
+
+        // return the buffer to the pool straight away.
+        tbuf.buf.Release();
     }
 
     log_write("finished write thread!\n");
     R_SUCCEED();
 }
 
-void readFunc(void* d) {
-    auto t = static_cast<ThreadData*>(d);
-    t->SetReadResult(t->yati->readFuncInternal(t));
-    log_write("read thread returned now\n");
-}
-
-void decompressFunc(void* d) {
-    log_write("hello decomp thread func\n");
-    auto t = static_cast<ThreadData*>(d);
-    t->SetDecompressResult(t->yati->decompressFuncInternal(t));
-    log_write("decompress thread returned now\n");
-}
-
-void writeFunc(void* d) {
-    auto t = static_cast<ThreadData*>(d);
-    t->SetWriteResult(t->yati->writeFuncInternal(t));
-    log_write("write thread returned now\n");
-}
-
 // stdio-like wrapper for std::vector
 struct BufHelper {
     BufHelper() = default;
@@ -880,6 +813,10 @@ Yati::~Yati() {
         ncmContentStorageClose(std::addressof(ncm_cs[i]));
     }
 
+    // give the memory back whilst nothing is being installed.
+    pool::LogStats();
+    pool::Trim();
+
     App::SetAutoSleepDisabled(false);
 }
 
@@ -887,14 +824,15 @@ Result Yati::Setup(const ConfigOverride& override) {
     log_write("[Yati::Setup] Configuring install parameters\n");
     config.sd_card_install = override.sd_card_install.value_or(true);
     config.allow_downgrade = false;
-    config.skip_if_already_installed = true;
+    config.skip_if_already_installed = override.skip_if_already_installed.value_or(true);
     config.ticket_only = false;
     config.skip_base = false;
     config.skip_patch = false;
     config.skip_addon = false;
     config.skip_data_patch = false;
     config.skip_ticket = false;
-    config.skip_nca_hash_verify = override.skip_nca_hash_verify.value_or(true);
+    // the hash has its own stage and core, so it doesn't slow the install down.
+    config.skip_nca_hash_verify = override.skip_nca_hash_verify.value_or(false);
     config.skip_rsa_header_fixed_key_verify = override.skip_rsa_header_fixed_key_verify.value_or(true);
     config.skip_rsa_npdm_fixed_key_verify = override.skip_rsa_npdm_fixed_key_verify.value_or(true);
     config.ignore_distribution_bit = override.ignore_distribution_bit.value_or(false);
@@ -902,6 +840,24 @@ Result Yati::Setup(const ConfigOverride& override) {
     config.convert_to_standard_crypto = override.convert_to_standard_crypto.value_or(false);
     config.lower_master_key = override.lower_master_key.value_or(false);
     config.lower_system_version = override.lower_system_version.value_or(true);
+    config.write_pacing = override.write_pacing.value_or(WritePacing_Balanced);
+    config.nca_install_threads = std::clamp<u32>(override.nca_install_threads.value_or(2), 1, 4);
+    config.ncz_decompress_threads = std::clamp<u32>(override.ncz_decompress_threads.value_or(3), 1, NczBlockDecompressor::MAX_WORKERS);
+    config.resume_installs = override.resume_installs.value_or(true);
+    config.auto_tune = override.auto_tune.value_or(true);
+    config.persist_tuning = override.persist_tuning.value_or(true);
+    config.scheduling = override.scheduling.value_or(GetSchedulingPolicy(SchedulingPreset_Pinned));
+    config.verify_section_hashes = override.verify_section_hashes.value_or(false);
+    config.stream_rewind_window = override.stream_rewind_window.value_or(1024 * 1024 * 8);
+    // the whole nca has to fit in a single pooled buffer.
+    config.small_nca_threshold = std::min(override.small_nca_threshold.value_or(1024 * 1024), pool::BUFFER_SIZE);
+    config.source_buffer_count = override.source_buffer_count.value_or(0);
+    // never allow the cap to go below what a single pipeline needs, otherwise it would deadlock.
+    const auto default_cap = pool::GetMemoryCapFor(config.nca_install_threads * PIPELINE_BUFFER_COUNT + config.source_buffer_count);
+    const auto min_cap = pool::BUFFER_SIZE * (PIPELINE_BUFFER_COUNT + config.source_buffer_count);
+    config.buffer_pool_memory_cap = std::max(override.buffer_pool_memory_cap.value_or(default_cap), min_cap);
+    pool::SetMemoryCap(config.buffer_pool_memory_cap);
+    pool::ResetStats();
     storage_id = config.sd_card_install ? NcmStorageId_SdCard : NcmStorageId_BuiltInUser;
     log_write("[Yati::Setup] Install to: %s\n", config.sd_card_install ? "SD Card" : "NAND");
 
@@ -926,65 +882,218 @@ Result Yati::Setup(const ConfigOverride& override) {
     cs = ncm_cs[config.sd_card_install];
     db = ncm_db[config.sd_card_install];
 
+    if (config.resume_installs) {
+        PruneJournal();
+    }
+
     log_write("[Yati::Setup] Parsing crypto keys\n");
     R_TRY(parse_keys(keys, true));
+
+    // stages block whilst waiting on each other, so there needs to be a worker
+    // for every stage of every concurrent nca, plus spare workers for ncz jobs.
+    // this has to count the hash stage whenever any nca could start it,
+    // otherwise the stages take the spare workers and the ncz jobs never run.
+    const u32 stage_count = HasHashStage(config.verify_section_hashes) ? 4 : 3;
+    log_write("[Yati::Setup] Creating thread pool\n");
+    thread_pool = std::make_unique<ThreadPool>();
+    R_TRY(thread_pool->Create(stage_count * config.nca_install_threads + config.ncz_decompress_threads, 1024*128));
     log_write("[Yati::Setup] Setup complete\n");
     R_SUCCEED();
 }
 
 Result Yati::InstallNcaInternal(std::span<TikCollection> tickets, NcaCollection& nca) {
-    if (config.skip_if_already_installed || config.ticket_only) {
-        R_TRY(ncmContentStorageHas(std::addressof(cs), std::addressof(nca.skipped), std::addressof(nca.content_id)));
+    // skipped may already be set if the caller checked up front.
+    if (nca.skipped || config.skip_if_already_installed || config.ticket_only) {
+        if (!nca.skipped) {
+            R_TRY(ncmContentStorageHas(std::addressof(cs), std::addressof(nca.skipped), std::addressof(nca.content_id)));
+        }
+
         if (nca.skipped) {
             log_write("\tskipped nca as it's already installed ncmContentStorageHas()\n");
             R_TRY(ncmContentStorageReadContentIdFile(std::addressof(cs), std::addressof(nca.header), sizeof(nca.header), std::addressof(nca.content_id), 0));
             crypto::cryptoAes128Xts(std::addressof(nca.header), std::addressof(nca.header), keys.header_key, 0, 0x200, sizeof(nca.header), false);
 
+            SCOPED_MUTEX(&ticket_mutex);
             R_TRY(HasRequiredTicket(nca.header, tickets));
             R_SUCCEED();
         }
     }
 
-    log_write("generateing placeholder\n");
-    R_TRY(ncmContentStorageGeneratePlaceHolderId(std::addressof(cs), std::addressof(nca.placeholder_id)));
-    log_write("creating placeholder\n");
-    R_TRY(ncmContentStorageCreatePlaceHolder(std::addressof(cs), std::addressof(nca.content_id), std::addressof(nca.placeholder_id), nca.size));
+    // small nca's are installed on the calling thread, as setting up the
+    // pipeline costs more than the install itself.
+    if (static_cast<u64>(nca.size) <= config.small_nca_threshold && !nca.name.ends_with(".ncz")) {
+        bool handled{};
+        R_TRY(InstallNcaInline(tickets, nca, handled));
+        if (handled) {
+            return VerifyNcaHash(nca);
+        }
+    }
+
+    // continue from the placeholder of a previous install, if it was journaled.
+    journal::Entry entry{};
+    bool resume{};
+    if (config.resume_installs && R_SUCCEEDED(journal::Load(nca.content_id, entry))) {
+        resume = CanResume(nca, entry);
+        if (!resume) {
+            log_write("[JOURNAL] discarding entry for: %s\n", nca.name.c_str());
+            if (entry.storage_id == storage_id) {
+                ncmContentStorageDeletePlaceHolder(std::addressof(cs), std::addressof(entry.placeholder_id));
+            }
+            journal::Remove(nca.content_id);
+        }
+    }
+
+    if (resume) {
+        log_write("[JOURNAL] resuming %s from: %zd / %zd block: %zu\n", nca.name.c_str(), entry.written, entry.write_size, entry.block_index);
+        nca.placeholder_id = entry.placeholder_id;
+        nca.resumable = true;
+    } else {
+        log_write("generateing placeholder\n");
+        R_TRY(ncmContentStorageGeneratePlaceHolderId(std::addressof(cs), std::addressof(nca.placeholder_id)));
+        log_write("creating placeholder\n");
+        R_TRY(ncmContentStorageCreatePlaceHolder(std::addressof(cs), std::addressof(nca.content_id), std::addressof(nca.placeholder_id), nca.size));
+
+        entry = {};
+        entry.content_id = nca.content_id;
+        entry.placeholder_id = nca.placeholder_id;
+        entry.storage_id = storage_id;
+        entry.flags = GetJournalFlags();
+        entry.source_size = nca.size;
+    }
+
+    // start from the values learned by previous installs of the same kind.
+    const tuner::Key tune_key{source->IsStream(), static_cast<u8>(storage_id), nca.name.ends_with(".ncz")};
+    tuner::Profile profile{};
+    if (config.auto_tune && config.persist_tuning) {
+        tuner::Load(tune_key, profile);
+    }
+    tuner::Tuner tune{profile};
+
+    // reserve enough buffers for the whole pipeline, this may wait for
+    // another nca to finish if installing concurrently.
+    // anything deeper than the default is only used if the buffers are free.
+    const auto start_depth = std::min(tune.GetProfile().depth, tuner::DEFAULT_DEPTH);
+    u64 reserved = GetPipelineBufferCount(start_depth);
+    pool::Reserve(reserved);
+    ON_SCOPE_EXIT(pool::Unreserve(reserved));
 
     log_write("opening thread\n");
-    ThreadData t_data{this, tickets, std::addressof(nca)};
+    // verifying needs every byte from the start of each section, so not when resuming.
+    const auto verify_sections = config.verify_section_hashes && !resume;
+
+    // the section verifier runs on the hash thread, so it's needed even if not hashing the nca.
+    ThreadData t_data{this, tickets, std::addressof(nca), HasHashStage(verify_sections)};
+    if (verify_sections) {
+        t_data.verifier = std::make_unique<SectionVerifier>();
+    }
 
-    #define READ_THREAD_CORE 1
-    #define DECOMPRESS_THREAD_CORE 2
-    #define WRITE_THREAD_CORE 0
-    // #define READ_THREAD_CORE 2
-    // #define DECOMPRESS_THREAD_CORE 2
-    // #define WRITE_THREAD_CORE 2
+    // reservation to drop to once the rings have drained after shrinking, 0 if none.
+    u64 release_to{};
 
-    Thread t_read{};
-    R_TRY(threadCreate(&t_read, readFunc, std::addressof(t_data), nullptr, 1024*64, PRIO_PREEMPTIVE, READ_THREAD_CORE));
-    ON_SCOPE_EXIT(threadClose(&t_read));
+    // the rings may still hold buffers from the old depth after shrinking,
+    // so the reservation is only given back once they are within the new depth.
+    const auto release_drained = [&]() {
+        if (!release_to) {
+            return;
+        }
 
-    Thread t_decompress{};
-    R_TRY(threadCreate(&t_decompress, decompressFunc, std::addressof(t_data), nullptr, 1024*64, PRIO_PREEMPTIVE, DECOMPRESS_THREAD_CORE));
-    ON_SCOPE_EXIT(threadClose(&t_decompress));
+        if (t_data.read_buffers.size() > t_data.read_buffers.capacity() || t_data.write_buffers.size() > t_data.write_buffers.capacity()) {
+            return;
+        }
 
-    Thread t_write{};
-    R_TRY(threadCreate(&t_write, writeFunc, std::addressof(t_data), nullptr, 1024*64, PRIO_PREEMPTIVE, WRITE_THREAD_CORE));
-    ON_SCOPE_EXIT(threadClose(&t_write));
+        pool::Unreserve(reserved - release_to);
+        reserved = release_to;
+        release_to = 0;
+    };
 
-    log_write("starting threads\n");
-    R_TRY(threadStart(std::addressof(t_read)));
-    ON_SCOPE_EXIT(threadWaitForExit(std::addressof(t_read)));
+    // resizes the read / write rings, keeping the reservation in step.
+    const auto set_depth = [&](u32 depth) {
+        const auto count = GetPipelineBufferCount(depth);
+        if (count > reserved) {
+            if (!pool::TryReserve(count - reserved)) {
+                return;
+            }
+            reserved = count;
+        }
 
-    R_TRY(threadStart(std::addressof(t_decompress)));
-    ON_SCOPE_EXIT(threadWaitForExit(std::addressof(t_decompress)));
+        release_to = count < reserved ? count : 0;
+        t_data.read_buffers.SetCapacity(depth);
+        t_data.write_buffers.SetCapacity(depth);
+        tune.SetDepth(depth);
+        release_drained();
+    };
 
-    R_TRY(threadStart(std::addressof(t_write)));
-    ON_SCOPE_EXIT(threadWaitForExit(std::addressof(t_write)));
+    const auto wanted_depth = tune.GetProfile().depth;
+    t_data.read_buffer_size = tune.GetProfile().chunk_size;
+    t_data.read_buffers.SetCapacity(start_depth);
+    t_data.write_buffers.SetCapacity(start_depth);
+    tune.SetDepth(start_depth);
+    set_depth(wanted_depth);
+    t_data.journal_enabled = config.resume_installs;
+    t_data.journal = entry;
+    if (resume) {
+        t_data.resume_offset = entry.written;
+        t_data.resume_block = entry.block_index;
+        t_data.write_offset = entry.written;
+        t_data.write_size = entry.write_size;
+        if (t_data.hash_enabled) {
+            t_data.sha256 = entry.sha256;
+        }
+    }
+
+    // every stage runs as a task on the session's thread pool.
+    log_write("submitting stages\n");
+    std::vector<ThreadPool::Future> stages{};
+    ON_SCOPE_EXIT(
+        // unblock any stage still running and wait for all of them, as they point to t_data.
+        t_data.WakeAllThreads();
+        for (auto& stage : stages) {
+            stage.Wait();
+        }
+        log_write("stages finished\n");
+    );
+
+    stages.emplace_back(thread_pool->Submit([this, &t_data](ThreadPool::Context&) {
+        t_data.SetReadResult(readFuncInternal(std::addressof(t_data)));
+        log_write("read stage returned now\n");
+        return t_data.read_result.load();
+    }, config.scheduling.read));
+
+    stages.emplace_back(thread_pool->Submit([this, &t_data](ThreadPool::Context& ctx) {
+        t_data.dctx = ctx.dctx;
+        t_data.SetDecompressResult(decompressFuncInternal(std::addressof(t_data)));
+        log_write("decompress stage returned now\n");
+        return t_data.decompress_result.load();
+    }, config.scheduling.decompress));
+
+    // hashing runs in its own stage so that it doesn't serialise with decompression.
+    if (t_data.hash_enabled) {
+        stages.emplace_back(thread_pool->Submit([this, &t_data](ThreadPool::Context&) {
+            t_data.SetHashResult(hashFuncInternal(std::addressof(t_data)));
+            log_write("hash stage returned now\n");
+            return t_data.hash_result.load();
+        }, config.scheduling.hash));
+    }
+
+    stages.emplace_back(thread_pool->Submit([this, &t_data](ThreadPool::Context&) {
+        if (t_data.journal_enabled) {
+            t_data.SetWriteResult(writeFuncInternal<true>(std::addressof(t_data)));
+        } else {
+            t_data.SetWriteResult(writeFuncInternal<false>(std::addressof(t_data)));
+        }
+        log_write("write stage returned now\n");
+        return t_data.write_result.load();
+    }, config.scheduling.write));
 
     const auto waiter_progress = waiterForUEvent(t_data.GetProgressEvent());
     const auto waiter_cancel = waiterForUEvent(pbox->GetCancelEvent());
     const auto waiter_done = waiterForUEvent(t_data.GetDoneEvent());
+    s64 batch_last_offset{};
+
+    // stall times at the start of the current tuning period.
+    u64 tune_tick = armGetSystemTick();
+    u64 tune_read_full{};
+    u64 tune_write_empty{};
 
     for (;;) {
         s32 idx;
@@ -993,28 +1102,60 @@ Result Yati::InstallNcaInternal(std::span<TikCollection> tickets, NcaCollection&
         }
 
         if (!idx) {
-            pbox->UpdateTransfer(t_data.GetWriteOffset(), t_data.GetWriteSize());
+            release_drained();
+
+            if (batch_progress) {
+                // compressed (read) size is known up front for every nca, unlike the write size.
+                const auto offset = t_data.read_offset.load();
+                pbox->UpdateTransfer(batch_offset += offset - batch_last_offset, batch_size);
+                batch_last_offset = offset;
+            } else {
+                pbox->UpdateTransfer(t_data.GetWriteOffset(), t_data.GetWriteSize());
+            }
+
+            const auto now = armGetSystemTick();
+            const s64 period_ns = armTicksToNs(now - tune_tick);
+            if (config.auto_tune && period_ns >= tuner::SAMPLE_PERIOD_NS) {
+                const auto read_full = t_data.read_buffers.GetPushWaitTicks();
+                const auto write_empty = t_data.write_buffers.GetPopWaitTicks();
+
+                tuner::Sample sample{};
+                sample.period_ns = period_ns;
+                sample.read_full_ns = armTicksToNs(read_full - tune_read_full);
+                sample.write_empty_ns = armTicksToNs(write_empty - tune_write_empty);
+                tune.Update(sample);
+
+                t_data.read_buffer_size = tune.GetProfile().chunk_size;
+                set_depth(tune.GetWanted().depth);
+
+                tune_tick = now;
+                tune_read_full = read_full;
+                tune_write_empty = write_empty;
+            }
         } else {
+            // unblock any stage waiting on the source or a ring, the stages
+            // then see the cancel via GetResults() and exit.
+            if (idx == 1) {
+                log_write("install cancelled, stopping stages: %s\n", nca.name.c_str());
+                source->SignalCancel();
+                t_data.WakeAllThreads();
+            }
             break;
         }
     }
 
-    // wait for all threads to close.
-    log_write("waiting for threads to close\n");
-    while (t_data.IsAnyRunning()) {
-        t_data.WakeAllThreads();
-        pbox->Yield();
-
-        if (R_FAILED(waitSingleHandle(t_read.handle, 1000))) {
-            continue;
-        } else if (R_FAILED(waitSingleHandle(t_decompress.handle, 1000))) {
-            continue;
-        } else if (R_FAILED(waitSingleHandle(t_write.handle, 1000))) {
-            continue;
-        }
-        break;
+    // wait for all stages to finish.
+    log_write("waiting for stages to finish\n");
+    t_data.WakeAllThreads();
+    for (auto& stage : stages) {
+        stage.Wait();
     }
-    log_write("threads closed\n");
+    stages.clear();
+    log_write("stages finished\n");
+
+    // bytes copied per 1000 bytes installed, ideally 0 (the source read and zstd output are not copies).
+    const auto written = std::max<s64>(t_data.write_offset.load(), 1);
+    log_write("[NCA] copied: %zu bytes installed: %zd bytes copy ratio: %zu / 1000\n", t_data.copied_size.load(), t_data.write_offset.load(), t_data.copied_size.load() * 1000 / written);
 
     // if any of the threads failed, wake up all threads so they can exit.
     if (R_FAILED(t_data.GetResults())) {
@@ -1024,6 +1165,21 @@ Result Yati::InstallNcaInternal(std::span<TikCollection> tickets, NcaCollection&
     }
     R_TRY(t_data.GetResults());
 
+    // catches a truncated section before the nca is registered.
+    if (t_data.verifier) {
+        R_TRY(t_data.verifier->Finish());
+    }
+
+    if (config.auto_tune && config.persist_tuning && tune.GetSampleCount() >= tuner::MIN_SAMPLES_TO_SAVE) {
+        const auto& learned = tune.GetProfile();
+        log_write("[TUNER] saving depth: %u chunk: %zu\n", learned.depth, learned.chunk_size);
+        tuner::Save(tune_key, learned);
+    }
+
+    return VerifyNcaHash(nca);
+}
+
+Result Yati::VerifyNcaHash(const NcaCollection& nca) {
     NcmContentId content_id{};
     std::memcpy(std::addressof(content_id), nca.hash, sizeof(content_id));
 
@@ -1042,9 +1198,282 @@ Result Yati::InstallNcaInternal(std::span<TikCollection> tickets, NcaCollection&
     R_SUCCEED();
 }
 
+Result Yati::ReadSource(void* buf, s64 off, s64 size, u64* bytes_read) {
+    R_TRY(pbox->ShouldExitResult());
+    SCOPED_MUTEX(&source_mutex);
+    return source->Read(buf, off, size, bytes_read);
+}
+
+Result Yati::ReadSourceBuffer(PooledBuffer& out, s64 off, s64 size) {
+    R_TRY(pbox->ShouldExitResult());
+    SCOPED_MUTEX(&source_mutex);
+    return source->ReadBuffer(out, off, size);
+}
+
+// runs nca installs on multiple threads, each thread takes the next nca from the list.
+struct NcaScheduler {
+    Yati* yati{};
+    std::span<TikCollection> tickets{};
+    std::span<NcaCollection* const> ncas{};
+    std::atomic<u64> next{};
+
+    void Run() {
+        for (;;) {
+            const auto index = next++;
+            if (index >= ncas.size() || R_FAILED(yati->install_result.load())) {
+                break;
+            }
+
+            if (const auto rc = yati->InstallNca(tickets, *ncas[index]); R_FAILED(rc)) {
+                // only keep the first error, as the rest will likely be caused by it.
+                Result expected{};
+                yati->install_result.compare_exchange_strong(expected, rc);
+                break;
+            }
+        }
+    }
+
+    static void Func(void* d) {
+        static_cast<NcaScheduler*>(d)->Run();
+    }
+};
+
+Result Yati::InstallNcas(std::span<TikCollection> tickets, std::span<NcaCollection> ncas) {
+    // every nca reserves its pipeline from the pool, so only run as many as fit.
+    // less the buffers the source keeps for itself.
+    const auto pool_buffers = pool::GetStats().memory_cap / pool::BUFFER_SIZE - config.source_buffer_count;
+    const auto count = std::min<u64>({config.nca_install_threads, ncas.size(), pool_buffers / PIPELINE_BUFFER_COUNT});
+
+    if (count <= 1) {
+        for (auto& nca : ncas) {
+            R_TRY(InstallNca(tickets, nca));
+        }
+        R_SUCCEED();
+    }
+
+    // install the largest first, so that a big nca doesn't end up running on its own at the end.
+    std::vector<NcaCollection*> order{};
+    for (auto& nca : ncas) {
+        order.emplace_back(std::addressof(nca));
+    }
+
+    std::ranges::sort(order, [](auto lhs, auto rhs) {
+        return lhs->size > rhs->size;
+    });
+
+    log_write("installing %zu ncas on %zu threads\n", ncas.size(), count);
+    batch_offset = 0;
+    batch_size = 0;
+    for (const auto nca : order) {
+        batch_size += nca->size;
+    }
+
+    batch_progress = true;
+    ON_SCOPE_EXIT(batch_progress = false);
+    pbox->NewTransfer("Installing ncas"_i18n);
+
+    NcaScheduler scheduler{this, tickets, order};
+
+    // the calling thread runs the scheduler as well, so one less thread is needed.
+    std::vector<Thread> threads(count - 1);
+    u32 started{};
+    ON_SCOPE_EXIT(
+        for (u32 i = 0; i < started; i++) {
+            threadWaitForExit(std::addressof(threads[i]));
+            threadClose(std::addressof(threads[i]));
+        }
+    );
+
+    for (auto& thread : threads) {
+        const auto& placement = config.scheduling.install;
+        if (R_FAILED(threadCreate(std::addressof(thread), NcaScheduler::Func, std::addressof(scheduler), nullptr, 1024*256, placement.priority, GetPreferredCore(placement)))) {
+            break;
+        }
+        ApplyPlacement(thread.handle, placement);
+
+        if (R_FAILED(threadStart(std::addressof(thread)))) {
+            threadClose(std::addressof(thread));
+            break;
+        }
+        started++;
+    }
+
+    scheduler.Run();
+
+    // wait for the other threads before checking the result.
+    for (; started; started--) {
+        threadWaitForExit(std::addressof(threads[started - 1]));
+        threadClose(std::addressof(threads[started - 1]));
+    }
+
+    return install_result.exchange(0);
+}
+
+Result Yati::ConsumeSource(s64 off, s64 size) {
+    // progress is updated after every chunk.
+    constexpr s64 CHUNK_SIZE = 1024 * 1024 * 8;
+    constexpr s64 READ_CHUNK_SIZE = 1024 * 1024;
+
+    // if the source can skip, only the last byte of each chunk is read, streams
+    // discard the data before it via SkipChunk() and other sources seek straight to it.
+    // otherwise, such as usb in stream mode, everything is read in order.
+    const auto can_skip = source->CanSkipForward();
+    std::vector<u8> buf;
+    if (!can_skip) {
+        buf.resize(READ_CHUNK_SIZE);
+    }
+
+    for (s64 done = 0; done < size;) {
+        R_TRY(pbox->ShouldExitResult());
+
+        u64 bytes_read{};
+        s64 chunk{};
+        if (can_skip) {
+            chunk = std::min<s64>(size - done, CHUNK_SIZE);
+            u8 last{};
+            R_TRY(ReadSource(std::addressof(last), off + done + chunk - 1, 1, std::addressof(bytes_read)));
+        } else {
+            chunk = std::min<s64>(size - done, READ_CHUNK_SIZE);
+            R_TRY(ReadSource(buf.data(), off + done, chunk, std::addressof(bytes_read)));
+            chunk = std::min<s64>(chunk, bytes_read);
+        }
+        R_UNLESS(bytes_read, Result_StreamBadSeek);
+
+        done += chunk;
+        pbox->UpdateTransfer(done, size);
+    }
+
+    R_SUCCEED();
+}
+
+auto Yati::GetJournalFlags() const -> u32 {
+    u32 flags{};
+    if (config.ignore_distribution_bit) {
+        flags |= journal::Flag_IgnoreDistributionBit;
+    }
+    if (config.convert_to_standard_crypto) {
+        flags |= journal::Flag_ConvertToStandardCrypto;
+    }
+    if (config.lower_master_key) {
+        flags |= journal::Flag_LowerMasterKey;
+    }
+    if (!config.skip_nca_hash_verify) {
+        flags |= journal::Flag_HasHash;
+    }
+    return flags;
+}
+
+auto Yati::CanResume(const NcaCollection& nca, const journal::Entry& entry) -> bool {
+    const journal::Target target{nca.size, static_cast<u8>(storage_id), GetJournalFlags()};
+
+    // cs is only for the current storage, so don't ask it about another one.
+    bool has{};
+    if (entry.storage_id == target.storage_id && R_FAILED(ncmContentStorageHasPlaceHolder(std::addressof(cs), std::addressof(has), std::addressof(entry.placeholder_id)))) {
+        has = false;
+    }
+
+    return journal::CanResume(entry, target, has);
+}
+
+void Yati::CleanupPlaceHolder(const NcaCollection& nca, bool failed) {
+    // the user won't send the nca again, so there is nothing to resume.
+    const auto cancelled = pbox->ShouldExitResult() == Result_TransferCancelled;
+    if (failed && nca.resumable && !cancelled) {
+        log_write("[JOURNAL] keeping placeholder for: %s\n", nca.name.c_str());
+        return;
+    }
+
+    ncmContentStorageDeletePlaceHolder(std::addressof(cs), std::addressof(nca.placeholder_id));
+    if (nca.resumable) {
+        journal::Remove(nca.content_id);
+    }
+}
+
+void Yati::PruneJournal() {
+    for (const auto& entry : journal::Prune(std::time(nullptr))) {
+        for (size_t i = 0; i < std::size(NCM_STORAGE_IDS); i++) {
+            if (NCM_STORAGE_IDS[i] == entry.storage_id) {
+                log_write("[JOURNAL] deleting pruned placeholder\n");
+                ncmContentStorageDeletePlaceHolder(std::addressof(ncm_cs[i]), std::addressof(entry.placeholder_id));
+            }
+        }
+    }
+}
+
+Result Yati::InstallNcaInline(std::span<TikCollection> tickets, NcaCollection& nca, bool& handled) {
+    R_UNLESS(nca.size >= static_cast<s64>(sizeof(nca::Header)), Result_YatiInvalidNcaSize);
+
+    // the nca may still be an ncz, which needs the pipeline to decompress.
+    // sources that can seek back to the start of the nca can check before
+    // reading the rest, other streams can't.
+    // the window has to cover the probe read plus a header to spare.
+    if (source->GetRewindWindow() >= static_cast<s64>(NCZ_SECTION_OFFSET + sizeof(ncz::Header)) && nca.size >= static_cast<s64>(NCZ_SECTION_OFFSET)) {
+        u64 bytes_read{};
+        ncz::Header header{};
+        R_TRY(ReadSource(std::addressof(header), nca.offset + 0x4000, sizeof(header), std::addressof(bytes_read)));
+        if (header.magic == NCZ_SECTION_MAGIC) {
+            log_write("small nca is an ncz, using pipeline: %s\n", nca.name.c_str());
+            R_SUCCEED();
+        }
+    }
+
+    pool::Reserve(1);
+    ON_SCOPE_EXIT(pool::Unreserve(1));
+
+    PooledBuffer buf{};
+    R_TRY(pool::Acquire(buf));
+
+    u64 bytes_read{};
+    R_TRY(ReadSource(buf.data(), nca.offset, nca.size, std::addressof(bytes_read)));
+    R_UNLESS(bytes_read == static_cast<u64>(nca.size), Result_YatiInvalidNcaSize);
+    buf.resize(bytes_read);
+
+    if (nca.size >= static_cast<s64>(NCZ_SECTION_OFFSET)) {
+        ncz::Header header{};
+        std::memcpy(std::addressof(header), buf.data() + 0x4000, sizeof(header));
+        R_UNLESS(header.magic != NCZ_SECTION_MAGIC, Result_YatiNczInNcaStream);
+    }
+
+    handled = true;
+    log_write("installing small nca inline: %s size: %zd\n", nca.name.c_str(), nca.size);
+
+    R_TRY(ncmContentStorageGeneratePlaceHolderId(std::addressof(cs), std::addressof(nca.placeholder_id)));
+    R_TRY(ncmContentStorageCreatePlaceHolder(std::addressof(cs), std::addressof(nca.content_id), std::addressof(nca.placeholder_id), nca.size));
+
+    std::unique_ptr<SectionVerifier> verifier{};
+    if (config.verify_section_hashes) {
+        verifier = std::make_unique<SectionVerifier>();
+    }
+
+    s64 write_size{};
+    R_TRY(ParseNcaHeader(tickets, nca, buf.data(), write_size, verifier.get()));
+    buf.resize(std::min<s64>(buf.size(), write_size));
+
+    if (!config.skip_nca_hash_verify) {
+        sha256CalculateHash(nca.hash, buf.data(), buf.size());
+    }
+
+    if (verifier) {
+        R_TRY(verifier->Update(buf.data(), buf.size(), 0));
+        R_TRY(verifier->Finish());
+    }
+
+    R_TRY(ncmContentStorageWritePlaceHolder(std::addressof(cs), std::addressof(nca.placeholder_id), 0, buf.data(), buf.size()));
+
+    if (batch_progress) {
+        pbox->UpdateTransfer(batch_offset += buf.size(), batch_size);
+    } else {
+        pbox->UpdateTransfer(buf.size(), write_size);
+    }
+
+    R_SUCCEED();
+}
+
 Result Yati::InstallNca(std::span<TikCollection> tickets, NcaCollection& nca) {
     log_write("in install nca\n");
-    pbox->NewTransfer(nca.name);
+    if (!batch_progress) {
+        pbox->NewTransfer(nca.name);
+    }
     keys::parse_hex_key(std::addressof(nca.content_id), nca.name.c_str());
 
     R_TRY(InstallNcaInternal(tickets, nca));
@@ -1405,10 +1834,12 @@ Result InstallInternal(ui::ProgressBox* pbox, source::Base* source, const contai
     }
 
     for (auto& cnmt : cnmts) {
+        // cleared once the cnmt has been installed (or skipped).
+        bool failed = true;
         ON_SCOPE_EXIT(
-            ncmContentStorageDeletePlaceHolder(std::addressof(yati->cs), std::addressof(cnmt.placeholder_id));
+            yati->CleanupPlaceHolder(cnmt, failed);
             for (auto& nca : cnmt.ncas) {
-                ncmContentStorageDeletePlaceHolder(std::addressof(yati->cs), std::addressof(nca.placeholder_id));
+                yati->CleanupPlaceHolder(nca, failed);
             }
         );
 
@@ -1421,17 +1852,17 @@ Result InstallInternal(ui::ProgressBox* pbox, source::Base* source, const contai
 
         if (skip) {
             log_write("skipping install!\n");
+            failed = false;
             continue;
         }
 
         log_write("installing nca's\n");
-        for (auto& nca : cnmt.ncas) {
-            R_TRY(yati->InstallNca(tickets, nca));
-        }
+        R_TRY(yati->InstallNcas(tickets, cnmt.ncas));
 
         R_TRY(yati->ImportTickets(tickets));
         R_TRY(yati->RemoveInstalledNcas(cnmt));
         R_TRY(yati->RegisterNcasAndPushRecord(cnmt, latest_version_num));
+        failed = false;
     }
 
     log_write("success!\n");
@@ -1445,22 +1876,23 @@ Result InstallInternalStream(ui::ProgressBox* pbox, source::Base* source, contai
     R_TRY(yati->Setup(override));
     log_write("[InstallInternalStream] Setup() succeeded\n");
 
-    // not supported with stream installs (yet).
-    yati->config.skip_if_already_installed = false;
-    yati->config.convert_to_standard_crypto = false;
-    yati->config.lower_master_key = false;
+    // short backward seeks let tickets stored after the nca's be read first.
+    R_TRY(source->SetRewindWindow(yati->config.stream_rewind_window));
 
     std::vector<NcaCollection> ncas{};
     std::vector<CnmtCollection> cnmts{};
     std::vector<TikCollection> tickets{};
 
+    // placeholders that can be resumed are kept if the install fails,
+    // so that sending the same file again continues where it stopped.
+    bool failed = true;
     ON_SCOPE_EXIT(
         for (const auto& cnmt : cnmts) {
-            ncmContentStorageDeletePlaceHolder(std::addressof(yati->cs), std::addressof(cnmt.placeholder_id));
+            yati->CleanupPlaceHolder(cnmt, failed);
         }
 
         for (const auto& nca : ncas) {
-            ncmContentStorageDeletePlaceHolder(std::addressof(yati->cs), std::addressof(nca.placeholder_id));
+            yati->CleanupPlaceHolder(nca, failed);
         }
     );
 
@@ -1476,12 +1908,79 @@ Result InstallInternalStream(ui::ProgressBox* pbox, source::Base* source, contai
 
     std::ranges::sort(collections, sorter);
 
+    // converting the crypto needs the title key when the nca header is parsed.
+    // tickets stored before every nca are read in order anyway, otherwise
+    // they are read up front if the rewind window reaches back to the first nca.
+    bool tickets_read{};
+    {
+        const auto is_ticket = [](const container::CollectionEntry& e) {
+            return e.name.ends_with(".tik") || e.name.ends_with(".cert");
+        };
+        const auto is_nca = [](const container::CollectionEntry& e) {
+            return e.name.ends_with(".nca") || e.name.ends_with(".ncz");
+        };
+
+        s64 first_nca = INT64_MAX;
+        s64 tickets_end{};
+        for (const auto& collection : collections) {
+            if (is_nca(collection)) {
+                first_nca = std::min(first_nca, collection.offset);
+            } else if (is_ticket(collection)) {
+                tickets_end = std::max(tickets_end, collection.offset + collection.size);
+            }
+        }
+
+        if (tickets_end <= first_nca) {
+            log_write("[InstallInternalStream] tickets are before the nca's\n");
+        } else if (!collections.empty() && tickets_end - collections.front().offset <= source->GetRewindWindow()) {
+            log_write("[InstallInternalStream] reading tickets ahead, span: %zd\n", tickets_end - collections.front().offset);
+            tickets.clear();
+            R_TRY(yati->ParseTicketsIntoCollection(tickets, collections, true));
+            tickets_read = true;
+        } else {
+            log_write("[InstallInternalStream] tickets are out of reach, disabling crypto conversion\n");
+            yati->config.convert_to_standard_crypto = false;
+            yati->config.lower_master_key = false;
+        }
+    }
+
+    // check which nca's are already installed up front, these are read past
+    // without being decrypted, hashed or written.
+    std::vector<NcmContentId> installed{};
+    if (yati->config.skip_if_already_installed) {
+        s64 skip_size{};
+        for (const auto& collection : collections) {
+            if (collection.name.ends_with(".nca") || collection.name.ends_with(".ncz")) {
+                NcmContentId content_id{};
+                keys::parse_hex_key(std::addressof(content_id), collection.name.c_str());
+
+                bool has{};
+                R_TRY(ncmContentStorageHas(std::addressof(yati->cs), std::addressof(has), std::addressof(content_id)));
+                if (has) {
+                    installed.emplace_back(content_id);
+                    skip_size += collection.size;
+                }
+            }
+        }
+
+        log_write("[InstallInternalStream] %zu nca's already installed, skipping %zd bytes\n", installed.size(), skip_size);
+    }
+
+    const auto is_installed = [&installed](const NcmContentId& content_id) {
+        return std::ranges::any_of(installed, [&content_id](auto& e){
+            return !std::memcmp(&e, &content_id, sizeof(e));
+        });
+    };
+
     log_write("[InstallInternalStream] Starting collection processing loop\n");
     for (const auto& collection : collections) {
         log_write("[InstallInternalStream] Processing: %s (offset=%lld, size=%lld)\n", 
             collection.name.c_str(), (long long)collection.offset, (long long)collection.size);
         if (collection.name.ends_with(".nca") || collection.name.ends_with(".ncz")) {
             auto& nca = ncas.emplace_back(NcaCollection{collection});
+            keys::parse_hex_key(std::addressof(nca.content_id), collection.name.c_str());
+            nca.skipped = is_installed(nca.content_id);
+
             if (collection.name.ends_with(".cnmt.nca") || collection.name.ends_with(".cnmt.ncz")) {
                 log_write("[InstallInternalStream] Installing CNMT NCA: %s\n", collection.name.c_str());
                 auto& cnmt = cnmts.emplace_back(nca);
@@ -1493,7 +1992,14 @@ Result InstallInternalStream(ui::ProgressBox* pbox, source::Base* source, contai
                 R_TRY(yati->InstallNca(tickets, nca));
                 log_write("[InstallInternalStream] Regular NCA installed successfully\n");
             }
-        } else if (collection.name.ends_with(".tik") || collection.name.ends_with(".cert")) {
+
+            // read past the installed nca, rather than letting the next read
+            // do it, so that progress is still shown whilst skipping.
+            if (nca.skipped) {
+                log_write("[InstallInternalStream] Skipping installed NCA: %s\n", collection.name.c_str());
+                R_TRY(yati->ConsumeSource(collection.offset, collection.size));
+            }
+        } else if (!tickets_read && (collection.name.ends_with(".tik") || collection.name.ends_with(".cert"))) {
             FsRightsId rights_id{};
             keys::parse_hex_key(rights_id.c, collection.name.c_str());
             const auto str = collection.name.substr(0, collection.name.length() - 4) + ".cert";
@@ -1542,6 +2048,7 @@ Result InstallInternalStream(ui::ProgressBox* pbox, source::Base* source, contai
         R_TRY(yati->RegisterNcasAndPushRecord(cnmt, latest_version_num));
     }
 
+    failed = false;
     log_write("success!\n");
     R_SUCCEED();
 }
@@ -1583,4 +2090,36 @@ Result InstallFromCollections(ui::ProgressBox* pbox, source::Base* source, const
     }
 }
 
+#ifdef BBI_DEBUG
+Result BenchmarkScheduling(ui::ProgressBox* pbox, fs::Fs* fs, const fs::FsPath& path, std::vector<SchedulingBenchmark>& out, const ConfigOverride& override) {
+    s64 size{};
+    R_TRY(fs->FileGetSizeAndTimestamp(path, nullptr, std::addressof(size)));
+
+    // the same file is installed every time, so nothing can be skipped or
+    // resumed from a previous run.
+    auto bench_override = override;
+    bench_override.skip_if_already_installed = false;
+    bench_override.resume_installs = false;
+
+    out.clear();
+    for (const auto preset : SCHEDULING_PRESETS) {
+        R_TRY(pbox->ShouldExitResult());
+        bench_override.scheduling = GetSchedulingPolicy(preset);
+
+        auto& e = out.emplace_back();
+        e.preset = preset;
+        e.size = size;
+
+        const auto start = armGetSystemTick();
+        e.rc = InstallFromFile(pbox, fs, path, bench_override);
+        e.ms = armTicksToNs(armGetSystemTick() - start) / 1000000;
+
+        const auto mib_s = e.ms ? (size * 1000 / e.ms) / (1024 * 1024) : 0;
+        log_write("[BENCH] %s: rc: 0x%X time: %zu ms speed: %zd MiB/s\n", GetSchedulingPresetName(preset), e.rc, e.ms, mib_s);
+    }
+
+    R_SUCCEED();
+}
+#endif // BBI_DEBUG
+
 } // namespace sphaira::yati
@@ -4,141 +4,409 @@
 #include <cstring>
 
 namespace sphaira::mtp {
+namespace {
 
-InstallStream::InstallStream(const fs::FsPath& path) {
+// 同时存在的 stream 使用不同的 spill 文件，文件名循环使用，避免异常退出后残留过多文件
+constexpr u32 MAX_SPILL_FILES = 4;
+std::atomic<u32> g_spill_index{};
+
+} // namespace
+
+InstallStream::InstallStream(const fs::FsPath& path, u32 queue_depth, u64 spill_limit) {
     m_path = path;
     m_active = true;
-    m_buffer.reserve(1024ULL * 1024ULL * 32ULL);  // 预留 32MB
+    m_queue_depth = std::clamp<u32>(queue_depth, 1, MAX_QUEUE_DEPTH);
 
     mutexInit(&m_mutex);
+    mutexInit(&m_spill_mutex);
     condvarInit(&m_can_read);
     condvarInit(&m_can_write);
 
-    log_write("[InstallStream] Created for: %s\n", path.s);
+    // 队列中的块加上正在写入的一块，交给 yati 的块由安装流水线归还
+    // 在 MTP 回调中创建，不能阻塞等待，缓冲区不足时由调用者决定重试或放弃
+    m_reserved = yati::pool::TryReserve(m_queue_depth + 1);
+    if (!m_reserved) {
+        log_write("[InstallStream] Failed to reserve %u buffers for: %s\n", m_queue_depth + 1, path.s);
+        return;
+    }
+
+    // 文件至少要能放下一块
+    if (spill_limit >= CHUNK_SIZE) {
+        m_spill_limit = spill_limit;
+        m_spill_high_watermark = std::min(SPILL_HIGH_WATERMARK, m_spill_limit);
+        m_spill_low_watermark = std::min(SPILL_LOW_WATERMARK, m_spill_high_watermark / 2);
+
+        fs::CreateDirectoryRecursively("/config/BBI");
+        std::snprintf(m_spill_path.s, sizeof(m_spill_path.s), "/config/BBI/spill_%u.bin", g_spill_index++ % MAX_SPILL_FILES);
+        m_spill_file = std::fopen(m_spill_path, "w+b");
+        if (m_spill_file) {
+            m_spill_enabled = true;
+        } else {
+            log_write("[InstallStream] Failed to open spill file: %s\n", m_spill_path.s);
+        }
+    }
+
+    log_write("[InstallStream] Created for: %s queue depth: %u spill limit: %zu MiB\n", path.s, m_queue_depth, m_spill_enabled ? m_spill_limit / 1024 / 1024 : 0);
 }
 
 InstallStream::~InstallStream() {
-    log_write("[InstallStream] Destroyed: %s\n", m_path.s);
+    while (m_queue_count) {
+        PopChunk();
+    }
+    m_fill.Release();
+    if (m_reserved) {
+        yati::pool::Unreserve(m_queue_depth + 1);
+    }
+    SpillClose();
+
+    const auto copies = m_pushed_bytes + m_copied_bytes;
+    log_write("[InstallStream] Destroyed: %s pushed: %zu copied: %zu handed over: %zu spilled: %zu copies per byte: %zu / 1000\n",
+        m_path.s, m_pushed_bytes, m_copied_bytes, m_handed_bytes, m_spilled_bytes, m_pushed_bytes ? copies * 1000 / m_pushed_bytes : 0);
+}
+
+auto InstallStream::GetStats() -> Stats {
+    SCOPED_MUTEX(&m_mutex);
+    return {m_pushed_bytes, m_copied_bytes, m_handed_bytes, m_spilled_bytes};
+}
+
+void InstallStream::SpillClose() {
+    if (m_spill_file) {
+        std::fclose(m_spill_file);
+        m_spill_file = nullptr;
+        std::remove(m_spill_path);
+    }
 }
 
 Result InstallStream::ReadChunk(void* buf, s64 size, u64* bytes_read) {
-    log_write("[InstallStream::ReadChunk] Request size=%lld\n", (long long)size);
+    return Consume(buf, size, bytes_read);
+}
+
+Result InstallStream::SkipChunk(s64 size, u64* bytes_skipped) {
+    return Consume(nullptr, size, bytes_skipped);
+}
 
-    u32 wait_count = 0;
-    constexpr u32 MAX_WAIT_COUNT = 30;  // 最多等待 30 秒
+Result InstallStream::WaitReadable(bool& eof) {
+    eof = false;
 
+    // 空闲计时只在等待数据时开始，处理数据的时间不计入
+    const auto start = armGetSystemTick();
     while (true) {
-        {
-            SCOPED_MUTEX(&m_mutex);
+        // 已取消，立即返回
+        R_UNLESS(!m_cancelled, Result_TransferCancelled);
 
-            // 如果缓冲区为空且流还活跃，等待数据（带超时）
-            if (m_active && m_buffer.empty()) {
-                log_write("[InstallStream::ReadChunk] Buffer empty, waiting...\n");
-                
-                // 等待最多 1 秒
-                const u64 timeout = armNsToTicks(1e9);  // 1 秒
-                Result wait_rc = condvarWaitTimeout(&m_can_read, &m_mutex, timeout);
-                
-                if (R_FAILED(wait_rc)) {
-                    // 超时
-                    wait_count++;
-                    if (wait_count >= MAX_WAIT_COUNT) {
-                        // 超过 30 秒没有数据，认为传输已被取消
-                        log_write("[InstallStream::ReadChunk] Timeout after %u seconds, aborting\n", MAX_WAIT_COUNT);
-                        m_active = false;  // 标记为非活跃
-                        *bytes_read = 0;
-                        R_THROW(0xBB10);  // 自定义错误码：传输超时
-                    }
-                    continue;  // 继续等待
-                }
-                
-                // 成功收到信号，重置计数
-                wait_count = 0;
-            }
+        if (m_queue_count) {
+            R_SUCCEED();
+        }
+
+        // 内存队列已读完，按顺序从 spill 文件读回
+        if (SpillPending()) {
+            R_TRY(SpillRead());
+            continue;
+        }
 
-            // 如果流已关闭且缓冲区为空，返回 EOF
-            if (!m_active && m_buffer.empty()) {
-                *bytes_read = 0;
-                log_write("[InstallStream::ReadChunk] EOF reached\n");
-                R_SUCCEED();
+        // 如果流已关闭且队列为空，返回 EOF
+        if (!m_active) {
+            log_debug("[InstallStream::WaitReadable] EOF reached\n");
+            eof = true;
+            R_SUCCEED();
+        }
+
+        const auto elapsed = armTicksToNs(armGetSystemTick() - start);
+        if (elapsed >= IDLE_TIMEOUT_NS) {
+            // 长时间没有数据，认为传输已被中断
+            log_write("[InstallStream::WaitReadable] No data for %llu seconds, aborting\n", IDLE_TIMEOUT_NS / 1000000000ULL);
+            m_active = false;
+            if (m_writer_waiting) {
+                condvarWakeOne(&m_can_write);
             }
+            R_THROW(Result_StreamIdleTimeout);
+        }
 
-            // 从缓冲区读取数据
-            if (!m_buffer.empty()) {
-                const s64 read_size = std::min<s64>(size, m_buffer.size());
-                std::memcpy(buf, m_buffer.data(), read_size);
-                m_buffer.erase(m_buffer.begin(), m_buffer.begin() + read_size);
-                *bytes_read = read_size;
+        m_reader_waiting = true;
+        condvarWaitTimeout(&m_can_read, &m_mutex, IDLE_TIMEOUT_NS - elapsed);
+        m_reader_waiting = false;
+    }
+}
 
-                log_write("[InstallStream::ReadChunk] Read %lld bytes, buffer left=%zu\n",
-                    (long long)read_size, m_buffer.size());
+void InstallStream::QueueFillChunk() {
+    auto& chunk = m_queue[(m_queue_head + m_queue_count) % m_queue_depth];
+    chunk.buf = std::move(m_fill);
+    chunk.start = 0;
+    m_queue_count++;
 
-                // 通知写端可以继续写
-                condvarWakeOne(&m_can_write);
-                R_SUCCEED();
+    // 通知读端有数据了
+    if (m_reader_waiting) {
+        condvarWakeOne(&m_can_read);
+    }
+}
+
+bool InstallStream::FlushFillChunk() {
+    // 内存队列满，或已有数据在 spill 文件中时（保持顺序），写入 spill 文件
+    if (m_spill_enabled && (SpillPending() || m_queue_count == m_queue_depth)) {
+        if (const auto rc = SpillWrite(); R_SUCCEEDED(rc)) {
+            if (!m_active) {
+                m_fill.Release();
+                return false;
             }
+            return true;
+        } else {
+            // 例如 SD 卡已满，之后改为等待读端，已写入文件的数据仍会按顺序读完
+            log_write("[InstallStream] Spill write failed: 0x%x, disabling spill\n", rc);
+            m_spill_enabled = false;
+        }
+    }
+
+    // 如果队列满，等待读端取走数据
+    while (m_active && (SpillPending() || m_queue_count == m_queue_depth)) {
+        m_writer_waiting = true;
+        condvarWait(&m_can_write, &m_mutex);
+        m_writer_waiting = false;
+    }
+
+    if (!m_active) {
+        m_fill.Release();
+        return false;
+    }
+
+    QueueFillChunk();
+    return true;
+}
+
+Result InstallStream::SpillWrite() {
+    // 超过高水位时等待读端消耗到低水位以下
+    if (SpillPending() >= m_spill_high_watermark) {
+        log_write("[InstallStream] Spill file at high watermark, waiting\n");
+        while (m_active && SpillPending() > m_spill_low_watermark) {
+            m_writer_waiting = true;
+            condvarWait(&m_can_write, &m_mutex);
+            m_writer_waiting = false;
+        }
+    }
+
+    // 文件写到上限时，等待读端读完后从头复用，文件不会超过 m_spill_limit
+    if (m_spill_write_off + m_fill.size() > m_spill_limit) {
+        while (m_active && SpillPending()) {
+            m_writer_waiting = true;
+            condvarWait(&m_can_write, &m_mutex);
+            m_writer_waiting = false;
+        }
+    }
+
+    if (!m_active) {
+        R_SUCCEED();
+    }
+
+    // 文件中的数据已全部读完，从头复用
+    if (!SpillPending()) {
+        m_spill_write_off = m_spill_read_off = 0;
+    }
+
+    const auto off = m_spill_write_off;
+    const auto size = m_fill.size();
+
+    // 读端只读取 [read_off, write_off) 的数据，在 m_mutex 外写入文件
+    Result rc{};
+    mutexUnlock(&m_mutex);
+    {
+        SCOPED_MUTEX(&m_spill_mutex);
+        if (std::fseek(m_spill_file, off, SEEK_SET) || std::fwrite(m_fill.data(), 1, size, m_spill_file) != size) {
+            rc = Result_FsUnknownStdioError;
+        }
+    }
+    mutexLock(&m_mutex);
+    R_TRY(rc);
+
+    m_spill_write_off += size;
+    m_spilled_bytes += size;
+    // 缓冲区直接用于下一块
+    m_fill.clear();
+
+    // 通知读端有数据了
+    if (m_reader_waiting) {
+        condvarWakeOne(&m_can_read);
+    }
+
+    R_SUCCEED();
+}
+
+Result InstallStream::SpillRead() {
+    const auto off = m_spill_read_off;
+    const auto size = std::min<u64>(SpillPending(), CHUNK_SIZE);
+
+    // 在 m_mutex 外读取文件，写端只会追加到 write_off 之后
+    yati::PooledBuffer buf;
+    mutexUnlock(&m_mutex);
+    auto rc = yati::pool::Acquire(buf);
+    if (R_SUCCEEDED(rc)) {
+        SCOPED_MUTEX(&m_spill_mutex);
+        buf.resize(size);
+        if (std::fseek(m_spill_file, off, SEEK_SET) || std::fread(buf.data(), 1, size, m_spill_file) != size) {
+            rc = Result_FsUnknownStdioError;
         }
+    }
+    mutexLock(&m_mutex);
+    R_TRY(rc);
+
+    // 有数据在 spill 文件中时写端不会放入内存队列，读回的数据放在队列尾部即可
+    auto& chunk = m_queue[(m_queue_head + m_queue_count) % m_queue_depth];
+    chunk.buf = std::move(buf);
+    chunk.start = 0;
+    m_queue_count++;
+    m_spill_read_off += size;
+
+    // 通知写端 spill 文件已低于水位
+    if (m_writer_waiting) {
+        condvarWakeOne(&m_can_write);
+    }
+
+    R_SUCCEED();
+}
+
+void InstallStream::PopChunk() {
+    auto& chunk = Front();
+    chunk.buf.Release();
+    chunk.start = 0;
+    m_queue_head = (m_queue_head + 1) % m_queue_depth;
+    m_queue_count--;
 
-        // 防止忙等
-        svcSleepThread(1e6);  // 1ms
+    // 通知写端可以继续写
+    if (m_writer_waiting) {
+        condvarWakeOne(&m_can_write);
     }
 }
 
+Result InstallStream::TakeChunk(yati::PooledBuffer& out, s64 size) {
+    out.Release();
+
+    SCOPED_MUTEX(&m_mutex);
+
+    bool eof;
+    R_TRY(WaitReadable(eof));
+    if (eof) {
+        R_SUCCEED();
+    }
+
+    // 只交出完整且不超过请求大小的块，其余情况由 ReadChunk() 拷贝
+    auto& chunk = Front();
+    if (chunk.start || chunk.buf.size() > static_cast<u64>(size)) {
+        R_SUCCEED();
+    }
+
+    out = std::move(chunk.buf);
+    m_handed_bytes += out.size();
+    PopChunk();
+    R_SUCCEED();
+}
+
+Result InstallStream::Consume(void* buf, s64 size, u64* bytes_read) {
+    *bytes_read = 0;
+
+    Chunk* chunk;
+    u64 available;
+    {
+        SCOPED_MUTEX(&m_mutex);
+
+        bool eof;
+        R_TRY(WaitReadable(eof));
+        if (eof) {
+            R_SUCCEED();
+        }
+
+        chunk = &Front();
+        available = std::min<u64>(size, chunk->buf.size() - chunk->start);
+    }
+
+    // 读端拥有队列头部的块，写端只会向队列尾部添加，在锁外拷贝
+    if (buf) {
+        std::memcpy(buf, chunk->buf.data() + chunk->start, available);
+    }
+
+    {
+        SCOPED_MUTEX(&m_mutex);
+        if (buf) {
+            m_copied_bytes += available;
+        }
+
+        chunk->start += available;
+        if (chunk->start == chunk->buf.size()) {
+            PopChunk();
+        }
+    }
+
+    *bytes_read = available;
+    R_SUCCEED();
+}
+
 bool InstallStream::Push(const void* buf, s64 size) {
-    log_write("[InstallStream::Push] size=%lld\n", (long long)size);
+    auto src = static_cast<const u8*>(buf);
 
-    while (true) {
+    while (size > 0) {
+        if (!m_fill.IsValid()) {
+            if (R_FAILED(yati::pool::Acquire(m_fill))) {
+                log_write("[InstallStream::Push] Failed to acquire buffer\n");
+                return false;
+            }
+        }
+
+        const auto offset = m_fill.size();
+        const auto span = std::min<u64>(size, CHUNK_SIZE - offset);
         {
             SCOPED_MUTEX(&m_mutex);
 
             // 先检查流是否还活跃
             if (!m_active) {
-                // Stream 已关闭（安装完成），但仍返回 true 让 MTP 认为传输成功
+                // Stream 已关闭（安装完成或取消），但仍返回 true 让 MTP 认为传输成功
                 // 这样 Windows 才会继续传输下一个文件
-                log_write("[InstallStream::Push] Stream not active, discarding data\n");
-                return true;  // 返回 true，不中断 MTP 传输
+                m_fill.Release();
+                return true;
             }
+        }
 
-            // 如果缓冲区满，等待空间（带超时检查）
-            if (m_buffer.size() >= MAX_BUFFER_SIZE) {
-                // log_write("[InstallStream::Push] Buffer full, waiting...\n");  // 减少日志噪音
-                
-                // 等待最多 1 秒
-                const u64 timeout = armNsToTicks(1e9);  // 1 秒
-                Result wait_rc = condvarWaitTimeout(&m_can_write, &m_mutex, timeout);
-                
-                // 超时或等待失败后再次检查 active 状态
-                if (!m_active) {
-                    log_write("[InstallStream::Push] Stream became inactive during wait\n");
-                    return true;  // 返回 true，让 Windows 继续下一个文件
-                }
-                
-                // 如果等待超时，继续循环（可能安装线程还在工作）
-                if (R_FAILED(wait_rc)) {
-                    // log_write("[InstallStream::Push] Wait timeout, retrying...\n");  // 减少日志噪音
-                    continue;
-                }
-            }
+        // m_fill 只属于写端，在锁外拷贝
+        m_fill.resize(offset + span);
+        std::memcpy(m_fill.data() + offset, src, span);
+        src += span;
+        size -= span;
 
-            // 再次确认流还活跃
-            if (!m_active) {
-                log_write("[InstallStream::Push] Stream not active after wait\n");
-                return true;  // 返回 true，让 Windows 继续下一个文件
+        SCOPED_MUTEX(&m_mutex);
+        m_pushed_bytes += span;
+
+        // 写满一块，或读端正在等待数据时，放入队列
+        if (m_fill.size() == CHUNK_SIZE || (m_reader_waiting && !m_queue_count)) {
+            if (!FlushFillChunk()) {
+                return true;
             }
+        }
+    }
 
-            // 写入缓冲区
-            const auto offset = m_buffer.size();
-            m_buffer.resize(offset + size);
-            std::memcpy(m_buffer.data() + offset, buf, size);
+    return true;
+}
 
-            log_write("[InstallStream::Push] Pushed %lld bytes, buffer=%zu\n",
-                (long long)size, m_buffer.size());
+void InstallStream::SignalCancel() {
+    log_write("[InstallStream::SignalCancel] Cancelling stream: %s\n", m_path.s);
 
-            // 通知读端有数据了
-            condvarWakeOne(&m_can_read);
-            return true;
+    SCOPED_MUTEX(&m_mutex);
+    m_cancelled = true;
+    m_active = false;
+
+    // 唤醒所有等待的线程，读端返回取消，写端丢弃数据
+    condvarWakeAll(&m_can_read);
+    condvarWakeAll(&m_can_write);
+}
+
+void InstallStream::Close() {
+    log_write("[InstallStream::Close] End of data: %s\n", m_path.s);
+
+    {
+        SCOPED_MUTEX(&m_mutex);
+
+        // 把最后不满一块的数据交给读端
+        if (!m_fill.empty()) {
+            FlushFillChunk();
         }
     }
+
+    Disable();
 }
 
 void InstallStream::Disable() {
@@ -148,8 +416,8 @@ void InstallStream::Disable() {
     m_active = false;
 
     // 唤醒所有等待的线程
-    condvarWakeOne(&m_can_read);
-    condvarWakeOne(&m_can_write);
+    condvarWakeAll(&m_can_read);
+    condvarWakeAll(&m_can_write);
 }
 
 } // namespace sphaira::mtp
@@ -1,44 +1,166 @@
 #pragma once
 
 #include "yati/source/stream.hpp"
+#include "yati/buffer_pool.hpp"
 #include "fs.hpp"
-#include <vector>
+#include <algorithm>
 #include <atomic>
+#include <cstdio>
 #include <switch.h>
 
 namespace sphaira::mtp {
 
 // InstallStream: 流式数据源，用于 MTP Install
 // 继承 yati::source::Stream，实现 ReadChunk 接口
-// MTP WriteFile 通过 Push() 推送数据，yati 通过 ReadChunk() 读取数据
+// MTP WriteFile 通过 Push() 推送数据，yati 通过 ReadChunk() / TakeChunk() 读取数据
+//
+// Notes:
+// - Push() 把数据拷贝进缓冲池的缓冲区（唯一一次拷贝），写满一块后放入固定长度的队列。
+// - yati 读线程通过 TakeChunk() 直接取走整块缓冲区，不再拷贝。
+//   只有 nca / ncz 头部以及跨 nca 边界的块才会通过 ReadChunk() 拷贝。
+// - 只有一个写端 (MTP) 和一个读端 (yati)，拷贝在锁外进行，锁只用于更新队列。
+// - 只在对端正在等待时才唤醒，没有轮询和睡眠。
+// - 取消（MTP 会话关闭、退出）通过 SignalCancel() 立即唤醒读写两端，不依赖超时。
+// - 读端等待数据的时间超过 IDLE_TIMEOUT_NS 时认为传输已中断。这只用于对端消失却没有
+//   关闭会话的情况，USB 主机正常传输时也可能停顿数秒（PC 端读盘、杀毒扫描等），
+//   超时过短会把正常的停顿当作中断，所以保留 30 秒。
+// - 开启 spill 后，内存队列满时写端不再等待，而是把块追加到 SD 卡上的临时文件，
+//   读端读完内存队列后按顺序从文件读回，这样安装较慢时 USB 仍能全速传输。
+//   文件中未读的数据超过高水位时写端等待，直到读端消耗到低水位以下。
+//   文件大小不超过创建时给定的上限，写到上限时等待读端读完，然后从头复用，stream 销毁时删除。
 class InstallStream final : public sphaira::yati::source::Stream {
 public:
-    InstallStream(const fs::FsPath& path);
+    // 每块的大小，与 yati 的读缓冲区大小一致
+    static constexpr u64 CHUNK_SIZE = 1024ULL * 1024ULL * 4ULL;  // 4MB
+    // 队列中默认最多等待读取的块数（另有一块正在被 MTP 写入）
+    static constexpr u32 QUEUE_DEPTH = 2;
+    static constexpr u32 MAX_QUEUE_DEPTH = 8;
+    // spill 文件中未读数据的高 / 低水位
+    static constexpr u64 SPILL_HIGH_WATERMARK = 1024ULL * 1024ULL * 1024ULL * 2ULL;  // 2GB
+    static constexpr u64 SPILL_LOW_WATERMARK = 1024ULL * 1024ULL * 1024ULL * 1ULL;  // 1GB
+    // 读端最长等待新数据的时间，只是对端无响应时的兜底，取消不受它影响
+    static constexpr u64 IDLE_TIMEOUT_NS = 30ULL * 1000ULL * 1000ULL * 1000ULL;  // 30 秒
+
+    static_assert(CHUNK_SIZE <= yati::pool::BUFFER_SIZE);
+
+    // queue_depth 决定内存中最多缓冲多少数据，范围 1 - MAX_QUEUE_DEPTH
+    // spill_limit 不为 0 时，内存队列满后的数据写入 SD 卡上的临时文件，文件最大为 spill_limit
+    // 构造时不等待缓冲池，预留失败时 IsReserved() 返回 false，此时 stream 不可使用
+    InstallStream(const fs::FsPath& path, u32 queue_depth = QUEUE_DEPTH, u64 spill_limit = 0);
     ~InstallStream();
 
-    // yati::source::Stream 接口：读取一块数据（不带 offset）
+    // yati::source::Stream 接口：读取一块数据（不带 offset），需要拷贝
     Result ReadChunk(void* buf, s64 size, u64* bytes_read) override;
 
-    // MTP WriteFile 调用：推送数据到缓冲区
+    // yati::source::Stream 接口：向前跳过数据，直接从缓冲区丢弃，无需拷贝
+    Result SkipChunk(s64 size, u64* bytes_skipped) override;
+
+    // yati::source::Stream 接口：取走队列头部的整块缓冲区，无需拷贝
+    Result TakeChunk(yati::PooledBuffer& out, s64 size) override;
+
+    // yati::source::Base 接口：取消传输，唤醒所有等待的线程，之后的读取立即失败
+    void SignalCancel() override;
+
+    // MTP WriteFile 调用：推送数据到缓冲区，队列满时等待读端
     bool Push(const void* buf, s64 size);
 
-    // MTP CloseFile 调用：标记数据流结束
+    // MTP CloseFile 调用：交出最后不满一块的数据，然后标记数据流结束
+    void Close();
+
+    // 标记数据流结束，之后推送的数据直接丢弃（安装线程结束时调用）
     void Disable();
 
     // 获取文件路径
     auto& GetPath() const { return m_path; }
 
+    // spill 文件路径，未开启 spill 时为空
+    auto& GetSpillPath() const { return m_spill_path; }
+
+    // 拷贝统计
+    struct Stats {
+        u64 pushed{};
+        u64 copied{};
+        u64 handed{};
+        u64 spilled{};
+    };
+    auto GetStats() -> Stats;
+
+    // 是否已从缓冲池预留到队列所需的缓冲区
+    auto IsReserved() const -> bool { return m_reserved; }
+
     // 公开 mutex 和 active 标志（供外部等待/检查）
     Mutex m_mutex{};
     std::atomic_bool m_active{true};
+    std::atomic_bool m_cancelled{false};
 
 private:
+    struct Chunk {
+        yati::PooledBuffer buf{};
+        // 已被读取的字节数
+        u64 start{};
+    };
+
+    // 从队列头部取出数据，buf 为空时直接丢弃
+    Result Consume(void* buf, s64 size, u64* bytes_read);
+
+    // 等待队列中有数据，流已结束时 eof 为 true，调用时必须持有 m_mutex
+    Result WaitReadable(bool& eof);
+
+    // 把写满的块放入队列或 spill 文件，流已关闭时返回 false，调用时必须持有 m_mutex
+    bool FlushFillChunk();
+
+    // 把正在写入的块放入队列，调用时必须持有 m_mutex
+    void QueueFillChunk();
+
+    // 把正在写入的块追加到 spill 文件，调用时必须持有 m_mutex（期间会暂时释放）
+    Result SpillWrite();
+
+    // 从 spill 文件读回一块放入队列，调用时必须持有 m_mutex（期间会暂时释放）
+    Result SpillRead();
+
+    void SpillClose();
+
+    // spill 文件中未读的数据量
+    auto SpillPending() const -> u64 {
+        return m_spill_write_off - m_spill_read_off;
+    }
+
+    // 移除队列头部的块，调用时必须持有 m_mutex
+    void PopChunk();
+
+    auto Front() -> Chunk& {
+        return m_queue[m_queue_head];
+    }
+
     fs::FsPath m_path{};
-    std::vector<u8> m_buffer{};
-    CondVar m_can_read{};   // 通知 yati: 缓冲区有数据可读
-    CondVar m_can_write{};  // 通知 MTP: 缓冲区有空间可写
+    Chunk m_queue[MAX_QUEUE_DEPTH]{};
+    u32 m_queue_depth{};
+    bool m_reserved{};
+    u32 m_queue_head{};
+    u32 m_queue_count{};
+    // MTP 正在写入的块，只有写端访问
+    yati::PooledBuffer m_fill{};
+    bool m_reader_waiting{};  // 读端正在等待数据
+    bool m_writer_waiting{};  // 写端正在等待空间
+    CondVar m_can_read{};   // 通知 yati: 队列有数据可读
+    CondVar m_can_write{};  // 通知 MTP: 队列有空间可写
+
+    // spill 文件，读写位置由 m_mutex 保护，文件读写由 m_spill_mutex 保护
+    Mutex m_spill_mutex{};
+    std::FILE* m_spill_file{};
+    fs::FsPath m_spill_path{};
+    bool m_spill_enabled{};  // 写入失败后关闭，已写入的数据仍会读完
+    u64 m_spill_limit{};  // spill 文件的最大大小
+    u64 m_spill_high_watermark{};
+    u64 m_spill_low_watermark{};
+    u64 m_spill_write_off{};
+    u64 m_spill_read_off{};
 
-    static constexpr u64 MAX_BUFFER_SIZE = 1024ULL * 1024ULL * 8ULL;  // 8MB
+    // 拷贝统计，用于确认每字节最多拷贝一次
+    u64 m_pushed_bytes{};  // Push() 拷贝进缓冲区的字节数
+    u64 m_copied_bytes{};  // ReadChunk() 再次拷贝出去的字节数
+    u64 m_handed_bytes{};  // TakeChunk() 直接交给 yati 的字节数
+    u64 m_spilled_bytes{};  // 经过 spill 文件中转的字节数
 };
 
 } // namespace sphaira::mtp
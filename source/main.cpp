@@ -3,6 +3,7 @@
 #include <cstdlib>
 #include <cstring>
 #include <cstdarg>
+#include <atomic>
 #include <vector>
 
 #include "haze.h"
@@ -17,6 +18,8 @@ namespace {
 
 Mutex g_mutex;
 std::vector<haze::CallbackData> g_callback_data;
+// 每个 CloseSession 事件关闭的会话编号，与 g_callback_data 中的 CloseSession 按顺序一一对应
+std::vector<u32> g_closed_sessions;
 
 // 进度跟踪
 struct ProgressTracker {
@@ -48,34 +51,427 @@ struct ProgressTracker {
     }
 } g_progress_tracker;
 
-// 全局安装上下文
-struct InstallContext {
-    Mutex mutex;
-    std::unique_ptr<sphaira::mtp::InstallStream> stream;
-    Thread install_thread;
-    std::atomic<bool> in_progress{false};
-    std::atomic<Result> install_result{0};
-} g_install_ctx;
+// 安装线程及流水线各阶段的核心 / 优先级布局
+// haze 的 usb 线程运行在核心 2 上，可换成 TwoCore 等预设避开它
+const auto g_scheduling = sphaira::yati::GetSchedulingPolicy(sphaira::yati::SchedulingPreset_Pinned);
 
+// 安装结果等摘要日志，与 log_write 写入同一个日志文件（由后台线程批量写入）
 void BbiLog(const char* fmt, ...) {
-    static bool init = false;
-    if (!init) {
-        fs::CreateDirectoryRecursively("/config/BBI");
-        init = true;
+    std::va_list v;
+    va_start(v, fmt);
+    log_write_arg(fmt, &v);
+    va_end(v);
+}
+
+// MTP 安装队列
+// 每个写入的文件对应表中的一个任务，由同一个安装线程按打开顺序依次安装。
+// 打开文件时不再等待上一个安装结束，新文件的 stream 立即开始缓冲（最多 PREFETCH_MEMORY_CAP），
+// 这样上一个游戏在提交数据库、推送记录、导入 ticket 时，USB 仍在传输下一个文件。
+struct InstallQueue {
+    // 每个文件的 stream 最多缓冲的数据量
+    static constexpr u64 PREFETCH_MEMORY_CAP = 1024ULL * 1024ULL * 16ULL;  // 16MB
+    static constexpr u32 STREAM_QUEUE_DEPTH = PREFETCH_MEMORY_CAP / sphaira::mtp::InstallStream::CHUNK_SIZE;
+    // 同时未完成的任务数上限（一个正在安装，一个正在缓冲）
+    static constexpr u32 MAX_ACTIVE_JOBS = 2;
+    // spill 时 SD 卡上为其它写入保留的空间
+    static constexpr u64 SPILL_FREE_SPACE_RESERVE = 1024ULL * 1024ULL * 1024ULL;  // 1GB
+    // 缓冲池不足时，打开文件最多等待其它任务释放缓冲区的时间
+    static constexpr u64 RESERVE_TIMEOUT_NS = 5ULL * 1000ULL * 1000ULL * 1000ULL;  // 5 秒
+    static constexpr u64 RESERVE_RETRY_NS = 100ULL * 1000ULL * 1000ULL;  // 100 毫秒
+    // 任务已满时，打开文件最多等待最早的任务结束的时间，超时返回 Result_StreamQueueBusy，
+    // 不让 MTP 线程无限期阻塞
+    static constexpr u64 OPEN_WAIT_TIMEOUT_NS = 30ULL * 1000ULL * 1000ULL * 1000ULL;  // 30 秒
+
+    enum class State {
+        Queued,      // 等待安装线程
+        Installing,  // 正在安装
+        Done,        // 安装结束，结果见 result
+    };
+
+    struct Job {
+        u32 object_id{};
+        fs::FsPath path{};
+        // MTP 线程推送 / 关闭时持有副本，job 释放后 stream 仍有效，直到副本也被释放
+        std::shared_ptr<sphaira::mtp::InstallStream> stream{};
+        u32 session{};  // 打开文件时的 MTP 会话
+        State state{State::Queued};
+        Result result{};
+        bool closed{};    // MTP 已关闭文件，不会再推送数据
+        bool reported{};  // 结果已显示
+        Result cancelled{};  // 取消原因，不为 0 时安装线程开始安装时立即退出
+        bool sd_card_install{};  // 打开文件时的安装位置
+        // 正在安装时的进度框，用于取消安装，由安装线程设置 / 清除
+        sphaira::ui::ProgressBox* pbox{};
+    };
+
+    // 运行时设置，只影响之后打开的文件
+    // 安装位置：SD 卡（默认）或 NAND
+    void SetSdCardInstall(bool enable) { m_sd_card_install = enable; }
+    auto IsSdCardInstall() const -> bool { return m_sd_card_install; }
+
+    // 安装慢于 USB 时，把超出内存缓冲的数据暂存到 SD 卡，避免 MTP 传输停顿超时（默认关闭）
+    // 安装到 SD 卡时不使用，避免 spill 与安装同时写 SD 卡
+    void SetSpillToSd(bool enable) { m_spill_to_sd = enable; }
+    auto IsSpillToSd() const -> bool { return m_spill_to_sd; }
+
+    Result Start() {
+        mutexInit(&m_mutex);
+        condvarInit(&m_can_install);
+        condvarInit(&m_job_done);
+        m_running = true;
+
+        // 安装线程（核心 / 优先级由调度策略决定）
+        R_TRY(threadCreate(&m_thread, WorkerFunc, this, nullptr, 1024*128,
+                           g_scheduling.install.priority, sphaira::yati::GetPreferredCore(g_scheduling.install)));
+
+        // 限制线程可运行的核心
+        if (R_FAILED(sphaira::yati::ApplyPlacement(m_thread.handle, g_scheduling.install))) {
+            log_write("[InstallQueue] Failed to apply install thread placement\n");
+        }
+
+        if (const auto rc = threadStart(&m_thread); R_FAILED(rc)) {
+            threadClose(&m_thread);
+            m_running = false;
+            return rc;
+        }
+
+        m_started = true;
+        R_SUCCEED();
     }
 
-    std::FILE* f = std::fopen("/config/BBI/log.txt", "a");
-    if (!f) {
-        return;
+    void Stop() {
+        if (!m_started) {
+            return;
+        }
+
+        {
+            SCOPED_MUTEX(&m_mutex);
+            m_running = false;
+
+            // 取消所有任务，让安装线程立即停止（而不是当作传输结束）
+            // 用户主动退出，安装不会再继续，placeholder 和 journal 一并删除
+            for (auto& job : m_jobs) {
+                Cancel(*job, Result_TransferCancelled);
+            }
+
+            condvarWakeAll(&m_can_install);
+            condvarWakeAll(&m_job_done);
+        }
+
+        threadWaitForExit(&m_thread);
+        threadClose(&m_thread);
+        m_started = false;
     }
 
-    std::va_list v;
-    va_start(v, fmt);
-    std::vfprintf(f, fmt, v);
-    va_end(v);
+    // haze 线程在会话开始时调用，之后打开的文件属于新会话
+    void OpenSession() {
+        SCOPED_MUTEX(&m_mutex);
+        m_session++;
+    }
 
-    std::fclose(f);
-}
+    auto GetSession() -> u32 {
+        SCOPED_MUTEX(&m_mutex);
+        return m_session;
+    }
+
+    // MTP OpenFile：添加任务，stream 立即开始缓冲
+    Result Open(u32 object_id, const fs::FsPath& path) {
+        u32 session;
+        {
+            SCOPED_MUTEX(&m_mutex);
+            // 等待期间会话可能已经关闭，任务属于打开文件时的会话
+            session = m_session;
+
+            // 未完成的任务太多时，等待最早的任务结束
+            const auto start = armGetSystemTick();
+            while (m_running && GetActiveCount() >= MAX_ACTIVE_JOBS) {
+                const auto elapsed = armTicksToNs(armGetSystemTick() - start);
+                if (elapsed >= OPEN_WAIT_TIMEOUT_NS) {
+                    log_write("[InstallQueue] Still busy after %llu seconds, rejecting: %s\n", OPEN_WAIT_TIMEOUT_NS / 1000000000ULL, path.s);
+                    BbiLog("[Install] Queue busy, rejected: %s\n", path.s);
+                    R_THROW(Result_StreamQueueBusy);
+                }
+
+                log_write("[InstallQueue] Waiting for a previous install...\n");
+                condvarWaitTimeout(&m_job_done, &m_mutex, OPEN_WAIT_TIMEOUT_NS - elapsed);
+            }
+
+            R_UNLESS(m_running, Result_TransferCancelled);
+        }
+
+        // 在锁外创建 stream，缓冲池不足时不阻塞 MTP 回调，
+        // 而是每隔 RESERVE_RETRY_NS 重试一次，超过 RESERVE_TIMEOUT_NS 仍失败则放弃
+        auto job = std::make_unique<Job>();
+        job->object_id = object_id;
+        job->session = session;
+        job->path = path;
+        job->sd_card_install = m_sd_card_install;
+        const auto spill_limit = GetSpillLimit(job->sd_card_install);
+
+        const auto start = armGetSystemTick();
+        while (true) {
+            job->stream = std::make_shared<sphaira::mtp::InstallStream>(path, STREAM_QUEUE_DEPTH, spill_limit);
+            if (job->stream->IsReserved()) {
+                break;
+            }
+            job->stream.reset();
+
+            SCOPED_MUTEX(&m_mutex);
+            R_UNLESS(m_running, Result_TransferCancelled);
+            R_UNLESS(armTicksToNs(armGetSystemTick() - start) < RESERVE_TIMEOUT_NS, Result_YatiBufferPoolOutOfMemory);
+            condvarWaitTimeout(&m_job_done, &m_mutex, RESERVE_RETRY_NS);
+        }
+
+        SCOPED_MUTEX(&m_mutex);
+        log_write("[InstallQueue] Queued: %s (pending: %zu)\n", path.s, m_jobs.size() - m_next);
+        m_jobs.emplace_back(std::move(job));
+        condvarWakeOne(&m_can_install);
+        R_SUCCEED();
+    }
+
+    // MTP WriteFile：推送数据到对应任务的 stream
+    Result Push(u32 object_id, const void* buf, s64 size) {
+        std::shared_ptr<sphaira::mtp::InstallStream> stream;
+        {
+            SCOPED_MUTEX(&m_mutex);
+            auto job = Find(object_id);
+            R_UNLESS(job && job->stream, FsError_PathNotFound);
+            stream = job->stream;
+        }
+
+        // 持有副本，会话关闭 / 安装结束时释放 job 的 stream 也不影响，在锁外推送
+        R_UNLESS(stream->Push(buf, size), FsError_NotImplemented);
+        R_SUCCEED();
+    }
+
+    // MTP CloseFile：标记数据结束，不等待安装完成
+    void Close(u32 object_id, s64 final_size) {
+        std::shared_ptr<sphaira::mtp::InstallStream> stream;
+        {
+            SCOPED_MUTEX(&m_mutex);
+            auto job = Find(object_id);
+            if (!job || !job->stream) {
+                return;
+            }
+            stream = job->stream;
+        }
+
+        log_write("[InstallQueue] Closing: %s size=%lld\n", stream->GetPath().s, (long long)final_size);
+        BbiLog("[Install] CloseFile size=%lld bytes\n", (long long)final_size);
+        stream->Close();
+
+        // 标记关闭后安装线程可以释放 job 的 stream，本地副本在返回时释放
+        SCOPED_MUTEX(&m_mutex);
+        if (auto job = Find(object_id)) {
+            job->closed = true;
+            ReleaseStream(*job);
+        }
+    }
+
+    // MTP 会话关闭：取消该会话中还未关闭的文件，它们不会再收到数据
+    // 已关闭的文件数据已完整，继续安装
+    // 关闭事件由主线程稍后处理，此时新会话可能已经打开了文件，所以只取消 session 的任务
+    void CancelSession(u32 session) {
+        SCOPED_MUTEX(&m_mutex);
+        for (auto& job : m_jobs) {
+            if (job->session == session && !job->closed) {
+                log_write("[InstallQueue] Session closed, cancelling: %s\n", job->path.s);
+                // 可能只是连接中断，保留 placeholder 和 journal，重新发送同一文件时继续安装
+                Cancel(*job, Result_StreamSessionClosed);
+                job->closed = true;
+                ReleaseStream(*job);
+            }
+        }
+    }
+
+    // 主线程调用：显示新完成的任务结果，然后移除已结束、已关闭且已显示的任务
+    void ReportFinished() {
+        SCOPED_MUTEX(&m_mutex);
+        for (auto& job : m_jobs) {
+            if (job->state == State::Done && !job->reported) {
+                job->reported = true;
+                if (R_SUCCEEDED(job->result)) {
+                    std::printf("[Install] SUCCESS: %s\n", job->path.s);
+                } else {
+                    std::printf("[Install] FAILED (0x%x): %s\n", job->result, job->path.s);
+                }
+            }
+        }
+
+        // 已结束的任务都在 m_next 之前，移除后要同步调整 m_next
+        const auto removed = std::erase_if(m_jobs, [](auto& job) {
+            return job->state == State::Done && job->closed && job->reported;
+        });
+        m_next -= removed;
+    }
+
+private:
+    // 查找 MTP 尚未关闭的任务，调用时必须持有 m_mutex
+    auto Find(u32 object_id) -> Job* {
+        for (auto it = m_jobs.rbegin(); it != m_jobs.rend(); it++) {
+            if ((*it)->object_id == object_id && !(*it)->closed) {
+                return it->get();
+            }
+        }
+        return nullptr;
+    }
+
+    // spill 文件的大小上限，不使用 spill 时返回 0
+    // 同时缓冲的任务平分 SD 卡的剩余空间（保留 SPILL_FREE_SPACE_RESERVE），空间不足时不使用
+    auto GetSpillLimit(bool sd_card_install) const -> u64 {
+        if (!m_spill_to_sd || sd_card_install) {
+            return 0;
+        }
+
+        fs::FsNativeSd fs_sd{};
+        s64 free_space{};
+        if (R_FAILED(fs_sd.GetFsOpenResult()) || R_FAILED(fs_sd.GetFreeSpace("/", &free_space))) {
+            log_write("[InstallQueue] Failed to get SD free space, not spilling\n");
+            return 0;
+        }
+
+        if (static_cast<u64>(free_space) <= SPILL_FREE_SPACE_RESERVE + sphaira::mtp::InstallStream::CHUNK_SIZE * MAX_ACTIVE_JOBS) {
+            log_write("[InstallQueue] Not enough SD free space to spill: %lld\n", (long long)free_space);
+            return 0;
+        }
+
+        return std::min((free_space - SPILL_FREE_SPACE_RESERVE) / MAX_ACTIVE_JOBS, sphaira::mtp::InstallStream::SPILL_HIGH_WATERMARK);
+    }
+
+    // 唤醒阻塞在 stream 上的读写，并让 yati 停止流水线、清理 placeholder，调用时必须持有 m_mutex
+    // reason 为 Result_TransferCancelled 时 yati 不保留可继续安装的 placeholder
+    void Cancel(Job& job, Result reason) {
+        job.cancelled = reason;
+        if (job.stream) {
+            job.stream->SignalCancel();
+        }
+        if (job.pbox) {
+            job.pbox->RequestExit(reason);
+        }
+    }
+
+    // 调用时必须持有 m_mutex
+    auto GetActiveCount() const -> u32 {
+        return std::ranges::count_if(m_jobs, [](auto& job) {
+            return job->state != State::Done;
+        });
+    }
+
+    // 文件已关闭且安装已结束时才释放 stream（及其缓冲区），调用时必须持有 m_mutex
+    void ReleaseStream(Job& job) {
+        if (job.closed && job.state == State::Done) {
+            job.stream.reset();
+        }
+    }
+
+    static void WorkerFunc(void* arg) {
+        static_cast<InstallQueue*>(arg)->Worker();
+    }
+
+    void Worker() {
+        while (true) {
+            Job* job;
+            {
+                SCOPED_MUTEX(&m_mutex);
+                while (m_running && m_next == m_jobs.size()) {
+                    condvarWait(&m_can_install, &m_mutex);
+                }
+
+                if (!m_running) {
+                    break;
+                }
+
+                job = m_jobs[m_next++].get();
+                job->state = State::Installing;
+            }
+
+            const auto rc = Install(job);
+
+            SCOPED_MUTEX(&m_mutex);
+            job->result = rc;
+            job->state = State::Done;
+            ReleaseStream(*job);
+            condvarWakeAll(&m_job_done);
+        }
+
+        // 未开始的任务标记为已取消
+        SCOPED_MUTEX(&m_mutex);
+        for (; m_next < m_jobs.size(); m_next++) {
+            auto& job = m_jobs[m_next];
+            job->result = Result_TransferCancelled;
+            job->state = State::Done;
+            ReleaseStream(*job);
+        }
+    }
+
+    Result Install(Job* job) {
+        // 持有副本，会话关闭时释放 job 的 stream 也不影响安装
+        std::shared_ptr<sphaira::mtp::InstallStream> stream;
+        {
+            SCOPED_MUTEX(&m_mutex);
+            stream = job->stream;
+        }
+        log_write("[InstallThread] Started for: %s\n", stream->GetPath().s);
+
+        // 无论成功失败都要 Disable，让 MTP 线程停止传输
+        ON_SCOPE_EXIT(stream->Disable());
+
+        fs::FsNativeSd fs_sd{};
+        if (R_FAILED(fs_sd.GetFsOpenResult())) {
+            log_write("[InstallThread] Failed to open FsNativeSd\n");
+            return fs_sd.GetFsOpenResult();
+        }
+
+        // 登记进度框，使 Cancel() 能取消安装，返回前清除
+        sphaira::ui::ProgressBox pbox;
+        {
+            SCOPED_MUTEX(&m_mutex);
+            job->pbox = &pbox;
+            if (R_FAILED(job->cancelled)) {
+                pbox.RequestExit(job->cancelled);
+            }
+        }
+        ON_SCOPE_EXIT(
+            mutexLock(&m_mutex);
+            job->pbox = nullptr;
+            mutexUnlock(&m_mutex);
+        );
+
+        sphaira::yati::ConfigOverride override{};
+        override.scheduling = g_scheduling;
+        override.sd_card_install = job->sd_card_install;
+        // 每个 stream 从缓冲池预留 STREAM_QUEUE_DEPTH + 1 块，缓冲池上限要把它们算进去
+        override.source_buffer_count = MAX_ACTIVE_JOBS * (STREAM_QUEUE_DEPTH + 1);
+
+        // 调用 yati::InstallFromSource，使用流式数据源
+        const auto rc = sphaira::yati::InstallFromSource(&pbox, stream.get(), stream->GetPath(), override);
+        if (R_SUCCEEDED(rc)) {
+            log_write("[InstallThread] SUCCESS: %s\n", stream->GetPath().s);
+            BbiLog("[Install] OK: %s\n", stream->GetPath().s);
+        } else {
+            log_write("[InstallThread] FAILED (0x%x): %s\n", rc, stream->GetPath().s);
+            BbiLog("[Install] FAILED (0x%x): %s\n", rc, stream->GetPath().s);
+        }
+
+        return rc;
+    }
+
+    Mutex m_mutex{};
+    CondVar m_can_install{};  // 通知安装线程：有新任务
+    CondVar m_job_done{};     // 通知 MTP：有任务结束
+    // 任务表，按打开顺序排列，已结束、已关闭且已显示的任务由 ReportFinished() 移除
+    // 安装线程只持有正在安装的任务的指针，其余地方每次都在锁内重新查找
+    std::vector<std::unique_ptr<Job>> m_jobs{};
+    // 安装线程下一个要处理的任务
+    size_t m_next{};
+    // 当前 MTP 会话编号，每次 OpenSession 加一
+    u32 m_session{};
+    Thread m_thread{};
+    bool m_running{};
+    bool m_started{};
+    std::atomic_bool m_sd_card_install{true};
+    std::atomic_bool m_spill_to_sd{false};
+} g_install_queue;
 
 struct FsNative : haze::FileSystemProxyImpl {
     FsNative() = default;
@@ -218,21 +614,16 @@ struct FsSdImage final : FsNative {
 
 struct FsInstall final : haze::FileSystemProxyImpl {
     FsInstall() {
-        mutexInit(&g_install_ctx.mutex);
+        mutexInit(&m_mutex);
+        if (const auto rc = g_install_queue.Start(); R_FAILED(rc)) {
+            log_write("[FsInstall] Failed to start install thread: 0x%x\n", rc);
+        }
         log_write("[FsInstall] Initialized\n");
     }
 
     ~FsInstall() {
-        // 确保安装线程退出
-        if (g_install_ctx.in_progress) {
-            log_write("[FsInstall] Destructor: Disabling stream and waiting for install thread\n");
-            // 先 Disable stream，让安装线程停止等待
-            if (g_install_ctx.stream) {
-                g_install_ctx.stream->Disable();
-            }
-            // 然后等待线程退出
-            WaitForInstallThread();
-        }
+        // 取消所有安装并等待安装线程退出
+        g_install_queue.Stop();
         log_write("[FsInstall] Destroyed\n");
     }
 
@@ -244,50 +635,6 @@ struct FsInstall final : haze::FileSystemProxyImpl {
         return "Install (NSP, XCI, NSZ, XCZ)";
     }
 
-    // 安装线程入口
-    static void InstallThreadFunc(void* arg) {
-        auto* stream = static_cast<sphaira::mtp::InstallStream*>(arg);
-        log_write("[InstallThread] Started for: %s\n", stream->GetPath().s);
-
-        fs::FsNativeSd fs_sd{};
-        if (R_FAILED(fs_sd.GetFsOpenResult())) {
-            log_write("[InstallThread] Failed to open FsNativeSd\n");
-            g_install_ctx.install_result = fs_sd.GetFsOpenResult();
-            // 注意：不在这里设置 in_progress = false
-            stream->Disable();  // 通知 MTP 写入线程停止
-            return;
-        }
-
-        sphaira::ui::ProgressBox pbox;
-        sphaira::yati::ConfigOverride override{};
-
-        // 调用 yati::InstallFromSource，使用流式数据源
-        Result rc = sphaira::yati::InstallFromSource(&pbox, stream, stream->GetPath(), override);
-        g_install_ctx.install_result = rc;
-        // 注意：不在这里设置 in_progress = false，让 WaitForInstallThread() 来处理
-
-        if (R_SUCCEEDED(rc)) {
-            log_write("[InstallThread] SUCCESS: %s\n", stream->GetPath().s);
-            BbiLog("[Install] OK: %s\n", stream->GetPath().s);
-        } else {
-            log_write("[InstallThread] FAILED (0x%x): %s\n", rc, stream->GetPath().s);
-            BbiLog("[Install] FAILED (0x%x): %s\n", rc, stream->GetPath().s);
-        }
-        
-        // 无论成功失败都要 Disable，让 MTP 线程停止传输
-        stream->Disable();
-    }
-
-    static void WaitForInstallThread() {
-        if (g_install_ctx.in_progress) {
-            log_write("[FsInstall] Waiting for install thread...\n");
-            threadWaitForExit(&g_install_ctx.install_thread);
-            threadClose(&g_install_ctx.install_thread);
-            g_install_ctx.in_progress = false;  // 确保标志被重置
-            log_write("[FsInstall] Install thread exited\n");
-        }
-    }
-
     static bool IsSupportedExt(const char* name) {
         const char* ext = std::strrchr(name, '.');
         if (!ext) {
@@ -353,6 +700,14 @@ struct FsInstall final : haze::FileSystemProxyImpl {
     }
 
     Result GetFreeSpace(const char *path, s64 *out) override {
+        // 安装到 NAND 时返回 NAND 的剩余空间
+        if (!g_install_queue.IsSdCardInstall()) {
+            NcmContentStorage cs{};
+            R_TRY(ncmOpenContentStorage(&cs, NcmStorageId_BuiltInUser));
+            ON_SCOPE_EXIT(ncmContentStorageClose(&cs));
+            return ncmContentStorageGetFreeSpaceSize(&cs, out);
+        }
+
         // 返回 SD 卡的剩余空间
         fs::FsNativeSd fs_sd{};
         if (R_FAILED(fs_sd.GetFsOpenResult())) {
@@ -381,7 +736,7 @@ struct FsInstall final : haze::FileSystemProxyImpl {
         }
 
         // 在虚拟文件条目中查找
-        SCOPED_MUTEX(&g_install_ctx.mutex);
+        SCOPED_MUTEX(&m_mutex);
         auto it = std::find_if(m_entries.begin(), m_entries.end(), [name](auto& e) {
             return !strcasecmp(name, e.name);
         });
@@ -396,7 +751,7 @@ struct FsInstall final : haze::FileSystemProxyImpl {
         R_UNLESS(name, FsError_PathNotFound);
         R_UNLESS(IsSupportedExt(name), FsError_NotImplemented);
 
-        SCOPED_MUTEX(&g_install_ctx.mutex);
+        SCOPED_MUTEX(&m_mutex);
 
         // 生成唯一文件名（处理同名文件）
         std::string unique_name = GenerateUniqueName(m_entries, name);
@@ -432,7 +787,7 @@ struct FsInstall final : haze::FileSystemProxyImpl {
         R_UNLESS(name, FsError_PathNotFound);
         R_UNLESS(IsSupportedExt(name), FsError_NotImplemented);
 
-        SCOPED_MUTEX(&g_install_ctx.mutex);
+        SCOPED_MUTEX(&m_mutex);
 
         // 找到虚拟条目
         auto it = std::find_if(m_entries.begin(), m_entries.end(), [name](auto& e) {
@@ -446,56 +801,25 @@ struct FsInstall final : haze::FileSystemProxyImpl {
 
         log_write("[FsInstall] OpenFile: %s mode=0x%X object_id=%d\n", name, mode, (int)object_id);
 
-        // 如果是写模式，创建 stream + 启动安装线程
+        // 如果是写模式，加入安装队列，不等待之前的安装完成
         if (mode & FsOpenMode_Write) {
-            // 等待之前的安装完成
-            if (g_install_ctx.in_progress) {
-                log_write("[FsInstall] Waiting for previous install...\n");
-                mutexUnlock(&g_install_ctx.mutex);
-                WaitForInstallThread();
-                mutexLock(&g_install_ctx.mutex);
-            }
-
-            // 创建新的 stream
             fs::FsPath install_path = "/install/";
             install_path += name;
-            g_install_ctx.stream = std::make_unique<sphaira::mtp::InstallStream>(install_path);
-            g_install_ctx.in_progress = true;
-
-            // 启动安装线程（使用与 yati 内部线程相同的参数）
-            Result rc = threadCreate(&g_install_ctx.install_thread, InstallThreadFunc,
-                                      g_install_ctx.stream.get(), nullptr, 1024*128, 0x3B, -2);
-            if (R_FAILED(rc)) {
-                log_write("[FsInstall] Failed to create install thread: 0x%x\n", rc);
-                g_install_ctx.stream.reset();
-                g_install_ctx.in_progress = false;
-                return rc;
-            }
-
-            rc = threadStart(&g_install_ctx.install_thread);
-            if (R_FAILED(rc)) {
-                log_write("[FsInstall] Failed to start install thread: 0x%x\n", rc);
-                threadClose(&g_install_ctx.install_thread);
-                g_install_ctx.stream.reset();
-                g_install_ctx.in_progress = false;
-                return rc;
-            }
-
-            log_write("[FsInstall] Install thread started for: %s\n", name);
+            R_TRY(g_install_queue.Open(object_id, install_path));
         }
 
         R_SUCCEED();
     }
 
     Result GetFileSize(FsFile *file, s64 *out_size) override {
-        SCOPED_MUTEX(&g_install_ctx.mutex);
+        SCOPED_MUTEX(&m_mutex);
         auto& e = m_entries[file->s.object_id];
         *out_size = e.file_size;
         R_SUCCEED();
     }
 
     Result SetFileSize(FsFile *file, s64 size) override {
-        SCOPED_MUTEX(&g_install_ctx.mutex);
+        SCOPED_MUTEX(&m_mutex);
         auto& e = m_entries[file->s.object_id];
         e.file_size = size;
         R_SUCCEED();
@@ -507,20 +831,15 @@ struct FsInstall final : haze::FileSystemProxyImpl {
     }
 
     Result WriteFile(FsFile *file, s64 off, const void *buf, u64 write_size, u32 option) override {
-        // 推送数据到 stream
-        if (!g_install_ctx.stream) {
-            log_write("[FsInstall] WriteFile: no stream\n");
-            R_THROW(FsError_PathNotFound);
-        }
-
-        if (!g_install_ctx.stream->Push(buf, write_size)) {
-            log_write("[FsInstall] WriteFile: Push failed\n");
-            R_THROW(FsError_NotImplemented);
+        // 推送数据到对应任务的 stream
+        if (const auto rc = g_install_queue.Push(file->s.object_id, buf, write_size); R_FAILED(rc)) {
+            log_write("[FsInstall] WriteFile: Push failed: 0x%x\n", rc);
+            return rc;
         }
 
         // 更新虚拟文件大小
         {
-            SCOPED_MUTEX(&g_install_ctx.mutex);
+            SCOPED_MUTEX(&m_mutex);
             auto& e = m_entries[file->s.object_id];
             e.file_size = std::max<s64>(e.file_size, off + write_size);
         }
@@ -531,35 +850,15 @@ struct FsInstall final : haze::FileSystemProxyImpl {
     void CloseFile(FsFile *file) override {
         log_write("[FsInstall] CloseFile object_id=%d\n", (int)file->s.object_id);
 
-        // 如果是写模式，通知 stream 数据结束
+        // 如果是写模式，通知 stream 数据结束，安装在后台继续，MTP 可以立即传输下一个文件
         if (file->s.own_handle & FsOpenMode_Write) {
-            if (g_install_ctx.stream) {
-                s64 final_size = 0;
-                {
-                    SCOPED_MUTEX(&g_install_ctx.mutex);
-                    auto& e = m_entries[file->s.object_id];
-                    final_size = e.file_size;
-                }
-
-                log_write("[FsInstall] CloseFile: disabling stream, size=%lld\n", (long long)final_size);
-                BbiLog("[Install] CloseFile size=%lld bytes\n", (long long)final_size);
-
-                g_install_ctx.stream->Disable();
-
-                // 等待安装线程完成
-                WaitForInstallThread();
-
-                // 输出安装结果
-                const Result rc = g_install_ctx.install_result;
-                if (R_SUCCEEDED(rc)) {
-                    std::printf("[Install] SUCCESS\n");
-                } else {
-                    std::printf("[Install] FAILED (0x%x)\n", rc);
-                }
-
-                // 清理
-                g_install_ctx.stream.reset();
+            s64 final_size = 0;
+            {
+                SCOPED_MUTEX(&m_mutex);
+                final_size = m_entries[file->s.object_id].file_size;
             }
+
+            g_install_queue.Close(file->s.object_id, final_size);
         }
 
         std::memset(file, 0, sizeof(*file));
@@ -586,7 +885,7 @@ struct FsInstall final : haze::FileSystemProxyImpl {
     }
 
     Result ReadDirectory(FsDir *d, s64 *out_total_entries, size_t max_entries, FsDirectoryEntry *buf) override {
-        SCOPED_MUTEX(&g_install_ctx.mutex);
+        SCOPED_MUTEX(&m_mutex);
         max_entries = std::min<s64>(m_entries.size() - d->s.object_id, max_entries);
         std::memcpy(buf, m_entries.data() + d->s.object_id, max_entries * sizeof(*buf));
         d->s.object_id += max_entries;
@@ -595,7 +894,7 @@ struct FsInstall final : haze::FileSystemProxyImpl {
     }
 
     Result GetDirectoryEntryCount(FsDir *d, s64 *out_count) override {
-        SCOPED_MUTEX(&g_install_ctx.mutex);
+        SCOPED_MUTEX(&m_mutex);
         *out_count = m_entries.size();
         R_SUCCEED();
     }
@@ -609,26 +908,46 @@ struct FsInstall final : haze::FileSystemProxyImpl {
     }
 
 private:
+    Mutex m_mutex{};
     std::vector<FsDirectoryEntry> m_entries;
 };
 
 void callbackHandler(const haze::CallbackData* data) {
+    // 会话编号在 haze 线程上立即记录，主线程稍后处理关闭事件时新会话可能已经开始
+    u32 session{};
+    if (data->type == haze::CallbackType_OpenSession) {
+        g_install_queue.OpenSession();
+    } else if (data->type == haze::CallbackType_CloseSession) {
+        session = g_install_queue.GetSession();
+    }
+
     mutexLock(&g_mutex);
     g_callback_data.emplace_back(*data);
+    if (data->type == haze::CallbackType_CloseSession) {
+        g_closed_sessions.emplace_back(session);
+    }
     mutexUnlock(&g_mutex);
 }
 
 void processEvents() {
     std::vector<haze::CallbackData> data;
+    std::vector<u32> closed_sessions;
 
     mutexLock(&g_mutex);
     std::swap(data, g_callback_data);
+    std::swap(closed_sessions, g_closed_sessions);
     mutexUnlock(&g_mutex);
 
+    u32 closed_index{};
+
     for (const auto& e : data) {
         switch (e.type) {
             case haze::CallbackType_OpenSession: std::printf("Opening Session\n"); break;
-            case haze::CallbackType_CloseSession: std::printf("Closing Session\n"); break;
+            case haze::CallbackType_CloseSession:
+                std::printf("Closing Session\n");
+                // 对端断开时未传完的文件不会再有数据，立即取消，而不是等待读端超时
+                g_install_queue.CancelSession(closed_sessions[closed_index++]);
+                break;
 
             case haze::CallbackType_CreateFile: std::printf("Creating File: %s\n", e.file.filename); break;
             case haze::CallbackType_DeleteFile: std::printf("Deleting File: %s\n", e.file.filename); break;
@@ -669,8 +988,55 @@ void processEvents() {
         }
     }
 
+    // 显示后台完成的安装结果
+    g_install_queue.ReportFinished();
+
+    consoleUpdate(nullptr);
+}
+
+void PrintInstallOptions() {
+    std::printf("Install target: %s, spill to SD: %s%s\n",
+        g_install_queue.IsSdCardInstall() ? "SD" : "NAND",
+        g_install_queue.IsSpillToSd() ? "on" : "off",
+        g_install_queue.IsSpillToSd() && g_install_queue.IsSdCardInstall() ? " (unused when installing to SD)" : "");
+}
+
+#ifdef BBI_DEBUG
+// 调度预设基准测试（仅调试版本，DEBUG=1 编译）：用每种预设各安装一次 BENCHMARK_PATH，并在屏幕上显示耗时和速度
+// 同一文件会被反复安装，所以必须是 SD 卡上的文件，不能是 MTP 流
+constexpr const char* BENCHMARK_PATH = "/config/BBI/benchmark.nsp";
+
+void RunSchedulingBenchmark() {
+    std::printf("Benchmarking scheduling presets with %s...\n", BENCHMARK_PATH);
+    consoleUpdate(nullptr);
+
+    fs::FsNativeSd fs_sd{};
+    if (R_FAILED(fs_sd.GetFsOpenResult())) {
+        std::printf("Failed to open SD card (0x%x)\n", fs_sd.GetFsOpenResult());
+        return;
+    }
+
+    sphaira::ui::ProgressBox pbox;
+    std::vector<sphaira::yati::SchedulingBenchmark> results;
+    const auto rc = sphaira::yati::BenchmarkScheduling(&pbox, &fs_sd, BENCHMARK_PATH, results);
+    if (R_FAILED(rc)) {
+        std::printf("Benchmark failed (0x%x), place an nsp at %s\n", rc, BENCHMARK_PATH);
+    }
+
+    for (const auto& e : results) {
+        const auto mib_s = e.ms ? (double)e.size * 1000.0 / (double)e.ms / (1024.0 * 1024.0) : 0.0;
+        if (R_SUCCEEDED(e.rc)) {
+            std::printf("  %-10s %6zu ms  %.2f MiB/s\n", sphaira::yati::GetSchedulingPresetName(e.preset), e.ms, mib_s);
+        } else {
+            std::printf("  %-10s failed (0x%x)\n", sphaira::yati::GetSchedulingPresetName(e.preset), e.rc);
+        }
+        BbiLog("[Bench] %s: rc: 0x%x time: %zu ms speed: %.2f MiB/s\n", sphaira::yati::GetSchedulingPresetName(e.preset), e.rc, e.ms, mib_s);
+    }
+
+    std::printf("Benchmark finished\n");
     consoleUpdate(nullptr);
 }
+#endif // BBI_DEBUG
 
 } // namespace
 
@@ -700,8 +1066,14 @@ int main(int argc, char** argv) {
 
     std::printf("BBI A fake DBI made by hahappify\n\n");
     std::printf("Press X to start MTP (SD + game install)\n");
+#ifdef BBI_DEBUG
+    std::printf("Press Y to benchmark install scheduling (%s)\n", BENCHMARK_PATH);
+#endif
+    std::printf("Press L to switch install target (SD / NAND)\n");
+    std::printf("Press R to toggle spilling to SD (NAND installs only)\n");
     std::printf("Press B to stop MTP and exit\n");
     std::printf("Press + to exit without MTP\n\n");
+    PrintInstallOptions();
     consoleUpdate(nullptr);
 
     while (appletMainLoop()) {
@@ -729,6 +1101,31 @@ int main(int argc, char** argv) {
             }
         }
 
+        // 安装设置只影响之后打开的文件
+        if (kDown & HidNpadButton_L) {
+            g_install_queue.SetSdCardInstall(!g_install_queue.IsSdCardInstall());
+            PrintInstallOptions();
+            consoleUpdate(nullptr);
+        }
+
+        if (kDown & HidNpadButton_R) {
+            g_install_queue.SetSpillToSd(!g_install_queue.IsSpillToSd());
+            PrintInstallOptions();
+            consoleUpdate(nullptr);
+        }
+
+#ifdef BBI_DEBUG
+        // 基准测试会反复安装同一文件，只在启动 MTP 之前可用，避免与 MTP 安装同时进行
+        if (kDown & HidNpadButton_Y) {
+            if (!mtpRunning) {
+                RunSchedulingBenchmark();
+            } else {
+                std::printf("The benchmark can only run before MTP is started\n");
+                consoleUpdate(nullptr);
+            }
+        }
+#endif
+
         if (kDown & HidNpadButton_B) {
             if (mtpRunning) {
                 haze::Exit();
@@ -751,6 +1148,8 @@ int main(int argc, char** argv) {
     }
 
     consoleExit(nullptr);
+    // 写出后台日志线程中剩余的日志
+    log_file_exit();
     fsdevUnmountAll();
     return 0;
 }
@@ -0,0 +1,88 @@
+// times the fused crypt + hash against crypting a whole buffer and then
+// hashing it in a second pass, over buffers the size of a pool buffer.
+// hash only is the cost of the hash stage on its own.
+
+#include "yati/ncz_crypt.hpp"
+#include "yati/buffer_pool.hpp"
+#include "yati/nx/nca.hpp"
+
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <random>
+#include <vector>
+
+namespace {
+
+using namespace sphaira;
+
+constexpr u64 TOTAL_SIZE = 1024ULL * 1024ULL * 512ULL;
+constexpr u32 ROUNDS = 3;
+
+template<typename F>
+auto Time(F&& func) -> double {
+    double best{};
+    for (u32 i = 0; i < ROUNDS; i++) {
+        const auto start = std::chrono::steady_clock::now();
+        func();
+        const std::chrono::duration<double> taken = std::chrono::steady_clock::now() - start;
+        if (!i || taken.count() < best) {
+            best = taken.count();
+        }
+    }
+    return best;
+}
+
+} // namespace
+
+int main() {
+    std::mt19937_64 rng{0x42454E};
+
+    ncz::Section section{};
+    section.size = TOTAL_SIZE;
+    section.crypto_type = nca::EncryptionType_AesCtr;
+    for (auto& e : section.key) e = rng();
+    for (auto& e : section.counter) e = rng();
+
+    std::vector<u8> buf(yati::pool::BUFFER_SIZE);
+    for (auto& e : buf) e = rng();
+
+    u8 hash[SHA256_HASH_SIZE];
+
+    const auto two_pass = Time([&]{
+        Sha256Context sha{};
+        sha256ContextCreate(&sha);
+        for (u64 off = 0; off < TOTAL_SIZE; off += buf.size()) {
+            const auto size = std::min<u64>(buf.size(), TOTAL_SIZE - off);
+            yati::CryptNczSections({&section, 1}, buf.data(), size, off);
+            sha256ContextUpdate(&sha, buf.data(), size);
+        }
+        sha256ContextGetHash(&sha, hash);
+    });
+
+    const auto fused = Time([&]{
+        Sha256Context sha{};
+        sha256ContextCreate(&sha);
+        for (u64 off = 0; off < TOTAL_SIZE; off += buf.size()) {
+            const auto size = std::min<u64>(buf.size(), TOTAL_SIZE - off);
+            yati::CryptHashNczSections({&section, 1}, buf.data(), size, off, &sha);
+        }
+        sha256ContextGetHash(&sha, hash);
+    });
+
+    const auto hash_only = Time([&]{
+        Sha256Context sha{};
+        sha256ContextCreate(&sha);
+        for (u64 off = 0; off < TOTAL_SIZE; off += buf.size()) {
+            const auto size = std::min<u64>(buf.size(), TOTAL_SIZE - off);
+            sha256ContextUpdate(&sha, buf.data(), size);
+        }
+        sha256ContextGetHash(&sha, hash);
+    });
+
+    const auto mib = TOTAL_SIZE / 1024.0 / 1024.0;
+    std::printf("hash only: %.0f ms (%.0f MiB/s)\n", hash_only * 1000, mib / hash_only);
+    std::printf("two pass: %.0f ms (%.0f MiB/s)\n", two_pass * 1000, mib / two_pass);
+    std::printf("fused:    %.0f ms (%.0f MiB/s)\n", fused * 1000, mib / fused);
+    std::printf("speedup:  %.2fx\n", two_pass / fused);
+}
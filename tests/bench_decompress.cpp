@@ -0,0 +1,84 @@
+// times every variant of the decompress loop over the same synthetic body,
+// the output is dropped by the writer thread so only the decompress stage
+// (plus hashing when enabled) is measured.
+// copied is the bytes memcpy'd by the stage per byte installed.
+
+#include "ncz_pipeline.hpp"
+
+#include <cstdio>
+#include <cstring>
+
+namespace {
+
+using namespace sphaira;
+using namespace sphaira::test;
+
+constexpr u64 TOTAL_SIZE = 1024ULL * 1024ULL * 256ULL;
+constexpr u32 ROUNDS = 3;
+
+void Bench(yati::ThreadPool& pool, const char* name, const NczBody& body, RunConfig config) {
+    config.keep_output = false;
+
+    double best{};
+    u64 copied{};
+    for (u32 i = 0; i < ROUNDS; i++) {
+        const auto result = RunDecompress(pool, body, config);
+        if (R_FAILED(result.rc) || result.out_size != body.plain.size()) {
+            std::printf("%-16s failed: 0x%X\n", name, result.rc);
+            return;
+        }
+        if (!i || result.seconds < best) {
+            best = result.seconds;
+        }
+        copied = result.copied;
+    }
+
+    const auto mib = body.plain.size() / 1024.0 / 1024.0;
+    std::printf("%-16s hash: %u crypt: %u fused: %u  %6.0f ms  %6.0f MiB/s  copied: %.2f\n",
+        name, config.hash, body.IsCrypted(), config.fused, best * 1000, mib / best, static_cast<double>(copied) / body.plain.size());
+}
+
+void BenchAll(yati::ThreadPool& pool, const char* name, const NczBody& body, yati::NcaMode mode) {
+    for (const auto hash : {false, true}) {
+        Bench(pool, name, body, {.mode = mode, .hash = hash, .workers = pool.GetWorkerCount()});
+    }
+
+    if (body.IsCrypted() && mode != yati::NcaMode::NczBlockParallel && mode != yati::NcaMode::Plain) {
+        Bench(pool, name, body, {.mode = mode, .hash = true, .fused = true});
+    }
+}
+
+} // namespace
+
+int main() {
+    yati::ThreadPool pool{};
+    if (R_FAILED(pool.Create(3, 1024 * 128))) {
+        std::printf("failed to create thread pool\n");
+        return 1;
+    }
+
+    const auto data = MakeData(TOTAL_SIZE, 1);
+
+    BenchAll(pool, "plain", MakePlain(data), yati::NcaMode::Plain);
+    for (const auto crypt : {false, true}) {
+        BenchAll(pool, "solid", MakeSolid(data, crypt), yati::NcaMode::NczSolid);
+
+        const auto blocks = MakeBlocks(data, crypt, 20);
+        BenchAll(pool, "block", blocks, yati::NcaMode::NczBlock);
+        BenchAll(pool, "block parallel", blocks, yati::NcaMode::NczBlockParallel);
+
+        const auto stored = MakeBlocks(data, crypt, 20, true);
+        BenchAll(pool, "stored", stored, yati::NcaMode::NczBlock);
+        BenchAll(pool, "stored parallel", stored, yati::NcaMode::NczBlockParallel);
+
+        // every 4th block is random, so stored and compressed blocks share read buffers.
+        auto mixed_data = data;
+        for (u64 off = 0; off < mixed_data.size(); off += 1024 * 1024 * 4) {
+            const auto random = MakeRandom(1024 * 1024, off);
+            std::memcpy(mixed_data.data() + off, random.data(), random.size());
+        }
+        const auto mixed = MakeBlocks(mixed_data, crypt, 20);
+        BenchAll(pool, "mixed", mixed, yati::NcaMode::NczBlock);
+        BenchAll(pool, "mixed parallel", mixed, yati::NcaMode::NczBlockParallel);
+    }
+}
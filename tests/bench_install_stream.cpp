@@ -0,0 +1,81 @@
+// replays mtp sized pushes through an install stream, with a reader that
+// takes whole chunks as the yati read thread does, and reports the cpu time
+// spent per GiB along with how often each byte was copied.
+
+#include "install_stream.hpp"
+
+#include <chrono>
+#include <cstdio>
+#include <ctime>
+#include <thread>
+#include <vector>
+
+namespace {
+
+using namespace sphaira;
+
+constexpr u64 TOTAL_SIZE = 1024ULL * 1024ULL * 1024ULL;
+
+auto CpuTime() -> double {
+    timespec ts{};
+    clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+void Bench(u64 push_size, u32 depth) {
+    std::vector<u8> src(push_size, 0xAB);
+    mtp::InstallStream stream{"/bench/stream.nsp", depth};
+    if (!stream.IsReserved()) {
+        std::printf("failed to reserve buffers\n");
+        return;
+    }
+
+    const auto cpu_start = CpuTime();
+    const auto start = std::chrono::steady_clock::now();
+
+    std::thread writer{[&]{
+        for (u64 off = 0; off < TOTAL_SIZE; off += push_size) {
+            stream.Push(src.data(), std::min<u64>(push_size, TOTAL_SIZE - off));
+        }
+        stream.Close();
+    }};
+
+    std::vector<u8> buf(mtp::InstallStream::CHUNK_SIZE);
+    u64 total{};
+    while (true) {
+        yati::PooledBuffer chunk{};
+        if (R_FAILED(stream.TakeChunk(chunk, mtp::InstallStream::CHUNK_SIZE))) {
+            break;
+        }
+        if (!chunk.empty()) {
+            total += chunk.size();
+            continue;
+        }
+
+        u64 bytes_read{};
+        if (R_FAILED(stream.ReadChunk(buf.data(), buf.size(), &bytes_read)) || !bytes_read) {
+            break;
+        }
+        total += bytes_read;
+    }
+    writer.join();
+
+    const std::chrono::duration<double> taken = std::chrono::steady_clock::now() - start;
+    const auto cpu = CpuTime() - cpu_start;
+    const auto stats = stream.GetStats();
+    const auto gib = total / 1024.0 / 1024.0 / 1024.0;
+
+    std::printf("push: %7zu KiB depth: %u  %5.0f MiB/s  cpu: %4.0f ms/GiB  copies per byte: %.3f\n",
+        push_size / 1024, depth, gib * 1024 / taken.count(), cpu * 1000 / gib,
+        static_cast<double>(stats.pushed + stats.copied) / stats.pushed);
+}
+
+} // namespace
+
+int main() {
+    for (const u64 push_size : {u64{0x10000}, u64{0x80000}, u64{0x100000}, u64{0x3FFE00}}) {
+        for (const auto depth : {mtp::InstallStream::QUEUE_DEPTH, mtp::InstallStream::MAX_QUEUE_DEPTH}) {
+            Bench(push_size, depth);
+        }
+    }
+}
@@ -0,0 +1,116 @@
+// times log_write through the background writer against the old way of
+// opening, writing and closing the log file for every line.
+
+#include "log.hpp"
+
+#include <chrono>
+#include <cstdio>
+#include <ctime>
+#include <filesystem>
+#include <fstream>
+#include <string>
+#include <thread>
+#include <vector>
+#include <unistd.h>
+
+namespace {
+
+using Clock = std::chrono::steady_clock;
+
+constexpr unsigned LINE_COUNT = 200000;
+constexpr unsigned THREAD_COUNT = 4;
+
+auto Ns(Clock::duration d) -> double {
+    return std::chrono::duration<double, std::nano>(d).count();
+}
+
+auto CountLines(const std::filesystem::path& path, unsigned& dropped) -> unsigned {
+    std::ifstream f{path};
+    unsigned count{};
+    dropped = 0;
+    for (std::string line; std::getline(f, line);) {
+        unsigned n{};
+        if (std::sscanf(line.c_str(), "[%*u:%*u:%*u] -> [log] dropped %u lines", &n) == 1) {
+            dropped += n;
+        } else {
+            count++;
+        }
+    }
+    return count;
+}
+
+// what log_write did before the background writer.
+void WriteOpenClose(const char* path, unsigned i) {
+    const auto t = std::time(nullptr);
+    const auto tm = std::localtime(&t);
+
+    char buf[512];
+    const auto len = std::snprintf(buf, sizeof(buf), "[%02u:%02u:%02u] -> ", tm->tm_hour, tm->tm_min, tm->tm_sec);
+    std::snprintf(buf + len, sizeof(buf) - len, "install progress: %u / %u\n", i, LINE_COUNT);
+
+    if (auto f = std::fopen(path, "a")) {
+        std::fprintf(f, "%s", buf);
+        std::fclose(f);
+    }
+}
+
+} // namespace
+
+int main() {
+    const auto dir = std::filesystem::temp_directory_path() / ("bbi_bench_log_" + std::to_string(getpid()));
+    std::filesystem::create_directories(dir);
+    const auto sync_path = dir / "sync.txt";
+    const auto async_path = dir / "async.txt";
+
+    // baseline, single thread.
+    const auto sync_start = Clock::now();
+    for (unsigned i = 0; i < LINE_COUNT; i++) {
+        WriteOpenClose(sync_path.c_str(), i);
+    }
+    const auto sync_time = Clock::now() - sync_start;
+
+    // the log writes to stdout when using nxlink, point it at a file.
+    if (!std::freopen(async_path.c_str(), "w", stdout)) {
+        std::fprintf(stderr, "failed to redirect stdout\n");
+        return 1;
+    }
+    log_nxlink_init();
+
+    const auto async_start = Clock::now();
+    for (unsigned i = 0; i < LINE_COUNT; i++) {
+        log_write("install progress: %u / %u\n", i, LINE_COUNT);
+    }
+    const auto async_queued = Clock::now() - async_start;
+    log_flush();
+    const auto async_time = Clock::now() - async_start;
+
+    // several threads logging at once, as the pipeline stages do.
+    const auto threads_start = Clock::now();
+    std::vector<std::thread> threads{};
+    for (unsigned t = 0; t < THREAD_COUNT; t++) {
+        threads.emplace_back([t] {
+            for (unsigned i = 0; i < LINE_COUNT / THREAD_COUNT; i++) {
+                log_write("stage %u progress: %u\n", t, i);
+            }
+        });
+    }
+    for (auto& thread : threads) {
+        thread.join();
+    }
+    log_flush();
+    const auto threads_time = Clock::now() - threads_start;
+
+    log_nxlink_exit();
+    std::fflush(stdout);
+
+    unsigned dropped{};
+    const auto written = CountLines(async_path, dropped);
+
+    std::fprintf(stderr, "open / write / close per line: %.0f ns/line\n", Ns(sync_time) / LINE_COUNT);
+    std::fprintf(stderr, "background writer, 1 thread:   %.0f ns/line queued, %.0f ns/line written\n", Ns(async_queued) / LINE_COUNT, Ns(async_time) / LINE_COUNT);
+    std::fprintf(stderr, "background writer, %u threads:  %.0f ns/line written\n", THREAD_COUNT, Ns(threads_time) / LINE_COUNT);
+    std::fprintf(stderr, "lines written: %u / %u dropped: %u\n", written, LINE_COUNT * 2, dropped);
+
+    std::filesystem::remove_all(dir);
+    return 0;
+}
@@ -0,0 +1,57 @@
+// times the parallel block ncz decompressor with 1 to 4 workers, each with
+// its own thread pool, over a body of compressible 1MiB blocks.
+// the numbers only scale as far as the host has cores.
+
+#include "ncz_pipeline.hpp"
+
+#include <cstdio>
+#include <thread>
+
+namespace {
+
+using namespace sphaira;
+using namespace sphaira::test;
+
+constexpr u64 TOTAL_SIZE = 1024ULL * 1024ULL * 256ULL;
+constexpr u32 ROUNDS = 3;
+
+} // namespace
+
+int main() {
+    std::printf("host cores: %u\n", std::thread::hardware_concurrency());
+
+    const auto data = MakeData(TOTAL_SIZE, 1);
+    for (const auto crypt : {false, true}) {
+        const auto body = MakeBlocks(data, crypt, 20);
+
+        for (u32 workers = 1; workers <= yati::NczBlockDecompressor::MAX_WORKERS; workers++) {
+            yati::ThreadPool pool{};
+            if (R_FAILED(pool.Create(workers, 1024 * 128))) {
+                std::printf("failed to create thread pool\n");
+                return 1;
+            }
+
+            double best{};
+            for (u32 i = 0; i < ROUNDS; i++) {
+                yati::PipelineData t{false, 0};
+                SetBlocks(t, body);
+                std::vector<u8> out{};
+                out.reserve(TOTAL_SIZE);
+
+                const auto start = std::chrono::steady_clock::now();
+                const auto rc = RunBlocks(pool, t, body, workers, 1024 * 1024 * 4, out);
+                const std::chrono::duration<double> taken = std::chrono::steady_clock::now() - start;
+                if (R_FAILED(rc) || out.size() != TOTAL_SIZE) {
+                    std::printf("failed: 0x%X\n", rc);
+                    return 1;
+                }
+                if (!i || taken.count() < best) {
+                    best = taken.count();
+                }
+            }
+
+            const auto mib = TOTAL_SIZE / 1024.0 / 1024.0;
+            std::printf("crypt: %u workers: %u  %6.0f ms  %6.0f MiB/s\n", crypt, workers, best * 1000, mib / best);
+        }
+    }
+}
@@ -0,0 +1,166 @@
+// times handing items from one thread to another through SpscRing, against
+// the mutex / condvar guarded RingBuf the pipeline used before it.
+// every item carries a buffer handle, as the pipeline's buffers do.
+
+#include "yati/spsc_ring.hpp"
+
+#include <chrono>
+#include <cstdio>
+#include <thread>
+#include <vector>
+
+namespace {
+
+using namespace sphaira;
+
+constexpr u64 ITEM_COUNT = 1024 * 1024 * 2;
+constexpr u32 ROUNDS = 3;
+
+struct Item {
+    std::vector<u8> buf{};
+    s64 off{};
+};
+
+// RingBuf and the handoff around it, as they were before SpscRing.
+// the waits are looped, the original only waited once.
+template<std::size_t Size>
+struct RingBuf {
+private:
+    Item buf[Size]{};
+    unsigned r_index{};
+    unsigned w_index{};
+
+public:
+    unsigned ringbuf_capacity() const {
+        return sizeof(this->buf) / sizeof(this->buf[0]);
+    }
+
+    unsigned ringbuf_size() const {
+        return (this->w_index - this->r_index) % (ringbuf_capacity() * 2U);
+    }
+
+    unsigned ringbuf_free() const {
+        return ringbuf_capacity() - ringbuf_size();
+    }
+
+    void ringbuf_push(std::vector<u8>& buf_in, s64 off_in) {
+        auto& value = this->buf[this->w_index % ringbuf_capacity()];
+        value.off = off_in;
+        std::swap(value.buf, buf_in);
+        this->w_index = (this->w_index + 1U) % (ringbuf_capacity() * 2U);
+    }
+
+    void ringbuf_pop(std::vector<u8>& buf_out, s64& off_out) {
+        auto& value = this->buf[this->r_index % ringbuf_capacity()];
+        off_out = value.off;
+        std::swap(value.buf, buf_out);
+        this->r_index = (this->r_index + 1U) % (ringbuf_capacity() * 2U);
+    }
+};
+
+template<std::size_t Size>
+struct LockedRing {
+    LockedRing() {
+        mutexInit(&mutex);
+        condvarInit(&can_push);
+        condvarInit(&can_pop);
+    }
+
+    void Push(std::vector<u8>& buf, s64 off) {
+        mutexLock(&mutex);
+        while (!ring.ringbuf_free()) {
+            condvarWait(&can_push, &mutex);
+        }
+        ring.ringbuf_push(buf, off);
+        mutexUnlock(&mutex);
+        condvarWakeOne(&can_pop);
+    }
+
+    void Pop(std::vector<u8>& buf, s64& off) {
+        mutexLock(&mutex);
+        while (!ring.ringbuf_size()) {
+            condvarWait(&can_pop, &mutex);
+        }
+        ring.ringbuf_pop(buf, off);
+        mutexUnlock(&mutex);
+        condvarWakeOne(&can_push);
+    }
+
+    RingBuf<Size> ring{};
+    Mutex mutex{};
+    CondVar can_push{};
+    CondVar can_pop{};
+};
+
+template<typename F>
+auto Time(F&& func) -> double {
+    double best{};
+    for (u32 i = 0; i < ROUNDS; i++) {
+        const auto start = std::chrono::steady_clock::now();
+        func();
+        const std::chrono::duration<double> taken = std::chrono::steady_clock::now() - start;
+        if (!i || taken.count() < best) {
+            best = taken.count();
+        }
+    }
+    return best;
+}
+
+template<std::size_t Size>
+auto TimeRingBuf() -> double {
+    return Time([]{
+        LockedRing<Size> ring{};
+        std::thread consumer{[&]{
+            std::vector<u8> buf{};
+            s64 off{};
+            for (u64 i = 0; i < ITEM_COUNT; i++) {
+                ring.Pop(buf, off);
+            }
+        }};
+
+        std::vector<u8> buf(16);
+        for (u64 i = 0; i < ITEM_COUNT; i++) {
+            ring.Push(buf, i);
+        }
+        consumer.join();
+    });
+}
+
+template<std::size_t Size>
+auto TimeSpscRing() -> double {
+    return Time([]{
+        yati::SpscRing<Item, Size> ring{};
+        std::thread consumer{[&]{
+            Item item{};
+            while (ring.Pop(item)) {
+            }
+        }};
+
+        Item item{};
+        item.buf.resize(16);
+        for (u64 i = 0; i < ITEM_COUNT; i++) {
+            item.off = i;
+            ring.Push(item);
+        }
+        ring.Close();
+        consumer.join();
+    });
+}
+
+template<std::size_t Size>
+void Report() {
+    const auto old_s = TimeRingBuf<Size>();
+    const auto new_s = TimeSpscRing<Size>();
+    std::printf("depth: %zu RingBuf: %.1f ns/item SpscRing: %.1f ns/item (%.2fx)\n",
+        Size, old_s * 1e9 / ITEM_COUNT, new_s * 1e9 / ITEM_COUNT, old_s / new_s);
+}
+
+} // namespace
+
+int main() {
+    std::printf("items: %zu cpus: %u\n", ITEM_COUNT, std::thread::hardware_concurrency());
+    Report<4>();
+    Report<8>();
+    Report<16>();
+    return 0;
+}
@@ -0,0 +1,15 @@
+// host versions of the fs helpers used by the units under test, using std::filesystem.
+
+#include "fs.hpp"
+#include <filesystem>
+#include <system_error>
+
+namespace fs {
+
+Result CreateDirectoryRecursively(const FsPath& path, bool) {
+    std::error_code ec{};
+    std::filesystem::create_directories(path.s, ec);
+    return ec ? 1 : 0;
+}
+
+} // namespace fs
@@ -0,0 +1,341 @@
+#define OPENSSL_SUPPRESS_DEPRECATED
+#include "switch.h"
+#include <openssl/evp.h>
+#include <openssl/sha.h>
+
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <chrono>
+#include <cstring>
+#include <climits>
+#include <ctime>
+#include <linux/futex.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+namespace {
+
+// returned on timeout, same value as libnx (KERNELRESULT(TimedOut)).
+constexpr Result RESULT_TIMED_OUT = 0xEA01;
+
+// every event shares one mutex / condvar, waiters re-check their events on every signal.
+pthread_mutex_t g_event_mutex = PTHREAD_MUTEX_INITIALIZER;
+pthread_cond_t g_event_cond = PTHREAD_COND_INITIALIZER;
+
+std::atomic<Handle> g_next_handle{1};
+
+auto Deadline(u64 timeout_ns) -> timespec {
+    timespec ts{};
+    clock_gettime(CLOCK_REALTIME, &ts);
+    const auto ns = static_cast<u64>(ts.tv_nsec) + timeout_ns % 1000000000ULL;
+    ts.tv_sec += timeout_ns / 1000000000ULL + ns / 1000000000ULL;
+    ts.tv_nsec = ns % 1000000000ULL;
+    return ts;
+}
+
+void* ThreadEntry(void* arg) {
+    auto t = static_cast<Thread*>(arg);
+    t->entry(t->arg);
+    return nullptr;
+}
+
+static_assert(sizeof(SHA256_CTX) <= sizeof(Sha256Context));
+
+auto GetSha(Sha256Context* ctx) -> SHA256_CTX* {
+    return reinterpret_cast<SHA256_CTX*>(ctx->state);
+}
+
+void IncrementCounter(u8* ctr) {
+    for (int i = 0xF; i >= 0; i--) {
+        if (++ctr[i]) {
+            break;
+        }
+    }
+}
+
+// the key schedule is kept per thread and only redone when the key changes, so
+// that crypting in small tiles costs about the same as on the switch.
+auto GetEcb(const u8* key) -> EVP_CIPHER_CTX* {
+    struct Ecb {
+        ~Ecb() { EVP_CIPHER_CTX_free(ctx); }
+        EVP_CIPHER_CTX* ctx{EVP_CIPHER_CTX_new()};
+        u8 key[0x10]{};
+        bool init{};
+    };
+    thread_local Ecb ecb{};
+
+    if (!ecb.init || std::memcmp(ecb.key, key, sizeof(ecb.key))) {
+        EVP_EncryptInit_ex(ecb.ctx, EVP_aes_128_ecb(), nullptr, key, nullptr);
+        EVP_CIPHER_CTX_set_padding(ecb.ctx, 0);
+        std::memcpy(ecb.key, key, sizeof(ecb.key));
+        ecb.init = true;
+    }
+
+    return ecb.ctx;
+}
+
+} // namespace
+
+extern "C" {
+
+void mutexInit(Mutex* m) {
+    pthread_mutex_init(&m->m, nullptr);
+}
+
+void mutexLock(Mutex* m) {
+    pthread_mutex_lock(&m->m);
+}
+
+void mutexUnlock(Mutex* m) {
+    pthread_mutex_unlock(&m->m);
+}
+
+bool mutexTryLock(Mutex* m) {
+    return !pthread_mutex_trylock(&m->m);
+}
+
+void condvarInit(CondVar* c) {
+    pthread_cond_init(&c->c, nullptr);
+}
+
+Result condvarWait(CondVar* c, Mutex* m) {
+    pthread_cond_wait(&c->c, &m->m);
+    return 0;
+}
+
+Result condvarWaitTimeout(CondVar* c, Mutex* m, u64 timeout) {
+    const auto ts = Deadline(timeout);
+    return pthread_cond_timedwait(&c->c, &m->m, &ts) == ETIMEDOUT ? RESULT_TIMED_OUT : 0;
+}
+
+Result condvarWakeOne(CondVar* c) {
+    pthread_cond_signal(&c->c);
+    return 0;
+}
+
+Result condvarWakeAll(CondVar* c) {
+    pthread_cond_broadcast(&c->c);
+    return 0;
+}
+
+Result threadCreate(Thread* t, ThreadFunc entry, void* arg, void*, size_t, int, int) {
+    *t = {};
+    t->handle = g_next_handle++;
+    t->entry = entry;
+    t->arg = arg;
+    return 0;
+}
+
+Result threadStart(Thread* t) {
+    return pthread_create(&t->thread, nullptr, ThreadEntry, t) ? 1 : 0;
+}
+
+Result threadWaitForExit(Thread* t) {
+    pthread_join(t->thread, nullptr);
+    return 0;
+}
+
+Result threadClose(Thread*) {
+    return 0;
+}
+
+Result svcSetThreadCoreMask(Handle, s32, u32) {
+    return 0;
+}
+
+Result svcSetThreadPriority(Handle, u32) {
+    return 0;
+}
+
+Result svcGetInfo(u64*, u32, Handle, u64) {
+    // not available, callers fall back to their defaults.
+    return 1;
+}
+
+// only the arbitration used by SpscRing is implemented, backed by a futex.
+Result svcWaitForAddress(void* address, u32 arb_type, s32 value, s64 timeout) {
+    if (arb_type != ArbitrationType_WaitIfEqual) {
+        return 1;
+    }
+
+    timespec ts{};
+    if (timeout >= 0) {
+        ts = {static_cast<time_t>(timeout / 1000000000LL), static_cast<long>(timeout % 1000000000LL)};
+    }
+
+    if (syscall(SYS_futex, address, FUTEX_WAIT_PRIVATE, value, timeout >= 0 ? &ts : nullptr, nullptr, 0) == -1 && errno == ETIMEDOUT) {
+        return RESULT_TIMED_OUT;
+    }
+    return 0;
+}
+
+Result svcSignalToAddress(void* address, u32 signal_type, s32, s32 count) {
+    if (signal_type != SignalType_Signal) {
+        return 1;
+    }
+
+    syscall(SYS_futex, address, FUTEX_WAKE_PRIVATE, count < 0 ? INT_MAX : count, nullptr, nullptr, 0);
+    return 0;
+}
+
+Result svcSleepThread(s64 ns) {
+    const timespec ts{static_cast<time_t>(ns / 1000000000LL), static_cast<long>(ns % 1000000000LL)};
+    nanosleep(&ts, nullptr);
+    return 0;
+}
+
+u64 armGetSystemTick(void) {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+u64 armGetSystemTickFreq(void) {
+    return 1000000000ULL;
+}
+
+u64 armTicksToNs(u64 tick) {
+    return tick;
+}
+
+u64 armNsToTicks(u64 ns) {
+    return ns;
+}
+
+void ueventCreate(UEvent* e, bool auto_clear) {
+    pthread_mutex_lock(&g_event_mutex);
+    e->signaled = false;
+    e->auto_clear = auto_clear;
+    pthread_mutex_unlock(&g_event_mutex);
+}
+
+void ueventSignal(UEvent* e) {
+    pthread_mutex_lock(&g_event_mutex);
+    e->signaled = true;
+    pthread_cond_broadcast(&g_event_cond);
+    pthread_mutex_unlock(&g_event_mutex);
+}
+
+void ueventClear(UEvent* e) {
+    pthread_mutex_lock(&g_event_mutex);
+    e->signaled = false;
+    pthread_mutex_unlock(&g_event_mutex);
+}
+
+Waiter waiterForUEvent(UEvent* e) {
+    return Waiter{e};
+}
+
+Result waitObjects(s32* idx, const Waiter* waiters, s32 count, u64 timeout) {
+    const auto ts = Deadline(timeout == UINT64_MAX ? 1000000000ULL * 60 * 60 * 24 : timeout);
+
+    pthread_mutex_lock(&g_event_mutex);
+    Result rc = 0;
+    while (true) {
+        const auto it = std::find_if(waiters, waiters + count, [](auto& w) { return w.event->signaled; });
+        if (it != waiters + count) {
+            if (it->event->auto_clear) {
+                it->event->signaled = false;
+            }
+            *idx = it - waiters;
+            break;
+        }
+
+        if (pthread_cond_timedwait(&g_event_cond, &g_event_mutex, &ts) == ETIMEDOUT) {
+            rc = RESULT_TIMED_OUT;
+            break;
+        }
+    }
+    pthread_mutex_unlock(&g_event_mutex);
+    return rc;
+}
+
+Result waitSingle(Waiter w, u64 timeout) {
+    s32 idx;
+    return waitObjects(&idx, &w, 1, timeout);
+}
+
+void sha256ContextCreate(Sha256Context* ctx) {
+    SHA256_Init(GetSha(ctx));
+}
+
+void sha256ContextUpdate(Sha256Context* ctx, const void* src, size_t size) {
+    SHA256_Update(GetSha(ctx), src, size);
+}
+
+void sha256ContextGetHash(Sha256Context* ctx, void* dst) {
+    SHA256_Final(static_cast<u8*>(dst), GetSha(ctx));
+}
+
+void sha256CalculateHash(void* dst, const void* src, size_t size) {
+    SHA256(static_cast<const u8*>(src), size, static_cast<u8*>(dst));
+}
+
+void aes128CtrContextCreate(Aes128CtrContext* ctx, const void* key, const void* ctr) {
+    std::memcpy(ctx->key, key, sizeof(ctx->key));
+    aes128CtrContextResetCtr(ctx, ctr);
+}
+
+void aes128CtrContextResetCtr(Aes128CtrContext* ctx, const void* ctr) {
+    std::memcpy(ctx->ctr, ctr, sizeof(ctx->ctr));
+    ctx->buffered = 0;
+}
+
+// same as libnx, the whole 16 byte counter is incremented as a big-endian number.
+void aes128CtrCrypt(Aes128CtrContext* ctx, void* dst, const void* src, size_t size) {
+    constexpr size_t BATCH_BLOCKS = 256;
+
+    auto out = static_cast<u8*>(dst);
+    auto in = static_cast<const u8*>(src);
+
+    auto e = GetEcb(ctx->key);
+
+    u8 counters[BATCH_BLOCKS * 0x10];
+    u8 stream[BATCH_BLOCKS * 0x10];
+
+    while (size) {
+        // use up the keystream left over from the last call first.
+        if (ctx->buffered) {
+            const auto used = 0x10 - ctx->buffered;
+            const auto len = std::min<size_t>(ctx->buffered, size);
+            for (size_t i = 0; i < len; i++) {
+                out[i] = in[i] ^ ctx->enc_ctr[used + i];
+            }
+            ctx->buffered -= len;
+            out += len; in += len; size -= len;
+            continue;
+        }
+
+        const auto blocks = std::min(BATCH_BLOCKS, (size + 0xF) / 0x10);
+        for (size_t i = 0; i < blocks; i++) {
+            std::memcpy(counters + i * 0x10, ctx->ctr, 0x10);
+            IncrementCounter(ctx->ctr);
+        }
+
+        int len{};
+        EVP_EncryptUpdate(e, stream, &len, counters, blocks * 0x10);
+
+        const auto bytes = std::min(blocks * 0x10, size);
+        for (size_t i = 0; i < bytes; i++) {
+            out[i] = in[i] ^ stream[i];
+        }
+
+        // keep the rest of the last block for the next call.
+        if (bytes % 0x10) {
+            std::memcpy(ctx->enc_ctr, stream + (blocks - 1) * 0x10, 0x10);
+            ctx->buffered = 0x10 - bytes % 0x10;
+        }
+
+        out += bytes; in += bytes; size -= bytes;
+    }
+}
+
+Result fsdevGetLastResult(void) {
+    return 0;
+}
+
+// the host's stdout stands in for the nxlink socket.
+int nxlinkConnectToHost(bool, bool) {
+    return dup(STDOUT_FILENO);
+}
+
+} // extern "C"
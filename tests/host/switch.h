@@ -0,0 +1,151 @@
+/*
+* Notes:
+* - stand-in for the parts of libnx used by the host tests, so that
+*   install_core units can be built and run on linux.
+* - types and prototypes match libnx closely enough to compile the units,
+*   only what the tests actually run is implemented (see switch.cpp).
+* - threads, mutexes, condvars and events are backed by pthreads,
+*   sha256 and aes by openssl.
+*/
+
+#pragma once
+
+#include <pthread.h>
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <strings.h>
+typedef uint8_t u8; typedef uint16_t u16; typedef uint32_t u32; typedef uint64_t u64;
+typedef int8_t s8; typedef int16_t s16; typedef int32_t s32; typedef int64_t s64;
+typedef u32 Result; typedef u32 Handle;
+#define BIT(n) (1U<<(n))
+#define R_FAILED(r) ((r)!=0)
+#define R_SUCCEEDED(r) ((r)==0)
+#define MAKERESULT(m,d) (((m)&0x1FF)|((d)&0x1FFF)<<9)
+#define R_VALUE(r) (r)
+#define FS_MAX_PATH 0x301
+#define SHA256_HASH_SIZE 0x20
+#define AES_128_KEY_SIZE 0x10
+#define AES_BLOCK_SIZE 0x10
+#define NX_INLINE static inline
+#define INVALID_HANDLE 0
+#define CUR_THREAD_HANDLE 0xFFFF8000
+#define CUR_PROCESS_HANDLE 0xFFFF8001
+extern "C" {
+typedef enum { YieldType_WithoutCoreMigration = 0, YieldType_WithCoreMigration = -1, YieldType_ToAnyThread = -2 } YieldType;
+Result svcGetCurrentProcessorNumber(void); Result svcSetThreadCoreMask(Handle, s32, u32); Result svcSetThreadPriority(Handle, u32);
+Result svcGetInfo(u64*, u32, Handle, u64);
+enum { InfoType_TotalMemorySize = 6, InfoType_UsedMemorySize = 7 };
+Result svcWaitForAddress(void*, u32, s32, s64); Result svcSignalToAddress(void*, u32, s32, s32);
+typedef enum { ArbitrationType_WaitIfLessThan=0, ArbitrationType_DecrementAndWaitIfLessThan=1, ArbitrationType_WaitIfEqual=2 } ArbitrationType;
+typedef enum { SignalType_Signal=0, SignalType_SignalAndIncrementIfEqual=1, SignalType_SignalAndModifyBasedOnWaitingThreadCountIfEqual=2 } SignalType;
+Result armDCacheFlush(void*, size_t);
+typedef struct { u8 c[0x10]; } NcmContentId; typedef struct { u8 c[0x10]; } NcmPlaceHolderId; typedef struct { u8 c[0x10]; } FsRightsId;
+typedef struct { int s; } Service;
+typedef struct { Service s; } NcmContentStorage; typedef struct { Service s; } NcmContentMetaDatabase;
+typedef enum { NcmStorageId_None=0, NcmStorageId_Host=1, NcmStorageId_GameCard=2, NcmStorageId_BuiltInSystem=3, NcmStorageId_BuiltInUser=4, NcmStorageId_SdCard=5, NcmStorageId_Any=6 } NcmStorageId;
+typedef enum { NcmContentType_Meta=0, NcmContentType_Program=1, NcmContentType_Data=2, NcmContentType_Control=3, NcmContentType_HtmlDocument=4, NcmContentType_LegalInformation=5, NcmContentType_DeltaFragment=6 } NcmContentType;
+typedef enum { NcmContentMetaType_Unknown=0, NcmContentMetaType_SystemProgram=1, NcmContentMetaType_SystemData=2, NcmContentMetaType_SystemUpdate=3, NcmContentMetaType_BootImagePackage=4, NcmContentMetaType_BootImagePackageSafe=5, NcmContentMetaType_Application=0x80, NcmContentMetaType_Patch=0x81, NcmContentMetaType_AddOnContent=0x82, NcmContentMetaType_Delta=0x83, NcmContentMetaType_DataPatch=0x84 } NcmContentMetaType;
+typedef enum { NcmContentInstallType_Full=0 } NcmContentInstallType;
+typedef struct { u64 id; u32 version; u8 type; u8 install_type; u8 padding[2]; } NcmContentMetaKey;
+typedef struct { u16 extended_header_size; u16 content_count; u16 content_meta_count; u8 attributes; u8 storage_id; } NcmContentMetaHeader;
+typedef struct { NcmContentId content_id; u32 size_low; u8 size_high; u8 attr; u8 content_type; u8 id_offset; } NcmContentInfo;
+typedef struct { u8 hash[0x20]; NcmContentInfo info; } NcmPackagedContentInfo;
+typedef struct { u64 a; u32 required_system_version; u32 b; } NcmApplicationMetaExtendedHeader;
+typedef struct { u64 a; u32 required_system_version; u32 b; } NcmPatchMetaExtendedHeader;
+typedef struct { u64 a; } NcmAddOnContentMetaExtendedHeader; typedef struct { u64 a; } NcmLegacyAddOnContentMetaExtendedHeader; typedef struct { u64 a; } NcmDataPatchMetaExtendedHeader;
+void ncmU64ToContentInfoSize(u64, NcmContentInfo*);
+Result ncmContentStorageHas(NcmContentStorage*, bool*, const NcmContentId*);
+Result ncmContentStorageReadContentIdFile(NcmContentStorage*, void*, size_t, const NcmContentId*, s64);
+Result ncmContentStorageGeneratePlaceHolderId(NcmContentStorage*, NcmPlaceHolderId*);
+Result ncmContentStorageCreatePlaceHolder(NcmContentStorage*, const NcmContentId*, const NcmPlaceHolderId*, s64);
+Result ncmContentStorageDeletePlaceHolder(NcmContentStorage*, const NcmPlaceHolderId*);
+Result ncmContentStorageHasPlaceHolder(NcmContentStorage*, bool*, const NcmPlaceHolderId*);
+Result ncmContentStorageWritePlaceHolder(NcmContentStorage*, const NcmPlaceHolderId*, u64, const void*, size_t);
+Result ncmContentStorageSetPlaceHolderSize(NcmContentStorage*, const NcmPlaceHolderId*, s64);
+Result ncmContentStorageGetSizeFromPlaceHolderId(NcmContentStorage*, s64*, const NcmPlaceHolderId*);
+Result ncmContentStorageFlushPlaceHolder(NcmContentStorage*);
+Result ncmContentStorageGetPlaceHolderPath(NcmContentStorage*, char*, size_t, const NcmPlaceHolderId*);
+Result ncmContentStorageGetPath(NcmContentStorage*, char*, size_t, const NcmContentId*);
+Result ncmContentStorageRegister(NcmContentStorage*, const NcmContentId*, const NcmPlaceHolderId*);
+Result ncmContentStorageDelete(NcmContentStorage*, const NcmContentId*);
+Result ncmContentStorageClose(NcmContentStorage*); Result ncmContentMetaDatabaseClose(NcmContentMetaDatabase*);
+Result ncmOpenContentStorage(NcmContentStorage*, NcmStorageId); Result ncmOpenContentMetaDatabase(NcmContentMetaDatabase*, NcmStorageId);
+Result ncmContentMetaDatabaseList(NcmContentMetaDatabase*, s32*, s32*, NcmContentMetaKey*, s32, NcmContentMetaType, u64, u64, u64, NcmContentInstallType);
+Result ncmContentMetaDatabaseHas(NcmContentMetaDatabase*, bool*, const NcmContentMetaKey*);
+Result ncmContentMetaDatabaseGet(NcmContentMetaDatabase*, const NcmContentMetaKey*, u64*, void*, u64);
+Result ncmContentMetaDatabaseListContentInfo(NcmContentMetaDatabase*, s32*, NcmContentInfo*, s32, const NcmContentMetaKey*, s32);
+Result ncmContentMetaDatabaseRemove(NcmContentMetaDatabase*, const NcmContentMetaKey*);
+Result ncmContentMetaDatabaseCommit(NcmContentMetaDatabase*);
+Result ncmContentMetaDatabaseSet(NcmContentMetaDatabase*, const NcmContentMetaKey*, const void*, u64);
+Result splCryptoInitialize(void); void splCryptoExit(void); Result nsInitialize(void); void nsExit(void);
+Result nsGetApplicationManagerInterface(Service*); void serviceClose(Service*); bool serviceIsActive(Service*);
+Result avmInitialize(void); void avmExit(void); Result avmPushLaunchVersion(u64, u32);
+bool hosversionAtLeast(int,int,int); Result appletSetAutoSleepDisabled(bool);
+typedef struct { char name[0x200]; char author[0x100]; } NacpLanguageEntry;
+typedef struct { u8 a[0x100]; } SetCalRsa2048DeviceKey;
+typedef struct { u64 object_id; u32 own_handle; } FsServiceStub;
+typedef struct { FsServiceStub s; } FsFile; typedef struct { FsServiceStub s; } FsDir; typedef struct { Service s; } FsFileSystem;
+typedef enum { FsDirEntryType_Dir=0, FsDirEntryType_File=1 } FsDirEntryType;
+typedef struct { char name[FS_MAX_PATH]; u8 pad[3]; s8 type; u8 pad2[3]; s64 file_size; } FsDirectoryEntry;
+typedef struct { u64 a[4]; } FsTimeStampRaw; typedef struct { u32 a; } FsGameCardHandle;
+typedef enum { FsOpenMode_Read=1, FsOpenMode_Write=2, FsOpenMode_Append=4 } FsOpenMode;
+typedef enum { FsDirOpenMode_ReadDirs=1, FsDirOpenMode_ReadFiles=2 } FsDirOpenMode;
+typedef enum { FsImageDirectoryId_Nand=0, FsImageDirectoryId_Sd=1 } FsImageDirectoryId;
+typedef int FsBisPartitionId; typedef int FsContentStorageId; typedef int FsGameCardPartition; typedef int FsSaveDataType; typedef int FsSaveDataSpaceId; typedef int FsFileSystemType; typedef int FsContentAttributes;
+#define FsContentAttributes_All 0
+#define FsSaveDataType_System 0
+#define FsSaveDataType_SystemBcat 1
+#define FsSaveDataSpaceId_System 0
+typedef struct { u64 a; } FsSaveDataAttribute;
+Result fsFsClose(FsFileSystem*); Result fsFsCommit(FsFileSystem*);
+Result fsFsGetFreeSpace(FsFileSystem*, const char*, s64*); Result fsFsGetTotalSpace(FsFileSystem*, const char*, s64*);
+Result fsFsGetEntryType(FsFileSystem*, const char*, FsDirEntryType*); Result fsFsCreateFile(FsFileSystem*, const char*, s64, u32); Result fsFsDeleteFile(FsFileSystem*, const char*);
+Result fsFsRenameFile(FsFileSystem*, const char*, const char*); Result fsFsOpenFile(FsFileSystem*, const char*, u32, FsFile*);
+Result fsFileGetSize(FsFile*, s64*); Result fsFileSetSize(FsFile*, s64); Result fsFileRead(FsFile*, s64, void*, u64, u32, u64*); Result fsFileWrite(FsFile*, s64, const void*, u64, u32); void fsFileClose(FsFile*); Result fsFileFlush(FsFile*);
+Result fsFsCreateDirectory(FsFileSystem*, const char*); Result fsFsDeleteDirectoryRecursively(FsFileSystem*, const char*); Result fsFsRenameDirectory(FsFileSystem*, const char*, const char*);
+Result fsFsOpenDirectory(FsFileSystem*, const char*, u32, FsDir*); Result fsDirRead(FsDir*, s64*, size_t, FsDirectoryEntry*); Result fsDirGetEntryCount(FsDir*, s64*); void fsDirClose(FsDir*);
+Result fsOpenImageDirectoryFileSystem(FsFileSystem*, FsImageDirectoryId); FsFileSystem* fsdevGetDeviceFileSystem(const char*);
+Result fsOpenBisFileSystem(FsFileSystem*, FsBisPartitionId, const char*); Result fsOpenContentStorageFileSystem(FsFileSystem*, FsContentStorageId);
+Result fsOpenGameCardFileSystem(FsFileSystem*, const FsGameCardHandle*, FsGameCardPartition);
+Result fsOpenSaveDataFileSystemBySystemSaveDataId(FsFileSystem*, FsSaveDataSpaceId, const FsSaveDataAttribute*); Result fsOpenReadOnlySaveDataFileSystem(FsFileSystem*, FsSaveDataSpaceId, const FsSaveDataAttribute*); Result fsOpenSaveDataFileSystem(FsFileSystem*, FsSaveDataSpaceId, const FsSaveDataAttribute*);
+Result fsOpenFileSystemWithId(FsFileSystem*, u64, FsFileSystemType, const char*, FsContentAttributes);
+int fsdevMountSdmc(void); int fsdevUnmountAll(void);
+int nxlinkConnectToHost(bool, bool);
+
+// sync primitives, backed by pthreads in switch.cpp.
+typedef struct { pthread_mutex_t m; } Mutex;
+typedef struct { pthread_cond_t c; } CondVar;
+void mutexInit(Mutex*); void mutexLock(Mutex*); void mutexUnlock(Mutex*); bool mutexTryLock(Mutex*);
+void condvarInit(CondVar*); Result condvarWait(CondVar*, Mutex*); Result condvarWaitTimeout(CondVar*, Mutex*, u64); Result condvarWakeOne(CondVar*); Result condvarWakeAll(CondVar*);
+
+typedef void (*ThreadFunc)(void*);
+typedef struct { Handle handle; pthread_t thread; ThreadFunc entry; void* arg; } Thread;
+Result threadCreate(Thread*, ThreadFunc, void*, void*, size_t, int, int); Result threadStart(Thread*); Result threadWaitForExit(Thread*); Result threadClose(Thread*);
+
+typedef struct { bool signaled; bool auto_clear; } UEvent;
+void ueventCreate(UEvent*, bool); void ueventSignal(UEvent*); void ueventClear(UEvent*);
+typedef struct { UEvent* event; } Waiter;
+Waiter waiterForUEvent(UEvent*);
+Result waitObjects(s32*, const Waiter*, s32, u64); Result waitSingle(Waiter, u64);
+Result svcSleepThread(s64);
+
+// ticks are nanoseconds on the host.
+u64 armGetSystemTick(void); u64 armGetSystemTickFreq(void); u64 armTicksToNs(u64); u64 armNsToTicks(u64);
+
+// crypto, backed by openssl in switch.cpp.
+typedef struct { u8 state[0x100]; } Sha256Context;
+void sha256ContextCreate(Sha256Context*); void sha256ContextUpdate(Sha256Context*, const void*, size_t); void sha256ContextGetHash(Sha256Context*, void*); void sha256CalculateHash(void*, const void*, size_t);
+typedef struct { u8 key[0x10]; u8 ctr[0x10]; u8 enc_ctr[0x10]; u64 buffered; } Aes128CtrContext;
+typedef struct { u8 key[0x10]; bool is_encryptor; } Aes128Context;
+typedef struct { u8 key[0x20]; } Aes128XtsContext;
+void aes128CtrContextCreate(Aes128CtrContext*, const void*, const void*); void aes128CtrContextResetCtr(Aes128CtrContext*, const void*); void aes128CtrCrypt(Aes128CtrContext*, void*, const void*, size_t);
+void aes128ContextCreate(Aes128Context*, const void*, bool); void aes128EncryptBlock(const Aes128Context*, void*, const void*); void aes128DecryptBlock(const Aes128Context*, void*, const void*);
+void aes128XtsContextCreate(Aes128XtsContext*, const void*, const void*, bool); void aes128XtsContextResetSector(Aes128XtsContext*, u64, bool);
+size_t aes128XtsEncrypt(Aes128XtsContext*, void*, const void*, size_t); size_t aes128XtsDecrypt(Aes128XtsContext*, void*, const void*, size_t);
+
+Result fsdevGetLastResult(void);
+Result ncmContentStorageGetFreeSpaceSize(NcmContentStorage*, s64*);
+
+}
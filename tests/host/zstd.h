@@ -0,0 +1,38 @@
+/*
+* Notes:
+* - the parts of the zstd api used by install_core and the host tests,
+*   linked against the system's libzstd.so.1, as its headers may not be installed.
+* - prototypes match zstd 1.5.
+* - compression is only used by the tests, to make ncz data.
+*/
+
+#pragma once
+#include <stddef.h>
+#ifdef __cplusplus
+extern "C" {
+#endif
+typedef struct ZSTD_DCtx_s ZSTD_DCtx; typedef ZSTD_DCtx ZSTD_DStream;
+typedef struct ZSTD_CCtx_s ZSTD_CCtx; typedef ZSTD_CCtx ZSTD_CStream;
+typedef struct { const void* src; size_t size; size_t pos; } ZSTD_inBuffer;
+typedef struct { void* dst; size_t size; size_t pos; } ZSTD_outBuffer;
+unsigned ZSTD_isError(size_t); const char* ZSTD_getErrorName(size_t);
+
+ZSTD_DCtx* ZSTD_createDCtx(void); size_t ZSTD_freeDCtx(ZSTD_DCtx*);
+size_t ZSTD_DStreamOutSize(void); size_t ZSTD_DStreamInSize(void);
+size_t ZSTD_decompressStream(ZSTD_DStream*, ZSTD_outBuffer*, ZSTD_inBuffer*);
+size_t ZSTD_decompressDCtx(ZSTD_DCtx*, void*, size_t, const void*, size_t);
+typedef enum { ZSTD_reset_session_only = 1, ZSTD_reset_parameters = 2, ZSTD_reset_session_and_parameters = 3 } ZSTD_ResetDirective;
+size_t ZSTD_DCtx_reset(ZSTD_DCtx*, ZSTD_ResetDirective);
+#define ZSTD_CONTENTSIZE_UNKNOWN (0ULL - 1)
+#define ZSTD_CONTENTSIZE_ERROR   (0ULL - 2)
+unsigned long long ZSTD_getFrameContentSize(const void*, size_t);
+
+ZSTD_CCtx* ZSTD_createCCtx(void); size_t ZSTD_freeCCtx(ZSTD_CCtx*);
+size_t ZSTD_compressBound(size_t);
+size_t ZSTD_compress(void*, size_t, const void*, size_t, int);
+size_t ZSTD_decompress(void*, size_t, const void*, size_t);
+typedef enum { ZSTD_e_continue = 0, ZSTD_e_flush = 1, ZSTD_e_end = 2 } ZSTD_EndDirective;
+size_t ZSTD_compressStream2(ZSTD_CCtx*, ZSTD_outBuffer*, ZSTD_inBuffer*, ZSTD_EndDirective);
+#ifdef __cplusplus
+}
+#endif
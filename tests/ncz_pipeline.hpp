@@ -0,0 +1,293 @@
+/*
+* Notes:
+* - builds synthetic ncz bodies (the data after the nca header) and runs the
+*   decompress stage over them, used by the decompress tests and benchmarks.
+* - a reader thread stands in for the read stage and a single writer thread
+*   for the hash + write stages, collecting the output.
+* - the nca header is not part of the body, the pipeline starts as if the
+*   decompress thread had already passed it on.
+*/
+
+#pragma once
+
+#include "yati/decompress.hpp"
+#include "yati/nx/nca.hpp"
+
+#include <chrono>
+#include <cstring>
+#include <random>
+#include <thread>
+#include <vector>
+
+namespace sphaira::test {
+
+// nca offset the body starts at.
+constexpr u64 BODY_OFFSET = 0x4000;
+// source offset of the compressed data, past the ncz headers.
+constexpr u64 SOURCE_OFFSET = 0x4000 + 0x1000;
+
+struct NczBody {
+    // the body once decompressed, before re-encrypting.
+    std::vector<u8> plain{};
+    // the body as read from the source.
+    std::vector<u8> source{};
+    std::vector<ncz::Section> sections{};
+    ncz::BlockHeader block_header{};
+    std::vector<ncz::BlockInfo> blocks{};
+
+    auto IsCrypted() const -> bool {
+        for (auto& e : sections) {
+            if (e.crypto_type >= nca::EncryptionType_AesCtr) {
+                return true;
+            }
+        }
+        return false;
+    }
+
+    // what the pipeline should output.
+    auto Expected() const -> std::vector<u8> {
+        auto out = plain;
+        yati::CryptNczSections(sections, out.data(), out.size(), BODY_OFFSET);
+        return out;
+    }
+};
+
+// bytes from a small alphabet, which compress to about half their size.
+inline auto MakeData(u64 size, u64 seed) -> std::vector<u8> {
+    std::mt19937_64 rng{seed};
+    std::vector<u8> out(size);
+    for (auto& e : out) e = 'a' + rng() % 16;
+    return out;
+}
+
+inline auto MakeRandom(u64 size, u64 seed) -> std::vector<u8> {
+    std::mt19937_64 rng{seed};
+    std::vector<u8> out(size);
+    for (auto& e : out) e = rng();
+    return out;
+}
+
+// a single section covering the whole body.
+inline void SetSection(NczBody& body, bool crypt) {
+    std::mt19937_64 rng{0x534543};
+    ncz::Section section{};
+    section.offset = BODY_OFFSET;
+    section.size = body.plain.size();
+    section.crypto_type = crypt ? nca::EncryptionType_AesCtr : nca::EncryptionType_None;
+    for (auto& e : section.key) e = rng();
+    for (auto& e : section.counter) e = rng();
+    body.sections = {section};
+}
+
+// a plain nca body, passed through as is.
+inline auto MakePlain(std::vector<u8> plain) -> NczBody {
+    NczBody body{};
+    body.source = plain;
+    body.plain = std::move(plain);
+    return body;
+}
+
+// one zstd frame, flushed every flush_size bytes (as a streaming
+// compressor may do), so zstd blocks need not line up with the output buffers.
+inline auto MakeSolid(std::vector<u8> plain, bool crypt, u64 flush_size = 0) -> NczBody {
+    NczBody body{};
+    body.plain = std::move(plain);
+    SetSection(body, crypt);
+
+    auto cctx = ZSTD_createCCtx();
+    body.source.resize(ZSTD_compressBound(body.plain.size()) + 1024 * 64);
+    ZSTD_outBuffer output{body.source.data(), body.source.size(), 0};
+
+    const auto step = flush_size ? flush_size : body.plain.size();
+    for (u64 off = 0; off < body.plain.size(); off += step) {
+        const auto size = std::min<u64>(step, body.plain.size() - off);
+        const auto last = off + size == body.plain.size();
+        ZSTD_inBuffer input{body.plain.data() + off, size, 0};
+        while (true) {
+            const auto rc = ZSTD_compressStream2(cctx, &output, &input, last ? ZSTD_e_end : ZSTD_e_flush);
+            if (!rc || ZSTD_isError(rc)) {
+                break;
+            }
+        }
+    }
+
+    ZSTD_freeCCtx(cctx);
+    body.source.resize(output.pos);
+    return body;
+}
+
+// every block is its own zstd frame, blocks that don't compress are stored,
+// as nsz does. if stored is set, every block is stored.
+inline auto MakeBlocks(std::vector<u8> plain, bool crypt, u8 exponent, bool stored = false) -> NczBody {
+    NczBody body{};
+    body.plain = std::move(plain);
+    SetSection(body, crypt);
+
+    const u64 block_size = 1ULL << exponent;
+    body.block_header.magic = NCZ_BLOCK_MAGIC;
+    body.block_header.version = 2;
+    body.block_header.type = 1;
+    body.block_header.block_size_exponent = exponent;
+    body.block_header.total_blocks = (body.plain.size() + block_size - 1) / block_size;
+    body.block_header.decompressed_size = body.plain.size();
+
+    std::vector<u8> compressed(ZSTD_compressBound(block_size));
+    for (u64 off = 0; off < body.plain.size(); off += block_size) {
+        const auto size = std::min<u64>(block_size, body.plain.size() - off);
+        auto rc = stored ? size : ZSTD_compress(compressed.data(), compressed.size(), body.plain.data() + off, size, 1);
+        if (stored || ZSTD_isError(rc) || rc >= size) {
+            rc = size;
+            body.source.insert(body.source.end(), body.plain.begin() + off, body.plain.begin() + off + size);
+        } else {
+            body.source.insert(body.source.end(), compressed.begin(), compressed.begin() + rc);
+        }
+        body.blocks.push_back({SOURCE_OFFSET + body.source.size() - rc, rc});
+    }
+
+    return body;
+}
+
+// sets up the parts of the pipeline that NczBlockDecompressor reads.
+inline void SetBlocks(yati::PipelineData& t, const NczBody& body) {
+    t.ncz_sections = body.sections;
+    t.ncz_block_header = body.block_header;
+    t.ncz_blocks = body.blocks;
+    t.decompress_offset = BODY_OFFSET;
+    t.push_offset = BODY_OFFSET;
+}
+
+// feeds the body to the block decompressor in read_size pieces, returning the output in order.
+inline auto RunBlocks(yati::ThreadPool& pool, yati::PipelineData& t, const NczBody& body, u32 workers, u64 read_size, std::vector<u8>& out) -> Result {
+    yati::NczBlockDecompressor decompressor{&pool, yati::Placement{}, &t, workers};
+    const auto on_output = [&](yati::PooledBuffer& buf) -> Result {
+        out.insert(out.end(), buf.data(), buf.data() + buf.size());
+        buf.Release();
+        R_SUCCEED();
+    };
+
+    for (u64 off = 0; off < body.source.size(); off += read_size) {
+        const auto size = std::min<u64>(read_size, body.source.size() - off);
+        R_TRY(decompressor.Feed(std::span{body.source.data() + off, size}, on_output));
+    }
+
+    return decompressor.Finish(on_output);
+}
+
+struct RunConfig {
+    yati::NcaMode mode{};
+    // output goes through the hash thread.
+    bool hash{};
+    // crypt + hash on the decompress thread.
+    bool fused{};
+    // size of each source read.
+    u64 read_size{1024 * 1024 * 4};
+    // workers used to crypt / decompress blocks.
+    u32 workers{1};
+    // collect the output, benchmarks skip the copy.
+    bool keep_output{true};
+};
+
+struct RunResult {
+    Result rc{};
+    std::vector<u8> out{};
+    u64 out_size{};
+    u8 hash[SHA256_HASH_SIZE]{};
+    // bytes memcpy'd by the decompress stage.
+    u64 copied{};
+    double seconds{};
+};
+
+// runs the decompress stage over the body, as decompressFuncInternal does after the nca header.
+inline auto RunDecompress(yati::ThreadPool& pool, const NczBody& body, const RunConfig& config) -> RunResult {
+    RunResult result{};
+
+    const auto hash = config.hash || config.fused;
+    yati::PipelineData t{hash, static_cast<s64>(BODY_OFFSET + body.plain.size())};
+    if (config.mode != yati::NcaMode::Plain) {
+        t.ncz_sections = body.sections;
+    }
+    if (config.mode == yati::NcaMode::NczBlock || config.mode == yati::NcaMode::NczBlockParallel) {
+        t.ncz_block_header = body.block_header;
+        t.ncz_blocks = body.blocks;
+    }
+    t.dctx = ZSTD_createDCtx();
+    // keep within the pool's default cap, as the install's reservation would.
+    t.read_buffers.SetCapacity(yati::tuner::DEFAULT_DEPTH);
+    t.write_buffers.SetCapacity(yati::tuner::DEFAULT_DEPTH);
+    t.decompress_offset = BODY_OFFSET;
+    t.push_offset = BODY_OFFSET;
+
+    yati::DecompressState s{};
+    s.written = BODY_OFFSET;
+
+    const auto crypt = config.mode != yati::NcaMode::Plain && body.IsCrypted();
+    if (config.mode == yati::NcaMode::NczBlockParallel) {
+        s.block_decompressor = std::make_unique<yati::NczBlockDecompressor>(&pool, yati::Placement{}, &t, config.workers);
+    } else if (crypt && !config.fused) {
+        s.ctr_crypter = std::make_unique<yati::NczCtrCrypter>(&pool, yati::Placement{}, t.ncz_sections, config.workers);
+    }
+
+    const auto start = std::chrono::steady_clock::now();
+
+    std::thread reader{[&]{
+        for (u64 off = 0; off < body.source.size(); off += config.read_size) {
+            const auto size = std::min<u64>(config.read_size, body.source.size() - off);
+            yati::ThreadBuffer tbuf{};
+            if (R_FAILED(yati::pool::Acquire(tbuf.buf))) {
+                break;
+            }
+            std::memcpy(tbuf.buf.data(), body.source.data() + off, size);
+            tbuf.buf.resize(size);
+            tbuf.off = SOURCE_OFFSET + off;
+            if (R_FAILED(t.PushDecompressBuf(tbuf))) {
+                break;
+            }
+        }
+        t.read_buffers.Close();
+    }};
+
+    std::thread writer{[&]{
+        Sha256Context sha{};
+        sha256ContextCreate(&sha);
+
+        const auto hash_thread = config.hash && !config.fused;
+        yati::ThreadBuffer tbuf{};
+        while (hash_thread ? t.hash_buffers.Pop(tbuf) : t.write_buffers.Pop(tbuf)) {
+            if (hash_thread) {
+                sha256ContextUpdate(&sha, tbuf.data(), tbuf.size());
+            }
+            if (config.keep_output) {
+                result.out.insert(result.out.end(), tbuf.data(), tbuf.data() + tbuf.size());
+            }
+            result.out_size += tbuf.size();
+            tbuf.buf.Release();
+            tbuf.start = 0;
+        }
+
+        if (config.fused) {
+            sha256ContextGetHash(&t.sha256, result.hash);
+        } else {
+            sha256ContextGetHash(&sha, result.hash);
+        }
+    }};
+
+    result.rc = yati::DecompressNca(&t, s, config.mode, crypt, config.fused);
+    // as decompressFuncInternal does on exit, the write ring is closed by
+    // the hash thread in an install, which fused output skips.
+    t.read_buffers.Close();
+    t.CloseDecompressOutput();
+    t.write_buffers.Close();
+
+    reader.join();
+    writer.join();
+
+    const std::chrono::duration<double> taken = std::chrono::steady_clock::now() - start;
+    result.seconds = taken.count();
+    result.copied = t.copied_size;
+
+    s = {};
+    ZSTD_freeDCtx(t.dctx);
+    return result;
+}
+
+} // namespace sphaira::test
@@ -0,0 +1,24 @@
+/*
+* Notes:
+* - minimal checks for the host tests, every test is its own executable
+*   and returns non-zero if any check failed.
+*/
+
+#pragma once
+
+#include <cstdio>
+
+namespace sphaira::test {
+
+inline int g_failed{};
+
+} // namespace sphaira::test
+
+#define TEST_CHECK(cond) do { \
+    if (!(cond)) { \
+        std::printf("%s:%d: check failed: %s\n", __FILE__, __LINE__, #cond); \
+        sphaira::test::g_failed++; \
+    } \
+} while (0)
+
+#define TEST_RESULT() (sphaira::test::g_failed ? (std::printf("FAILED: %d checks\n", sphaira::test::g_failed), 1) : (std::printf("OK\n"), 0))
@@ -0,0 +1,96 @@
+// checks that the fused crypt + hash gives the same bytes and the same hash
+// as crypting first and hashing the output in a second pass.
+
+#include "test.hpp"
+#include "yati/ncz_crypt.hpp"
+#include "yati/nx/nca.hpp"
+#include "yati/nx/crypto.hpp"
+
+#include <cstring>
+#include <initializer_list>
+#include <random>
+#include <vector>
+
+namespace {
+
+using namespace sphaira;
+
+struct Hash {
+    u8 data[SHA256_HASH_SIZE]{};
+    auto operator==(const Hash& v) const -> bool { return !std::memcmp(data, v.data, sizeof(data)); }
+};
+
+void TestCtr(const std::vector<u8>& plain, const u8* key, const u8* counter, u64 offset, u64 size) {
+    std::vector<u8> fused(plain.begin(), plain.begin() + size);
+    std::vector<u8> separate{fused};
+
+    Hash fused_hash{}, separate_hash{};
+
+    Sha256Context sha{};
+    sha256ContextCreate(&sha);
+    crypto::cryptoAes128CtrSha256(fused.data(), fused.data(), key, counter, offset, size, &sha);
+    sha256ContextGetHash(&sha, fused_hash.data);
+
+    crypto::cryptoAes128Ctr(separate.data(), separate.data(), key, counter, offset, size);
+    sha256CalculateHash(separate_hash.data, separate.data(), size);
+
+    TEST_CHECK(fused == separate);
+    TEST_CHECK(fused_hash == separate_hash);
+}
+
+void TestSections(std::span<const ncz::Section> sections, const std::vector<u8>& plain, u64 start, u64 size) {
+    std::vector<u8> fused(plain.begin() + start, plain.begin() + start + size);
+    std::vector<u8> separate{fused};
+
+    Hash fused_hash{}, separate_hash{};
+
+    Sha256Context sha{};
+    sha256ContextCreate(&sha);
+    TEST_CHECK(R_SUCCEEDED(yati::CryptHashNczSections(sections, fused.data(), size, start, &sha)));
+    sha256ContextGetHash(&sha, fused_hash.data);
+
+    TEST_CHECK(R_SUCCEEDED(yati::CryptNczSections(sections, separate.data(), size, start)));
+    sha256CalculateHash(separate_hash.data, separate.data(), size);
+
+    TEST_CHECK(fused == separate);
+    TEST_CHECK(fused_hash == separate_hash);
+}
+
+} // namespace
+
+int main() {
+    std::mt19937_64 rng{0x534841};
+
+    std::vector<u8> plain(1024 * 1024 * 2 + 0x33);
+    for (auto& e : plain) e = rng();
+
+    u8 key[0x10], counter[0x10];
+    for (auto& e : key) e = rng();
+    for (auto& e : counter) e = rng();
+
+    // sizes around the tile size, with aligned and unaligned offsets.
+    constexpr auto TILE = crypto::CRYPT_HASH_TILE_SIZE;
+    for (const u64 offset : std::initializer_list<u64>{0, 0x7, 0x10, 0xC00FFEE}) {
+        for (const u64 size : std::initializer_list<u64>{0, 1, 0xF, 0x10, TILE - 1, TILE, TILE + 1, TILE * 3 + 0x9, plain.size()}) {
+            TestCtr(plain, key, counter, offset, size);
+        }
+    }
+
+    // a ctr section followed by an uncrypted one, which is only hashed.
+    const u64 split = 1024 * 1024 + 0x5;
+    ncz::Section sections[2]{};
+    sections[0].offset = 0;
+    sections[0].size = split;
+    sections[0].crypto_type = nca::EncryptionType_AesCtr;
+    std::memcpy(sections[0].key, key, sizeof(key));
+    std::memcpy(sections[0].counter, counter, sizeof(counter));
+    sections[1].offset = split;
+    sections[1].size = plain.size() - split;
+    sections[1].crypto_type = nca::EncryptionType_None;
+
+    TestSections(sections, plain, 0, plain.size());
+    TestSections(sections, plain, 0x3, split);
+    TestSections(sections, plain, split - TILE - 0x1, TILE * 2 + 0x11);
+
+    return TEST_RESULT();
+}
@@ -0,0 +1,95 @@
+// checks that every variant of the decompress loop outputs the same bytes
+// (and hash) as decompressing + crypting the body in a single pass.
+
+#include "test.hpp"
+#include "ncz_pipeline.hpp"
+
+#include <cstring>
+
+namespace {
+
+using namespace sphaira;
+using namespace sphaira::test;
+
+auto Hash(const std::vector<u8>& data) -> std::vector<u8> {
+    std::vector<u8> out(SHA256_HASH_SIZE);
+    sha256CalculateHash(out.data(), data.data(), data.size());
+    return out;
+}
+
+void Check(yati::ThreadPool& pool, const char* name, const NczBody& body, RunConfig config) {
+    const auto expected = body.Expected();
+    const auto result = RunDecompress(pool, body, config);
+
+    const auto ok = R_SUCCEEDED(result.rc) && result.out == expected;
+    if (!ok) {
+        std::printf("%s: rc: 0x%X size: %zu expected: %zu\n", name, result.rc, result.out.size(), expected.size());
+    }
+    TEST_CHECK(ok);
+
+    if (config.hash || config.fused) {
+        TEST_CHECK(!std::memcmp(result.hash, Hash(expected).data(), SHA256_HASH_SIZE));
+    }
+}
+
+void CheckAll(yati::ThreadPool& pool, const char* name, const NczBody& body, yati::NcaMode mode) {
+    for (const auto hash : {false, true}) {
+        for (const auto read_size : {1024ULL * 1024 * 4, 1024ULL * 300}) {
+            Check(pool, name, body, {.mode = mode, .hash = hash, .read_size = read_size});
+        }
+    }
+
+    if (body.IsCrypted() && mode != yati::NcaMode::NczBlockParallel) {
+        Check(pool, name, body, {.mode = mode, .hash = true, .fused = true});
+        Check(pool, name, body, {.mode = mode, .hash = true, .fused = true, .read_size = 1024 * 300});
+    }
+}
+
+} // namespace
+
+int main() {
+    yati::ThreadPool pool{};
+    TEST_CHECK(R_SUCCEEDED(pool.Create(3, 1024 * 128)));
+
+    constexpr u64 SIZE = 1024 * 1024 * 9 + 12345;
+    const auto data = MakeData(SIZE, 1);
+
+    CheckAll(pool, "plain", MakePlain(data), yati::NcaMode::Plain);
+
+    for (const auto crypt : {false, true}) {
+        CheckAll(pool, "solid", MakeSolid(data, crypt), yati::NcaMode::NczSolid);
+        CheckAll(pool, "solid flushed", MakeSolid(data, crypt, 1024 * 100), yati::NcaMode::NczSolid);
+
+        const auto blocks = MakeBlocks(data, crypt, 20);
+        CheckAll(pool, "block", blocks, yati::NcaMode::NczBlock);
+        CheckAll(pool, "block parallel", blocks, yati::NcaMode::NczBlockParallel);
+
+        const auto stored = MakeBlocks(data, crypt, 20, true);
+        CheckAll(pool, "stored", stored, yati::NcaMode::NczBlock);
+        CheckAll(pool, "stored parallel", stored, yati::NcaMode::NczBlockParallel);
+
+        // random blocks don't compress, so compressed and stored blocks share read buffers.
+        auto mixed_data = data;
+        const auto random = MakeRandom(1024 * 1024 * 3, 2);
+        std::memcpy(mixed_data.data() + 1024 * 1024 * 2, random.data(), random.size());
+        const auto mixed = MakeBlocks(mixed_data, crypt, 17);
+        CheckAll(pool, "mixed", mixed, yati::NcaMode::NczBlock);
+        CheckAll(pool, "mixed parallel", mixed, yati::NcaMode::NczBlockParallel);
+    }
+
+    // the last zstd block crosses the 4MiB inflate buffer, so zstd may still
+    // hold output once the last of the input has been consumed.
+    for (const auto crypt : {false, true}) {
+        CheckAll(pool, "solid drain", MakeSolid(MakeData(100000 * 42, 3), crypt, 100000), yati::NcaMode::NczSolid);
+        CheckAll(pool, "block drain", MakeBlocks(MakeData(1024 * 1024 * 4 + 70000, 3), crypt, 22), yati::NcaMode::NczBlock);
+    }
+
+    // a corrupt frame is reported, rather than passed on.
+    auto corrupt = MakeSolid(data, false);
+    corrupt.source[corrupt.source.size() / 2] ^= 0xFF;
+    corrupt.source[corrupt.source.size() / 2 + 1] ^= 0xFF;
+    const auto result = RunDecompress(pool, corrupt, {.mode = yati::NcaMode::NczSolid});
+    TEST_CHECK(R_FAILED(result.rc) || result.out != corrupt.Expected());
+
+    return TEST_RESULT();
+}
@@ -0,0 +1,250 @@
+// checks that cancelling an install stream wakes a blocked reader or writer
+// within CANCEL_LATENCY, rather than after the idle timeout.
+// also checks that data comes out in order and intact, however it is pushed and
+// read, through the memory queue and through the spill file.
+
+#include "test.hpp"
+#include "install_stream.hpp"
+#include "ui/progress_box.hpp"
+#include "defines.hpp"
+
+#include <chrono>
+#include <cstring>
+#include <filesystem>
+#include <random>
+#include <thread>
+#include <vector>
+
+namespace {
+
+using namespace sphaira;
+using Clock = std::chrono::steady_clock;
+
+constexpr auto CANCEL_LATENCY = std::chrono::milliseconds{50};
+// how long the blocked side is left waiting before cancelling.
+constexpr auto BLOCK_TIME = std::chrono::milliseconds{20};
+
+// runs func on a thread, cancels once it has blocked, returns how long func took to return after the cancel.
+template<typename F, typename C>
+auto TimeCancel(F&& func, C&& cancel) -> Clock::duration {
+    Clock::time_point returned{};
+    std::thread thread{[&]{
+        func();
+        returned = Clock::now();
+    }};
+
+    std::this_thread::sleep_for(BLOCK_TIME);
+    TEST_CHECK(returned == Clock::time_point{});
+
+    const auto cancelled = Clock::now();
+    cancel();
+    thread.join();
+    return returned - cancelled;
+}
+
+void TestReadChunk() {
+    mtp::InstallStream stream{"/test/read.nsp"};
+    TEST_CHECK(stream.IsReserved());
+
+    Result rc{};
+    const auto latency = TimeCancel([&]{
+        u8 buf[0x100];
+        u64 bytes_read{};
+        rc = stream.ReadChunk(buf, sizeof(buf), &bytes_read);
+    }, [&]{ stream.SignalCancel(); });
+
+    TEST_CHECK(rc == Result_TransferCancelled);
+    TEST_CHECK(latency < CANCEL_LATENCY);
+
+    // later reads fail straight away.
+    u8 buf[0x100];
+    u64 bytes_read{};
+    TEST_CHECK(stream.ReadChunk(buf, sizeof(buf), &bytes_read) == Result_TransferCancelled);
+}
+
+void TestTakeChunk() {
+    mtp::InstallStream stream{"/test/take.nsp"};
+    TEST_CHECK(stream.IsReserved());
+
+    Result rc{};
+    const auto latency = TimeCancel([&]{
+        yati::PooledBuffer buf{};
+        rc = stream.TakeChunk(buf, mtp::InstallStream::CHUNK_SIZE);
+    }, [&]{ stream.SignalCancel(); });
+
+    TEST_CHECK(rc == Result_TransferCancelled);
+    TEST_CHECK(latency < CANCEL_LATENCY);
+}
+
+// the writer blocks once the queue is full and nothing is reading.
+void TestPushFull() {
+    mtp::InstallStream stream{"/test/push.nsp", 1};
+    TEST_CHECK(stream.IsReserved());
+
+    std::vector<u8> data(mtp::InstallStream::CHUNK_SIZE * 4);
+    bool ok{};
+    const auto latency = TimeCancel([&]{
+        ok = stream.Push(data.data(), data.size());
+    }, [&]{ stream.SignalCancel(); });
+
+    // data pushed after a cancel is dropped, not reported as an error to mtp.
+    TEST_CHECK(ok);
+    TEST_CHECK(latency < CANCEL_LATENCY);
+}
+
+// the install thread waits on the progress box cancel event alongside the stages.
+void TestProgressBox() {
+    ui::ProgressBox pbox{};
+    TEST_CHECK(R_SUCCEEDED(pbox.ShouldExitResult()));
+
+    Result rc{1};
+    const auto latency = TimeCancel([&]{
+        rc = waitSingle(waiterForUEvent(pbox.GetCancelEvent()), UINT64_MAX);
+    }, [&]{ pbox.RequestExit(); });
+
+    TEST_CHECK(R_SUCCEEDED(rc));
+    TEST_CHECK(latency < CANCEL_LATENCY);
+    TEST_CHECK(pbox.ShouldExitResult() == Result_TransferCancelled);
+
+    // not autoclear, so every nca waiting on it sees the cancel.
+    TEST_CHECK(R_SUCCEEDED(waitSingle(waiterForUEvent(pbox.GetCancelEvent()), 0)));
+
+    // a session closing is not a user cancel, so yati keeps what can be resumed.
+    ui::ProgressBox closed{};
+    closed.RequestExit(Result_StreamSessionClosed);
+    TEST_CHECK(closed.ShouldExitResult() == Result_StreamSessionClosed);
+}
+
+// the buffers held by a stream go back to the pool once it is destroyed.
+void TestRelease() {
+    const auto before = yati::pool::GetStats();
+    {
+        mtp::InstallStream stream{"/test/release.nsp"};
+        std::vector<u8> data(mtp::InstallStream::CHUNK_SIZE + 1);
+        TEST_CHECK(stream.Push(data.data(), data.size()));
+        stream.SignalCancel();
+    }
+    const auto after = yati::pool::GetStats();
+    TEST_CHECK(after.in_use == before.in_use);
+    TEST_CHECK(after.reserved == before.reserved);
+}
+
+auto MakeData(u64 size) -> std::vector<u8> {
+    std::mt19937_64 rng{size};
+    std::vector<u8> out(size);
+    for (auto& e : out) e = rng();
+    return out;
+}
+
+// pushes data in random sizes (up to max_push) on a thread, as mtp would.
+auto PushAll(mtp::InstallStream& stream, const std::vector<u8>& data, u64 max_push) -> std::thread {
+    return std::thread{[&stream, &data, max_push]{
+        std::mt19937_64 rng{max_push};
+        for (u64 off = 0; off < data.size();) {
+            const auto size = std::min<u64>(1 + rng() % max_push, data.size() - off);
+            TEST_CHECK(stream.Push(data.data() + off, size));
+            off += size;
+        }
+        stream.Close();
+    }};
+}
+
+// reads until eof, as the yati read thread does, taking whole chunks when it
+// can and copying odd sized reads otherwise. delay slows the reader down.
+auto ReadAll(mtp::InstallStream& stream, u64 seed, std::chrono::microseconds delay = {}) -> std::vector<u8> {
+    std::mt19937_64 rng{seed};
+    std::vector<u8> out{};
+    std::vector<u8> buf(mtp::InstallStream::CHUNK_SIZE * 2);
+
+    while (true) {
+        std::this_thread::sleep_for(delay);
+
+        if (rng() % 2) {
+            yati::PooledBuffer chunk{};
+            TEST_CHECK(R_SUCCEEDED(stream.TakeChunk(chunk, mtp::InstallStream::CHUNK_SIZE)));
+            if (!chunk.empty()) {
+                out.insert(out.end(), chunk.data(), chunk.data() + chunk.size());
+                continue;
+            }
+        }
+
+        // sizes that cross chunk boundaries.
+        const auto size = 1 + rng() % buf.size();
+        u64 bytes_read{};
+        TEST_CHECK(R_SUCCEEDED(stream.ReadChunk(buf.data(), size, &bytes_read)));
+        if (!bytes_read) {
+            break;
+        }
+        out.insert(out.end(), buf.data(), buf.data() + bytes_read);
+    }
+
+    return out;
+}
+
+void TestOrder() {
+    const auto data = MakeData(mtp::InstallStream::CHUNK_SIZE * 12 + 12345);
+
+    for (const u64 max_push : {u64{0x1000}, u64{0x80000}, mtp::InstallStream::CHUNK_SIZE * 3}) {
+        for (const auto depth : {1U, 2U, mtp::InstallStream::MAX_QUEUE_DEPTH}) {
+            mtp::InstallStream stream{"/test/order.nsp", depth};
+            TEST_CHECK(stream.IsReserved());
+
+            auto writer = PushAll(stream, data, max_push);
+            const auto out = ReadAll(stream, max_push + depth);
+            writer.join();
+
+            TEST_CHECK(out == data);
+            const auto stats = stream.GetStats();
+            TEST_CHECK(stats.pushed == data.size());
+            TEST_CHECK(stats.copied + stats.handed == data.size());
+            TEST_CHECK(!stats.spilled);
+        }
+    }
+}
+
+// a slow reader makes the writer spill, the file is small enough that the
+// writer has to wait for it to drain and then reuse it from the start.
+void TestSpill() {
+    constexpr u64 SPILL_LIMIT = mtp::InstallStream::CHUNK_SIZE * 3;
+    const auto data = MakeData(mtp::InstallStream::CHUNK_SIZE * 20 + 777);
+
+    mtp::InstallStream stream{"/test/spill.nsp", 1, SPILL_LIMIT};
+    TEST_CHECK(stream.IsReserved());
+    TEST_CHECK(std::filesystem::exists(stream.GetSpillPath().s));
+
+    auto writer = PushAll(stream, data, 0x80000);
+    const auto out = ReadAll(stream, 1, std::chrono::microseconds{2000});
+    writer.join();
+
+    TEST_CHECK(out == data);
+    const auto stats = stream.GetStats();
+    TEST_CHECK(stats.copied + stats.handed == data.size());
+    // more went through the file than fits in it, so it was reused.
+    TEST_CHECK(stats.spilled > SPILL_LIMIT);
+    TEST_CHECK(std::filesystem::file_size(stream.GetSpillPath().s) <= SPILL_LIMIT);
+}
+
+// the spill file is removed along with the stream.
+void TestSpillRemoved() {
+    fs::FsPath path{};
+    {
+        mtp::InstallStream stream{"/test/spill_removed.nsp", 1, mtp::InstallStream::CHUNK_SIZE};
+        path = stream.GetSpillPath();
+        TEST_CHECK(std::filesystem::exists(path.s));
+    }
+    TEST_CHECK(!std::filesystem::exists(path.s));
+}
+
+} // namespace
+
+int main() {
+    TestReadChunk();
+    TestTakeChunk();
+    TestPushFull();
+    TestProgressBox();
+    TestRelease();
+    TestOrder();
+    TestSpill();
+    TestSpillRemoved();
+    return TEST_RESULT();
+}
@@ -0,0 +1,410 @@
+// checks that an interrupted install can be resumed from its journal entry,
+// giving the same placeholder bytes and hash as an uninterrupted install,
+// and that entries which don't match or are damaged are not resumed.
+// also checks that stale entries are pruned by age and size budget.
+// placeholders are backed by files, standing in for ncm.
+
+#include "test.hpp"
+#include "yati/journal.hpp"
+#include "defines.hpp"
+
+#include <algorithm>
+#include <cstring>
+#include <ctime>
+#include <filesystem>
+#include <fstream>
+#include <random>
+#include <string>
+#include <vector>
+#include <unistd.h>
+
+namespace {
+
+using namespace sphaira;
+namespace journal = yati::journal;
+
+std::filesystem::path g_root{};
+
+auto PlaceHolderPath(const NcmPlaceHolderId* id) -> std::filesystem::path {
+    std::string name{};
+    for (auto c : id->c) {
+        char hex[3];
+        std::snprintf(hex, sizeof(hex), "%02x", c);
+        name += hex;
+    }
+    return g_root / "placeholder" / name;
+}
+
+} // namespace
+
+// file backed stand-in for the ncm placeholder calls.
+extern "C" {
+
+Result ncmContentStorageGeneratePlaceHolderId(NcmContentStorage*, NcmPlaceHolderId* out) {
+    static std::mt19937_64 rng{std::random_device{}()};
+    for (auto& c : out->c) c = rng();
+    return 0;
+}
+
+Result ncmContentStorageCreatePlaceHolder(NcmContentStorage*, const NcmContentId*, const NcmPlaceHolderId* id, s64 size) {
+    std::filesystem::create_directories(PlaceHolderPath(id).parent_path());
+    std::ofstream f{PlaceHolderPath(id), std::ios::binary | std::ios::trunc};
+    if (!f) {
+        return 1;
+    }
+    std::filesystem::resize_file(PlaceHolderPath(id), size);
+    return 0;
+}
+
+Result ncmContentStorageWritePlaceHolder(NcmContentStorage*, const NcmPlaceHolderId* id, u64 offset, const void* buf, size_t size) {
+    std::fstream f{PlaceHolderPath(id), std::ios::binary | std::ios::in | std::ios::out};
+    if (!f) {
+        return 1;
+    }
+    f.seekp(offset);
+    f.write(static_cast<const char*>(buf), size);
+    return f ? 0 : 1;
+}
+
+Result ncmContentStorageHasPlaceHolder(NcmContentStorage*, bool* out, const NcmPlaceHolderId* id) {
+    *out = std::filesystem::exists(PlaceHolderPath(id));
+    return 0;
+}
+
+Result ncmContentStorageDeletePlaceHolder(NcmContentStorage*, const NcmPlaceHolderId* id) {
+    std::filesystem::remove(PlaceHolderPath(id));
+    return 0;
+}
+
+Result ncmContentStorageFlushPlaceHolder(NcmContentStorage*) {
+    return 0;
+}
+
+} // extern "C"
+
+namespace {
+
+constexpr s64 CHUNK_SIZE = 1024 * 256;
+constexpr u32 FLAGS = journal::Flag_HasHash | journal::Flag_LowerMasterKey;
+
+struct Install {
+    NcmContentStorage cs{};
+    NcmContentId content_id{};
+    journal::Target target{};
+    std::string dir{};
+
+    // offset the last run started from.
+    s64 resumed_from{};
+    u8 hash[SHA256_HASH_SIZE]{};
+
+    // same flow as Yati::InstallNca, stopping once stop_at bytes have been written.
+    Result Run(const std::vector<u8>& data, s64 stop_at) {
+        journal::Entry entry{};
+        bool resume{};
+        if (R_SUCCEEDED(journal::Load(content_id, entry, dir.c_str()))) {
+            bool has{};
+            ncmContentStorageHasPlaceHolder(&cs, &has, &entry.placeholder_id);
+            resume = journal::CanResume(entry, target, has);
+            if (!resume) {
+                ncmContentStorageDeletePlaceHolder(&cs, &entry.placeholder_id);
+                journal::Remove(content_id, dir.c_str());
+            }
+        }
+
+        Sha256Context sha{};
+        if (resume) {
+            sha = entry.sha256;
+        } else {
+            entry = {};
+            entry.content_id = content_id;
+            R_TRY(ncmContentStorageGeneratePlaceHolderId(&cs, &entry.placeholder_id));
+            R_TRY(ncmContentStorageCreatePlaceHolder(&cs, &content_id, &entry.placeholder_id, data.size()));
+            entry.storage_id = target.storage_id;
+            entry.flags = target.flags;
+            entry.source_size = target.source_size;
+            entry.write_size = data.size();
+            sha256ContextCreate(&sha);
+        }
+
+        resumed_from = entry.written;
+        for (s64 off = entry.written; off < static_cast<s64>(data.size()); off += CHUNK_SIZE) {
+            if (off >= stop_at) {
+                return Result_TransferCancelled;
+            }
+
+            const auto size = std::min<s64>(CHUNK_SIZE, data.size() - off);
+            R_TRY(ncmContentStorageWritePlaceHolder(&cs, &entry.placeholder_id, off, data.data() + off, size));
+            sha256ContextUpdate(&sha, data.data() + off, size);
+
+            R_TRY(ncmContentStorageFlushPlaceHolder(&cs));
+            entry.written = off + size;
+            entry.sha256 = sha;
+            R_TRY(journal::Save(entry, dir.c_str()));
+        }
+
+        sha256ContextGetHash(&sha, hash);
+        journal::Remove(content_id, dir.c_str());
+        R_SUCCEED();
+    }
+
+    auto GetEntryPath() const -> std::filesystem::path {
+        std::string name{};
+        for (auto c : content_id.c) {
+            char hex[3];
+            std::snprintf(hex, sizeof(hex), "%02x", c);
+            name += hex;
+        }
+        return std::filesystem::path{dir} / (name + ".bin");
+    }
+};
+
+auto ReadFile(const std::filesystem::path& path) -> std::vector<u8> {
+    std::ifstream f{path, std::ios::binary};
+    return {std::istreambuf_iterator<char>{f}, {}};
+}
+
+void WriteFile(const std::filesystem::path& path, const std::vector<u8>& data) {
+    std::ofstream f{path, std::ios::binary | std::ios::trunc};
+    f.write(reinterpret_cast<const char*>(data.data()), data.size());
+}
+
+auto MakeInstall(const std::vector<u8>& data, u8 id) -> Install {
+    Install install{};
+    install.content_id.c[0] = id;
+    install.content_id.c[0xF] = 0xA5;
+    install.target = {static_cast<s64>(data.size()), NcmStorageId_SdCard, FLAGS};
+    install.dir = (g_root / "journal").string();
+    return install;
+}
+
+auto LoadEntry(const Install& install, journal::Entry& entry) -> Result {
+    return journal::Load(install.content_id, entry, install.dir.c_str());
+}
+
+void TestResume(const std::vector<u8>& data) {
+    u8 expected[SHA256_HASH_SIZE];
+    sha256CalculateHash(expected, data.data(), data.size());
+
+    auto install = MakeInstall(data, 1);
+    const s64 stop_at = CHUNK_SIZE * 5;
+    TEST_CHECK(install.Run(data, stop_at) == Result_TransferCancelled);
+
+    journal::Entry entry{};
+    TEST_CHECK(R_SUCCEEDED(LoadEntry(install, entry)));
+    TEST_CHECK(entry.written == stop_at);
+
+    TEST_CHECK(R_SUCCEEDED(install.Run(data, INT64_MAX)));
+    TEST_CHECK(install.resumed_from == stop_at);
+    TEST_CHECK(!std::memcmp(install.hash, expected, sizeof(expected)));
+    TEST_CHECK(ReadFile(PlaceHolderPath(&entry.placeholder_id)) == data);
+
+    // the entry is removed once complete.
+    TEST_CHECK(LoadEntry(install, entry) == Result_YatiJournalNotFound);
+}
+
+// the target changes between the interrupted and the next install.
+void TestTargetChanged(const std::vector<u8>& data, void(*change)(journal::Target&)) {
+    auto install = MakeInstall(data, 2);
+    TEST_CHECK(install.Run(data, CHUNK_SIZE * 3) == Result_TransferCancelled);
+
+    journal::Entry entry{};
+    TEST_CHECK(R_SUCCEEDED(LoadEntry(install, entry)));
+
+    journal::Target target{install.target};
+    change(target);
+    TEST_CHECK(!journal::CanResume(entry, target, true));
+    TEST_CHECK(journal::CanResume(entry, install.target, true));
+
+    // a mismatching entry starts again from 0, and still ends up correct.
+    install.target = target;
+    TEST_CHECK(R_SUCCEEDED(install.Run(data, INT64_MAX)));
+    TEST_CHECK(install.resumed_from == 0);
+
+    // the old placeholder was discarded.
+    bool has{};
+    ncmContentStorageHasPlaceHolder(nullptr, &has, &entry.placeholder_id);
+    TEST_CHECK(!has);
+}
+
+void TestMissingPlaceHolder(const std::vector<u8>& data) {
+    auto install = MakeInstall(data, 3);
+    TEST_CHECK(install.Run(data, CHUNK_SIZE * 2) == Result_TransferCancelled);
+
+    journal::Entry entry{};
+    TEST_CHECK(R_SUCCEEDED(LoadEntry(install, entry)));
+    ncmContentStorageDeletePlaceHolder(nullptr, &entry.placeholder_id);
+
+    TEST_CHECK(!journal::CanResume(entry, install.target, false));
+    TEST_CHECK(R_SUCCEEDED(install.Run(data, INT64_MAX)));
+    TEST_CHECK(install.resumed_from == 0);
+}
+
+// damages the saved entry, which then must fail to load.
+void TestDamaged(const std::vector<u8>& data, u8 id, void(*damage)(std::vector<u8>&)) {
+    auto install = MakeInstall(data, id);
+    TEST_CHECK(install.Run(data, CHUNK_SIZE * 2) == Result_TransferCancelled);
+
+    auto raw = ReadFile(install.GetEntryPath());
+    TEST_CHECK(raw.size() == sizeof(journal::Entry));
+    damage(raw);
+    WriteFile(install.GetEntryPath(), raw);
+
+    journal::Entry entry{};
+    TEST_CHECK(LoadEntry(install, entry) == Result_YatiJournalInvalid);
+
+    TEST_CHECK(R_SUCCEEDED(install.Run(data, INT64_MAX)));
+    TEST_CHECK(install.resumed_from == 0);
+}
+
+auto GetEntry(std::vector<u8>& raw) -> journal::Entry* {
+    return reinterpret_cast<journal::Entry*>(raw.data());
+}
+
+// saves an entry for id, written at now - age.
+auto SavePruneEntry(const std::string& dir, u8 id, s64 write_size, u64 now, u64 age) -> journal::Entry {
+    journal::Entry entry{};
+    entry.content_id.c[0] = id;
+    entry.placeholder_id.c[0] = id;
+    entry.storage_id = NcmStorageId_SdCard;
+    entry.write_size = write_size;
+    TEST_CHECK(R_SUCCEEDED(journal::Save(entry, dir.c_str())));
+
+    // Save() stamps the entry with the current time, move it back.
+    journal::Entry loaded{};
+    TEST_CHECK(R_SUCCEEDED(journal::Load(entry.content_id, loaded, dir.c_str())));
+    TEST_CHECK(loaded.saved_at >= now - 60 && loaded.saved_at <= now + 60);
+
+    Install install{};
+    install.content_id = entry.content_id;
+    install.dir = dir;
+    auto raw = ReadFile(install.GetEntryPath());
+    GetEntry(raw)->saved_at = now - age;
+    WriteFile(install.GetEntryPath(), raw);
+    return entry;
+}
+
+auto Has(const std::vector<journal::Entry>& entries, u8 id) -> bool {
+    return std::ranges::any_of(entries, [id](auto& e) { return e.content_id.c[0] == id; });
+}
+
+auto Exists(const std::string& dir, u8 id) -> bool {
+    NcmContentId content_id{};
+    content_id.c[0] = id;
+    journal::Entry entry{};
+    return R_SUCCEEDED(journal::Load(content_id, entry, dir.c_str()));
+}
+
+void TestPruneAge() {
+    const auto dir = (g_root / "prune_age").string();
+    const u64 now = std::time(nullptr);
+    constexpr u64 MAX_AGE = 100;
+
+    SavePruneEntry(dir, 1, 10, now, 0);
+    SavePruneEntry(dir, 2, 10, now, MAX_AGE);
+    SavePruneEntry(dir, 3, 10, now, MAX_AGE + 1);
+
+    const auto removed = journal::Prune(now, MAX_AGE, INT64_MAX, dir.c_str());
+    TEST_CHECK(removed.size() == 1 && Has(removed, 3));
+    TEST_CHECK(Exists(dir, 1) && Exists(dir, 2) && !Exists(dir, 3));
+
+    // nothing left to prune.
+    TEST_CHECK(journal::Prune(now, MAX_AGE, INT64_MAX, dir.c_str()).empty());
+}
+
+void TestPruneSize() {
+    const auto dir = (g_root / "prune_size").string();
+    const u64 now = std::time(nullptr);
+
+    // newest to oldest: 1, 2, 3, 4.
+    SavePruneEntry(dir, 3, 40, now, 30);
+    SavePruneEntry(dir, 1, 40, now, 10);
+    SavePruneEntry(dir, 4, 40, now, 40);
+    SavePruneEntry(dir, 2, 40, now, 20);
+
+    const auto removed = journal::Prune(now, UINT64_MAX, 100, dir.c_str());
+    TEST_CHECK(removed.size() == 2 && Has(removed, 3) && Has(removed, 4));
+    TEST_CHECK(Exists(dir, 1) && Exists(dir, 2) && !Exists(dir, 3) && !Exists(dir, 4));
+
+    // the newest entry is kept, even if it alone is over the budget.
+    const auto alone = journal::Prune(now, UINT64_MAX, 10, dir.c_str());
+    TEST_CHECK(alone.size() == 1 && Has(alone, 2));
+    TEST_CHECK(Exists(dir, 1));
+}
+
+// damaged entries are removed, along with their placeholder if it can still be read.
+void TestPruneDamaged() {
+    const auto dir = (g_root / "prune_damaged").string();
+    const u64 now = std::time(nullptr);
+
+    for (const u8 id : {1, 2, 3, 4}) {
+        SavePruneEntry(dir, id, 10, now, 0);
+    }
+
+    Install install{};
+    install.dir = dir;
+    const auto damage = [&](u8 id, void(*func)(std::vector<u8>&)) {
+        install.content_id = {};
+        install.content_id.c[0] = id;
+        auto raw = ReadFile(install.GetEntryPath());
+        func(raw);
+        WriteFile(install.GetEntryPath(), raw);
+    };
+
+    // an older version, a short file, and garbage.
+    damage(2, [](std::vector<u8>& raw) { GetEntry(raw)->version = 1; });
+    damage(3, [](std::vector<u8>& raw) { raw.resize(0x30); });
+    damage(4, [](std::vector<u8>& raw) { GetEntry(raw)->magic ^= 1; });
+    WriteFile(std::filesystem::path{dir} / "junk.bin", {1, 2, 3});
+
+    const auto removed = journal::Prune(now, UINT64_MAX, INT64_MAX, dir.c_str());
+    TEST_CHECK(removed.size() == 2 && Has(removed, 2) && Has(removed, 3));
+    TEST_CHECK(std::ranges::all_of(removed, [](auto& e) { return e.placeholder_id.c[0] == e.content_id.c[0]; }));
+    TEST_CHECK(Exists(dir, 1));
+
+    // every damaged file is gone.
+    u32 count{};
+    for ([[maybe_unused]] auto& e : std::filesystem::directory_iterator{dir}) {
+        count++;
+    }
+    TEST_CHECK(count == 1);
+}
+
+} // namespace
+
+int main() {
+    g_root = std::filesystem::temp_directory_path() / ("bbi_test_journal_" + std::to_string(getpid()));
+    std::filesystem::remove_all(g_root);
+
+    std::mt19937_64 rng{0x4A4E4C};
+    std::vector<u8> data(CHUNK_SIZE * 9 + 0x321);
+    for (auto& e : data) e = rng();
+
+    TestResume(data);
+
+    TestTargetChanged(data, [](journal::Target& t) { t.source_size++; });
+    TestTargetChanged(data, [](journal::Target& t) { t.storage_id = NcmStorageId_BuiltInUser; });
+    TestTargetChanged(data, [](journal::Target& t) { t.flags ^= journal::Flag_HasHash; });
+
+    TestMissingPlaceHolder(data);
+
+    TestDamaged(data, 4, [](std::vector<u8>& raw) { GetEntry(raw)->magic ^= 1; });
+    TestDamaged(data, 5, [](std::vector<u8>& raw) { GetEntry(raw)->version++; });
+    TestDamaged(data, 6, [](std::vector<u8>& raw) { GetEntry(raw)->content_id.c[0x7] ^= 1; });
+    TestDamaged(data, 7, [](std::vector<u8>& raw) { GetEntry(raw)->written = GetEntry(raw)->write_size + 1; });
+    TestDamaged(data, 8, [](std::vector<u8>& raw) { GetEntry(raw)->written = -1; });
+    TestDamaged(data, 9, [](std::vector<u8>& raw) { raw.resize(raw.size() - 1); });
+
+    // nothing saved for this id.
+    journal::Entry entry{};
+    TEST_CHECK(LoadEntry(MakeInstall(data, 10), entry) == Result_YatiJournalNotFound);
+
+    TestPruneAge();
+    TestPruneSize();
+    TestPruneDamaged();
+
+    // a missing folder has nothing to prune.
+    TEST_CHECK(journal::Prune(0, 0, 0, (g_root / "missing").string().c_str()).empty());
+
+    std::filesystem::remove_all(g_root);
+    return TEST_RESULT();
+}
@@ -0,0 +1,82 @@
+// checks that parallel block ncz output is the same as decompressing every
+// block serially, with workers finishing their jobs in a random order.
+
+#include "test.hpp"
+#include "ncz_pipeline.hpp"
+
+#include <chrono>
+#include <thread>
+
+namespace {
+
+using namespace sphaira;
+using namespace sphaira::test;
+
+// sleeps for a random time before every block, so that jobs complete out of order.
+struct ShuffledData final : yati::PipelineData {
+    ShuffledData() : PipelineData{false, 0} {}
+
+    auto GetResults() volatile -> Result override {
+        thread_local std::mt19937 rng{std::random_device{}()};
+        std::this_thread::sleep_for(std::chrono::microseconds(rng() % 2000));
+        return PipelineData::GetResults();
+    }
+};
+
+// decompresses every block on its own with ZSTD_decompress(), then crypts the lot.
+auto Serial(const NczBody& body) -> std::vector<u8> {
+    std::vector<u8> out(body.block_header.decompressed_size);
+    yati::PipelineData t{false, 0};
+    SetBlocks(t, body);
+
+    u64 out_off{};
+    for (u64 i = 0; i < body.blocks.size(); i++) {
+        const auto& block = body.blocks[i];
+        const auto src = body.source.data() + block.offset - SOURCE_OFFSET;
+        const auto size = t.GetNczBlockDecompressedSize(i);
+        if (block.size < size) {
+            TEST_CHECK(ZSTD_decompress(out.data() + out_off, size, src, block.size) == size);
+        } else {
+            std::memcpy(out.data() + out_off, src, size);
+        }
+        out_off += size;
+    }
+
+    yati::CryptNczSections(body.sections, out.data(), out.size(), BODY_OFFSET);
+    return out;
+}
+
+void Check(yati::ThreadPool& pool, const NczBody& body, u32 workers, u64 read_size) {
+    const auto expected = Serial(body);
+    TEST_CHECK(expected == body.Expected());
+
+    ShuffledData t{};
+    SetBlocks(t, body);
+    std::vector<u8> out{};
+    TEST_CHECK(R_SUCCEEDED(RunBlocks(pool, t, body, workers, read_size, out)));
+    TEST_CHECK(out == expected);
+}
+
+} // namespace
+
+int main() {
+    yati::ThreadPool pool{};
+    TEST_CHECK(R_SUCCEEDED(pool.Create(4, 1024 * 128)));
+
+    // random blocks are stored, so jobs mix stored and compressed blocks.
+    auto data = MakeData(1024 * 1024 * 9 + 4321, 1);
+    const auto random = MakeRandom(1024 * 1024, 2);
+    std::memcpy(data.data() + 1024 * 1024 * 3, random.data(), random.size());
+
+    for (const auto crypt : {false, true}) {
+        for (const auto exponent : {14, 16, 20}) {
+            const auto body = MakeBlocks(data, crypt, exponent);
+            for (const auto workers : {1, 2, 4}) {
+                Check(pool, body, workers, 1024 * 1024 * 4);
+                Check(pool, body, workers, 1024 * 100 + 7);
+            }
+        }
+    }
+
+    return TEST_RESULT();
+}
@@ -0,0 +1,106 @@
+// checks that sharded ncz re-encryption is byte identical to a single pass,
+// and that both match an independent aes-128-ctr built from the nca counter.
+
+#include "test.hpp"
+#include "yati/ncz_crypt.hpp"
+#include "yati/nx/nca.hpp"
+
+#include <openssl/evp.h>
+#include <cstring>
+#include <random>
+#include <vector>
+
+namespace {
+
+using namespace sphaira;
+
+auto MakeSection(u64 offset, u64 size, u64 crypto_type, std::mt19937_64& rng) -> ncz::Section {
+    ncz::Section section{};
+    section.offset = offset;
+    section.size = size;
+    section.crypto_type = crypto_type;
+    for (auto& e : section.key) e = rng();
+    for (auto& e : section.counter) e = rng();
+    return section;
+}
+
+// plain openssl aes-128-ctr, counter = upper 8 bytes of the section counter
+// followed by the big-endian block index of the nca offset.
+void ReferenceCrypt(std::span<const ncz::Section> sections, u8* data, u64 size, u64 offset) {
+    for (u64 off = 0; off < size; off++) {
+        const auto nca_offset = offset + off;
+        for (auto& section : sections) {
+            if (!section.InRange(nca_offset) || section.crypto_type < nca::EncryptionType_AesCtr) {
+                continue;
+            }
+
+            u8 iv[0x10];
+            std::memcpy(iv, section.counter, 0x8);
+            const auto block = __builtin_bswap64(nca_offset >> 4);
+            std::memcpy(iv + 0x8, &block, 0x8);
+
+            u8 stream[0x10]{};
+            int len{};
+            auto ctx = EVP_CIPHER_CTX_new();
+            EVP_EncryptInit_ex(ctx, EVP_aes_128_ctr(), nullptr, section.key, iv);
+            EVP_EncryptUpdate(ctx, stream, &len, stream, sizeof(stream));
+            EVP_CIPHER_CTX_free(ctx);
+
+            data[off] ^= stream[nca_offset & 0xF];
+        }
+    }
+}
+
+void TestRange(yati::ThreadPool& pool, std::span<const ncz::Section> sections, const std::vector<u8>& plain, u64 start, u64 size, u32 thread_count) {
+    std::vector<u8> single(plain.begin() + start, plain.begin() + start + size);
+    std::vector<u8> sharded{single};
+    std::vector<u8> reference{single};
+
+    TEST_CHECK(R_SUCCEEDED(yati::CryptNczSections(sections, single.data(), size, start)));
+
+    yati::NczCtrCrypter crypter{&pool, {}, sections, thread_count};
+    TEST_CHECK(R_SUCCEEDED(crypter.Crypt(sharded.data(), size, start)));
+
+    ReferenceCrypt(sections, reference.data(), size, start);
+
+    TEST_CHECK(sharded == single);
+    TEST_CHECK(single == reference);
+}
+
+} // namespace
+
+int main() {
+    std::mt19937_64 rng{0x4E435A};
+
+    // a ctr section, an uncrypted section and a second ctr section with a
+    // different key, with boundaries that are not block aligned.
+    const u64 total = 1024 * 1024 * 3 + 0x123;
+    const ncz::Section sections[] = {
+        MakeSection(0, 1024 * 1024 + 0x7, nca::EncryptionType_AesCtr, rng),
+        MakeSection(1024 * 1024 + 0x7, 0x10009, nca::EncryptionType_None, rng),
+        MakeSection(1024 * 1024 + 0x10010, total - (1024 * 1024 + 0x10010), nca::EncryptionType_AesCtr, rng),
+    };
+
+    std::vector<u8> plain(total);
+    for (auto& e : plain) e = rng();
+
+    yati::ThreadPool pool{};
+    TEST_CHECK(R_SUCCEEDED(pool.Create(3, 1024 * 64)));
+
+    // whole range, aligned and unaligned starts and sizes, various shard counts.
+    for (const u32 threads : {1U, 2U, 3U, 4U}) {
+        TestRange(pool, sections, plain, 0, total, threads);
+        TestRange(pool, sections, plain, 0x3, total - 0x3, threads);
+        TestRange(pool, sections, plain, 0x1001, 1024 * 1024 * 2 + 0x11, threads);
+        TestRange(pool, sections, plain, 1024 * 512 + 0x9, 1024 * 768 + 0x5, threads);
+    }
+
+    // smaller than a shard is crypted on the calling thread only.
+    TestRange(pool, sections, plain, 0x10, yati::NczCtrCrypter::MIN_SHARD_SIZE - 1, 4);
+
+    // offsets outside of every section fail rather than being skipped.
+    std::vector<u8> out_of_range(0x20);
+    TEST_CHECK(R_FAILED(yati::CryptNczSections(sections, out_of_range.data(), out_of_range.size(), total)));
+
+    return TEST_RESULT();
+}
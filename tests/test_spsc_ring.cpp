@@ -0,0 +1,178 @@
+// pushes millions of items through the ring from one thread to another,
+// checking that every item arrives once and in order, whilst a third thread
+// keeps changing the depth (as the tuner does).
+// also checks that close wakes up a parked producer / consumer.
+
+#include "test.hpp"
+#include "yati/spsc_ring.hpp"
+
+#include <memory>
+#include <random>
+#include <thread>
+
+namespace {
+
+using namespace sphaira;
+
+constexpr u64 ITEM_COUNT = 1024 * 1024 * 4;
+
+void TestOrder() {
+    yati::SpscRing<u64, 8> ring{};
+    std::atomic_bool done{};
+    u64 received{};
+    u64 out_of_order{};
+
+    std::thread consumer{[&]{
+        u64 expected{};
+        u64 value{};
+        while (ring.Pop(value)) {
+            if (value != expected) {
+                out_of_order++;
+            }
+            expected = value + 1;
+            received++;
+        }
+    }};
+
+    std::thread tuner{[&]{
+        std::mt19937 rng{0x5350};
+        while (!done) {
+            ring.SetCapacity(1 + rng() % 8);
+            std::this_thread::yield();
+        }
+    }};
+
+    bool pushed = true;
+    for (u64 i = 0; i < ITEM_COUNT && pushed; i++) {
+        auto value = i;
+        pushed = ring.Push(value);
+    }
+    TEST_CHECK(pushed);
+
+    ring.Close();
+    consumer.join();
+    done = true;
+    tuner.join();
+
+    TEST_CHECK(received == ITEM_COUNT);
+    TEST_CHECK(out_of_order == 0);
+    TEST_CHECK(ring.size() == 0);
+}
+
+// move-only items, such as pooled buffers, are moved through and never copied or lost.
+void TestMoveOnly() {
+    constexpr u64 COUNT = 1024 * 256;
+
+    yati::SpscRing<std::unique_ptr<u64>, 4> ring{};
+    u64 sum{};
+    u64 empty{};
+
+    std::thread consumer{[&]{
+        std::unique_ptr<u64> value{};
+        while (ring.Pop(value)) {
+            if (!value) {
+                empty++;
+            } else {
+                sum += *value;
+            }
+        }
+    }};
+
+    for (u64 i = 0; i < COUNT; i++) {
+        auto value = std::make_unique<u64>(i);
+        TEST_CHECK(ring.Push(value));
+        TEST_CHECK(!value);
+    }
+
+    ring.Close();
+    consumer.join();
+
+    TEST_CHECK(empty == 0);
+    TEST_CHECK(sum == COUNT * (COUNT - 1) / 2);
+}
+
+void TestClose() {
+    // a producer parked on a full ring returns false once closed, keeping its item.
+    {
+        yati::SpscRing<u64, 2> ring{};
+        u64 value = 1;
+        TEST_CHECK(ring.Push(value));
+        TEST_CHECK(ring.Push(value));
+
+        bool pushed = true;
+        u64 kept = 3;
+        std::thread producer{[&]{ pushed = ring.Push(kept); }};
+        std::this_thread::sleep_for(std::chrono::milliseconds(20));
+        ring.Close();
+        producer.join();
+
+        TEST_CHECK(!pushed);
+        TEST_CHECK(kept == 3);
+
+        // what was pushed before closing can still be popped.
+        TEST_CHECK(ring.Pop(value));
+        TEST_CHECK(ring.Pop(value));
+        TEST_CHECK(!ring.Pop(value));
+    }
+
+    // a consumer parked on an empty ring returns false once closed.
+    {
+        yati::SpscRing<u64, 2> ring{};
+        bool popped = true;
+        std::thread consumer{[&]{
+            u64 value{};
+            popped = ring.Pop(value);
+        }};
+        std::this_thread::sleep_for(std::chrono::milliseconds(20));
+        ring.Close();
+        consumer.join();
+
+        TEST_CHECK(!popped);
+        TEST_CHECK(ring.GetPopWaitTicks() > 0);
+    }
+}
+
+// shrinking the depth blocks the producer until the ring drains below it.
+void TestShrink() {
+    yati::SpscRing<u64, 8> ring{};
+    u64 value{};
+    for (u32 i = 0; i < 4; i++) {
+        TEST_CHECK(ring.Push(value));
+    }
+
+    ring.SetCapacity(2);
+    TEST_CHECK(ring.capacity() == 2);
+
+    std::atomic_bool pushed{};
+    std::thread producer{[&]{
+        u64 v{};
+        pushed = ring.Push(v);
+    }};
+
+    // 4 -> 2 still full.
+    TEST_CHECK(ring.Pop(value));
+    TEST_CHECK(ring.Pop(value));
+    std::this_thread::sleep_for(std::chrono::milliseconds(20));
+    TEST_CHECK(!pushed);
+
+    TEST_CHECK(ring.Pop(value));
+    producer.join();
+    TEST_CHECK(pushed);
+    TEST_CHECK(ring.size() == 2);
+
+    // clamped to [1, Size].
+    ring.SetCapacity(0);
+    TEST_CHECK(ring.capacity() == 1);
+    ring.SetCapacity(100);
+    TEST_CHECK(ring.capacity() == 8);
+}
+
+} // namespace
+
+int main() {
+    TestOrder();
+    TestMoveOnly();
+    TestClose();
+    TestShrink();
+    return TEST_RESULT();
+}
@@ -0,0 +1,166 @@
+// checks the tuner's decisions for source bound, output bound and idle
+// samples, that it never leaves the depth / chunk size limits, and that
+// profiles survive a save / load.
+
+#include "test.hpp"
+#include "yati/tuner.hpp"
+#include "defines.hpp"
+
+#include <cstdio>
+#include <string>
+
+namespace {
+
+using namespace sphaira::yati;
+
+constexpr s64 PERIOD = tuner::SAMPLE_PERIOD_NS;
+
+// writer starved, rings never full.
+constexpr tuner::Sample SOURCE_BOUND{PERIOD, 0, PERIOD / 2};
+// rings always full, writer never starved.
+constexpr tuner::Sample OUTPUT_BOUND{PERIOD, PERIOD / 2, 0};
+
+// updates, then applies the wanted depth as the caller would if the memory is there.
+void Step(tuner::Tuner& tune, const tuner::Sample& sample) {
+    tune.Update(sample);
+    tune.SetDepth(tune.GetWanted().depth);
+}
+
+void TestSourceBound() {
+    tuner::Tuner tune{{}};
+    Step(tune, SOURCE_BOUND);
+    TEST_CHECK(tune.GetProfile().depth == tuner::DEFAULT_DEPTH + 1);
+    TEST_CHECK(tune.GetProfile().chunk_size == tuner::MAX_CHUNK_SIZE - tuner::CHUNK_STEP);
+    TEST_CHECK(tune.GetSampleCount() == 1);
+}
+
+void TestOutputBound() {
+    tuner::Profile profile{};
+    profile.chunk_size = tuner::MIN_CHUNK_SIZE;
+    tuner::Tuner tune{profile};
+    Step(tune, OUTPUT_BOUND);
+    TEST_CHECK(tune.GetProfile().depth == tuner::DEFAULT_DEPTH - 1);
+    TEST_CHECK(tune.GetProfile().chunk_size == tuner::MIN_CHUNK_SIZE + tuner::CHUNK_STEP);
+}
+
+void TestIdle() {
+    const tuner::Profile profile{};
+    tuner::Tuner tune{profile};
+
+    // nothing stalls, both stall, or neither is clearly the bottleneck.
+    for (const auto& sample : {
+        tuner::Sample{PERIOD, 0, 0},
+        tuner::Sample{PERIOD, PERIOD / 2, PERIOD / 2},
+        tuner::Sample{PERIOD, PERIOD / 10, PERIOD / 10},
+        tuner::Sample{PERIOD, PERIOD / 10, PERIOD / 2},
+    }) {
+        Step(tune, sample);
+        TEST_CHECK(tune.GetProfile().depth == profile.depth);
+        TEST_CHECK(tune.GetProfile().chunk_size == profile.chunk_size);
+    }
+    TEST_CHECK(tune.GetSampleCount() == 4);
+
+    // an empty period is not a sample.
+    Step(tune, {});
+    TEST_CHECK(tune.GetSampleCount() == 4);
+}
+
+void TestClamp() {
+    tuner::Tuner tune{{}};
+    for (u32 i = 0; i < 20; i++) {
+        Step(tune, SOURCE_BOUND);
+        TEST_CHECK(tune.GetWanted().depth <= tuner::MAX_DEPTH);
+        TEST_CHECK(tune.GetWanted().chunk_size >= tuner::MIN_CHUNK_SIZE);
+    }
+    TEST_CHECK(tune.GetProfile().depth == tuner::MAX_DEPTH);
+    TEST_CHECK(tune.GetProfile().chunk_size == tuner::MIN_CHUNK_SIZE);
+
+    for (u32 i = 0; i < 20; i++) {
+        Step(tune, OUTPUT_BOUND);
+        TEST_CHECK(tune.GetWanted().depth >= tuner::MIN_DEPTH);
+        TEST_CHECK(tune.GetWanted().chunk_size <= tuner::MAX_CHUNK_SIZE);
+    }
+    TEST_CHECK(tune.GetProfile().depth == tuner::MIN_DEPTH);
+    TEST_CHECK(tune.GetProfile().chunk_size == tuner::MAX_CHUNK_SIZE);
+
+    // out of range profiles are clamped, and the chunk size rounded down to a step.
+    tuner::Profile profile{};
+    profile.depth = 100;
+    profile.chunk_size = tuner::MIN_CHUNK_SIZE + tuner::CHUNK_STEP + 123;
+    const tuner::Tuner clamped{profile};
+    TEST_CHECK(clamped.GetProfile().depth == tuner::MAX_DEPTH);
+    TEST_CHECK(clamped.GetProfile().chunk_size == tuner::MIN_CHUNK_SIZE + tuner::CHUNK_STEP);
+
+    profile.depth = 0;
+    profile.chunk_size = 1;
+    const tuner::Tuner low{profile};
+    TEST_CHECK(low.GetProfile().depth == tuner::MIN_DEPTH);
+    TEST_CHECK(low.GetProfile().chunk_size == tuner::MIN_CHUNK_SIZE);
+}
+
+// the depth the caller couldn't apply stays wanted, rather than being lost.
+void TestDepthNotApplied() {
+    tuner::Tuner tune{{}};
+    tune.Update(SOURCE_BOUND);
+    TEST_CHECK(tune.GetWanted().depth == tuner::DEFAULT_DEPTH + 1);
+    TEST_CHECK(tune.GetProfile().depth == tuner::DEFAULT_DEPTH);
+    tune.Update(SOURCE_BOUND);
+    TEST_CHECK(tune.GetWanted().depth == tuner::DEFAULT_DEPTH + 1);
+}
+
+void TestSaveLoad() {
+    // a storage id no install uses, so that real profiles are left alone.
+    const tuner::Key key{true, 0xEE, true};
+    const tuner::Key other{false, 0xEE, true};
+    const auto path = std::string{tuner::TUNING_PATH} + "/stream_238_ncz.bin";
+    std::remove(path.c_str());
+
+    tuner::Profile out{};
+    TEST_CHECK(tuner::Load(key, out) == Result_YatiTuningNotFound);
+
+    tuner::Profile profile{};
+    profile.depth = 6;
+    profile.chunk_size = tuner::MIN_CHUNK_SIZE + tuner::CHUNK_STEP * 3;
+    TEST_CHECK(R_SUCCEEDED(tuner::Save(key, profile)));
+    TEST_CHECK(R_SUCCEEDED(tuner::Load(key, out)));
+    TEST_CHECK(out.depth == profile.depth);
+    TEST_CHECK(out.chunk_size == profile.chunk_size);
+
+    // profiles are per key.
+    TEST_CHECK(tuner::Load(other, out) == Result_YatiTuningNotFound);
+
+    // saving clamps too.
+    profile.depth = 100;
+    TEST_CHECK(R_SUCCEEDED(tuner::Save(key, profile)));
+    TEST_CHECK(R_SUCCEEDED(tuner::Load(key, out)));
+    TEST_CHECK(out.depth == tuner::MAX_DEPTH);
+
+    // a file from another version is rejected.
+    profile.version = tuner::VERSION + 1;
+    if (auto f = std::fopen(path.c_str(), "wb")) {
+        std::fwrite(&profile, 1, sizeof(profile), f);
+        std::fclose(f);
+    }
+    TEST_CHECK(tuner::Load(key, out) == Result_YatiTuningInvalid);
+
+    // as is a short file.
+    if (auto f = std::fopen(path.c_str(), "wb")) {
+        std::fwrite(&profile, 1, sizeof(profile) / 2, f);
+        std::fclose(f);
+    }
+    TEST_CHECK(tuner::Load(key, out) == Result_YatiTuningInvalid);
+
+    std::remove(path.c_str());
+}
+
+} // namespace
+
+int main() {
+    TestSourceBound();
+    TestOutputBound();
+    TestIdle();
+    TestClamp();
+    TestDepthNotApplied();
+    TestSaveLoad();
+    return TEST_RESULT();
+}